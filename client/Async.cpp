@@ -0,0 +1,200 @@
+#include "Async.h"
+#include <chrono>
+#include <cstdlib>
+#include <new>
+
+#include "ServerCluster.h"
+#include "Stats.h"
+
+// ------------------------- coroutine frames -------------------------
+
+// Frames up to MAX_POOLED_FRAME bytes are kept on per-size-class free
+// lists when their task ends and handed out again to the next one.
+static constexpr size_t FRAME_CLASS = 64;
+static constexpr size_t MAX_POOLED_FRAME = 4096;
+
+struct FreeFrame
+{
+    FreeFrame *next;
+};
+
+static thread_local FreeFrame *freeFrames[MAX_POOLED_FRAME / FRAME_CLASS];
+
+void *coroFrameAlloc(size_t size)
+{
+    if (size > MAX_POOLED_FRAME)
+        return ::operator new(size);
+    FreeFrame *&head = freeFrames[(size - 1) / FRAME_CLASS];
+    if (FreeFrame *f = head)
+    {
+        head = f->next;
+        return f;
+    }
+    return ::operator new((size + FRAME_CLASS - 1) / FRAME_CLASS * FRAME_CLASS);
+}
+
+void coroFrameFree(void *frame, size_t size)
+{
+    if (size > MAX_POOLED_FRAME)
+    {
+        ::operator delete(frame);
+        return;
+    }
+    FreeFrame *&head = freeFrames[(size - 1) / FRAME_CLASS];
+    head = new (frame) FreeFrame{head};
+}
+
+// ------------------------- EventLoop -------------------------
+
+static int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+EventLoop::EventLoop(ServerCluster &cluster) : cluster(cluster), inFlightOn(cluster.size()) {}
+
+// Sends the frame and joins the node's list; on a failed send the
+// coroutine continues at once with ok == false.
+bool EventLoop::Exchange::await_suspend(std::coroutine_handle<> h)
+{
+    auto &stats = ClientStats::instance();
+    code = Protocol::requestCodeOf(req, reqLen);
+    startNs = nowNs();
+
+    ServerConnection *conn = loop.cluster.connection(node);
+    bool sent = false;
+    if (conn && conn->multiplexed())
+    {
+        Protocol::buildMuxFrame(loop.muxFrame, req, reqLen, static_cast<uint32_t>(loop.nextSeq));
+        sent = conn->sendAll(loop.muxFrame);
+    }
+    else if (conn)
+    {
+        sent = conn->sendAll(req, static_cast<int>(reqLen));
+    }
+    if (!sent)
+    {
+        stats.countTransportError(code);
+        loop.failNode(node);
+        return false;
+    }
+    stats.addBytesOut(code, reqLen);
+    stats.record(code, Phase::Send, static_cast<uint64_t>(nowNs() - startNs));
+
+    waiter = h;
+    seq = loop.nextSeq++;
+    Fifo &q = loop.inFlightOn[node];
+    (q.tail ? q.tail->next : q.head) = this;
+    q.tail = this;
+    ++loop.pending;
+    return true;
+}
+
+void EventLoop::failNode(size_t node)
+{
+    Fifo &q = inFlightOn[node];
+    while (Exchange *x = q.head)
+    {
+        q.head = x->next;
+        --pending;
+        x->ok = false;
+        ClientStats::instance().countTransportError(x->code);
+        post(x->waiter);
+    }
+    q.tail = nullptr;
+}
+
+bool EventLoop::step()
+{
+    if (readyPos < ready.size())
+    {
+        auto h = ready[readyPos++];
+        if (readyPos == ready.size())
+        {
+            ready.clear();
+            readyPos = 0;
+        }
+        h.resume();
+        return true;
+    }
+    if (!pending)
+        return false;
+
+    // the oldest exchange in flight: its node owes us a reply
+    size_t node = 0;
+    for (size_t n = 0; n < inFlightOn.size(); ++n)
+    {
+        if (inFlightOn[n].head && (!inFlightOn[node].head || inFlightOn[n].head->seq < inFlightOn[node].head->seq))
+            node = n;
+    }
+
+    auto &stats = ClientStats::instance();
+    ServerConnection *conn = cluster.connection(node);
+    const int64_t tWait = nowNs();
+    const bool mux = conn && conn->multiplexed();
+    uint8_t h[MuxReplyHeader::size];
+    const size_t headerSize = mux ? MuxReplyHeader::size : ReplyHeader::size;
+    if (!conn || !conn->recvExact(h, static_cast<int>(headerSize)))
+    {
+        failNode(node);
+        return true;
+    }
+    const ServerReply hdr = mux ? Protocol::parseMuxReplyHeader(h) : Protocol::parseServerReplyHeader(h);
+    Exchange *x = takeAnswered(node, mux, hdr);
+    if (!x)
+    {
+        // a reply nobody asked for: the stream can't be trusted any more
+        conn->disconnect();
+        failNode(node);
+        return true;
+    }
+    x->hdr = hdr;
+    const int64_t tHeader = nowNs();
+    stats.record(x->code, Phase::WaitHeader, static_cast<uint64_t>(tHeader - tWait));
+
+    x->payload.clear();
+    if (x->hdr.payloadSize)
+    {
+        x->payload.resize(x->hdr.payloadSize);
+        if (!conn->recvExact(x->payload.data(), static_cast<int>(x->payload.size())))
+        {
+            x->ok = false;
+            stats.countTransportError(x->code);
+            post(x->waiter);
+            failNode(node);
+            return true;
+        }
+    }
+    const int64_t tDone = nowNs();
+    stats.record(x->code, Phase::RecvPayload, static_cast<uint64_t>(tDone - tHeader));
+    stats.record(x->code, Phase::Total, static_cast<uint64_t>(tDone - x->startNs));
+    stats.addBytesIn(x->code, headerSize + x->payload.size());
+    if (x->hdr.code == CODE_ERROR)
+        stats.countServerError(x->code);
+
+    x->ok = true;
+    x->waiter.resume();
+    return true;
+}
+
+EventLoop::Exchange *EventLoop::takeAnswered(size_t node, bool mux, const ServerReply &hdr)
+{
+    Fifo &q = inFlightOn[node];
+    Exchange *prev = nullptr;
+    Exchange *x = q.head;
+    // few exchanges are in flight per node: a scan is cheaper than a map
+    while (mux && x && static_cast<uint32_t>(x->seq) != hdr.requestId)
+    {
+        prev = x;
+        x = x->next;
+    }
+    if (!x)
+        return nullptr;
+    (prev ? prev->next : q.head) = x->next;
+    if (q.tail == x)
+        q.tail = prev;
+    --pending;
+    return x;
+}
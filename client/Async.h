@@ -0,0 +1,371 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Protocol.h"
+
+class ServerCluster;
+
+//
+// ============================================================================
+//  Async.h
+//  --------------------------------------------------------------------------
+//  Coroutine form of the client operations (C++20).
+//
+//      Task<T>     lazy coroutine: starts when awaited (or start()ed) and
+//                  resumes its awaiter when it finishes
+//      EventLoop   drives the tasks of one session on one thread; its
+//                  exchange() awaitable writes a request frame right away
+//                  and suspends until the reply is in
+//      AsyncMutex  serializes an operation across suspensions
+//
+//  Any number of exchanges can be in flight on the same connection, so N
+//  public-key fetches cost about one round trip instead of N. On a
+//  multiplexed connection (see Protocol.h) each request carries the
+//  loop's sequence number as its id and a reply goes to the waiter with
+//  that id, in whatever order the server finishes them. Otherwise the
+//  server answers in order and each reply goes to the oldest waiter of
+//  the node. Nothing runs behind the caller's back: the loop only makes
+//  progress inside run().
+//
+//  Coroutine frames are recycled through a per-thread free list, so a
+//  warmed-up operation still does not touch the heap.
+// ============================================================================
+//
+
+// Frame storage for every Task coroutine (see Async.cpp).
+void *coroFrameAlloc(size_t size);
+void coroFrameFree(void *frame, size_t size);
+
+template <typename T>
+class Task
+{
+public:
+    struct promise_type
+    {
+        std::optional<T> value;
+        std::exception_ptr error;
+        std::coroutine_handle<> continuation;
+        bool started = false;
+
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        // resumes whoever awaited the task
+        struct FinalAwaiter
+        {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept
+            {
+                auto next = h.promise().continuation;
+                return next ? next : std::noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        void return_value(T v) { value = std::move(v); }
+        void unhandled_exception() { error = std::current_exception(); }
+
+        static void *operator new(size_t size) { return coroFrameAlloc(size); }
+        static void operator delete(void *frame, size_t size) { coroFrameFree(frame, size); }
+    };
+    using Handle = std::coroutine_handle<promise_type>;
+
+    Task() = default;
+    Task(Task &&other) noexcept : h(std::exchange(other.h, {})) {}
+    Task &operator=(Task &&other) noexcept
+    {
+        if (this != &other)
+        {
+            if (h)
+                h.destroy();
+            h = std::exchange(other.h, {});
+        }
+        return *this;
+    }
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+    ~Task()
+    {
+        if (h)
+            h.destroy();
+    }
+
+    // Runs the task up to its first suspension (no-op if already started).
+    void start()
+    {
+        if (h && !h.promise().started)
+        {
+            h.promise().started = true;
+            h.resume();
+        }
+    }
+
+    bool done() const { return !h || h.done(); }
+
+    // Result of a finished task; rethrows what the coroutine threw.
+    T result()
+    {
+        if (h.promise().error)
+            std::rethrow_exception(h.promise().error);
+        return std::move(*h.promise().value);
+    }
+
+    auto operator co_await() noexcept
+    {
+        struct Awaiter
+        {
+            Handle h;
+            bool await_ready() noexcept { return h.done(); }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+            {
+                h.promise().continuation = awaiting;
+                if (h.promise().started)
+                    return std::noop_coroutine(); // already running: resumes us when done
+                h.promise().started = true;
+                return h;
+            }
+            T await_resume()
+            {
+                if (h.promise().error)
+                    std::rethrow_exception(h.promise().error);
+                return std::move(*h.promise().value);
+            }
+        };
+        return Awaiter{h};
+    }
+
+private:
+    explicit Task(Handle h) : h(h) {}
+
+    Handle h;
+};
+
+// Starts every task, then awaits them in order: whatever each one sends
+// before its first suspension is on the wire before any reply is read.
+template <typename T>
+Task<std::vector<T>> whenAll(std::vector<Task<T>> tasks)
+{
+    for (auto &t : tasks)
+        t.start();
+    std::vector<T> results;
+    results.reserve(tasks.size());
+    for (auto &t : tasks)
+        results.push_back(co_await t);
+    co_return results;
+}
+
+class EventLoop
+{
+public:
+    explicit EventLoop(ServerCluster &cluster);
+
+    // One request/reply exchange with 'node'. The frame is sent when the
+    // awaiter suspends (the caller's buffer may be reused right after);
+    // 'hdr' and 'payload' are filled when the reply arrives. Resumes with
+    // false on a transport failure.
+    class Exchange
+    {
+    public:
+        Exchange(EventLoop &loop, size_t node, const uint8_t *req, size_t reqLen, ServerReply &hdr,
+                 std::vector<uint8_t> &payload)
+            : loop(loop), node(node), req(req), reqLen(reqLen), hdr(hdr), payload(payload)
+        {
+        }
+
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> h);
+        bool await_resume() const noexcept { return ok; }
+
+    private:
+        friend class EventLoop;
+
+        EventLoop &loop;
+        size_t node;
+        const uint8_t *req;
+        size_t reqLen;
+        ServerReply &hdr;
+        std::vector<uint8_t> &payload;
+
+        std::coroutine_handle<> waiter;
+        Exchange *next = nullptr; // node list, in send order
+        uint64_t seq = 0;         // send order across nodes; request id (low 32 bits)
+        uint16_t code = 0;
+        int64_t startNs = 0;
+        bool ok = false;
+    };
+
+    Exchange exchange(size_t node, const uint8_t *req, size_t reqLen, ServerReply &hdr,
+                      std::vector<uint8_t> &payload)
+    {
+        return Exchange(*this, node, req, reqLen, hdr, payload);
+    }
+
+    // Drives the loop until 'task' finishes and returns its result. Must
+    // not be called from inside a task of the same loop.
+    //
+    // Should the loop run out of work with the task still suspended (it
+    // waits for a wake-up that never comes: a bug), the task is destroyed
+    // (an AsyncMutex forgets its waiters in it) and the result is
+    // T::failure("Event loop stalled.") or false; any other T asserts.
+    template <typename T>
+    T run(Task<T> task)
+    {
+        task.start();
+        while (!task.done() && step())
+        {
+        }
+        if (task.done())
+            return task.result();
+        if constexpr (requires { T::failure(std::string()); })
+            return T::failure("Event loop stalled.");
+        else if constexpr (std::is_same_v<T, bool>)
+            return false;
+        else
+        {
+            assert(!"event loop stalled");
+            return T{};
+        }
+    }
+
+    // Resumes 'h' from the loop on its next step.
+    void post(std::coroutine_handle<> h) { ready.push_back(h); }
+
+    // Takes back a post() not yet resumed; false if there is none.
+    bool unpost(std::coroutine_handle<> h)
+    {
+        auto it = std::find(ready.begin() + static_cast<std::ptrdiff_t>(readyPos), ready.end(), h);
+        if (it == ready.end())
+            return false;
+        ready.erase(it);
+        return true;
+    }
+
+    // Exchanges sent and not yet answered.
+    size_t inFlight() const { return pending; }
+
+private:
+    // Resumes one posted coroutine, or reads the next reply from the node
+    // of the oldest exchange in flight (blocking) and resumes its waiter.
+    // False when there is nothing left to wait for.
+    bool step();
+
+    // Unlinks the exchange in flight on 'node' that a reply with 'hdr'
+    // answers: the one with its id when multiplexed, else the oldest.
+    // nullptr if there is none.
+    Exchange *takeAnswered(size_t node, bool mux, const ServerReply &hdr);
+
+    // Completes every exchange in flight on 'node' with ok == false: their
+    // replies died with the connection.
+    void failNode(size_t node);
+
+    struct Fifo
+    {
+        Exchange *head = nullptr;
+        Exchange *tail = nullptr;
+    };
+
+    ServerCluster &cluster;
+    std::vector<Fifo> inFlightOn; // per node
+    std::vector<uint8_t> muxFrame; // request re-framed with its id
+    std::vector<std::coroutine_handle<>> ready;
+    size_t readyPos = 0;
+    size_t pending = 0;
+    uint64_t nextSeq = 0;
+};
+
+// Mutual exclusion between tasks of one loop:
+//     auto guard = co_await mutex.lock();
+class AsyncMutex
+{
+public:
+    explicit AsyncMutex(EventLoop &loop) : loop(loop) {}
+
+    class Guard
+    {
+    public:
+        explicit Guard(AsyncMutex *m) : m(m) {}
+        Guard(Guard &&other) noexcept : m(std::exchange(other.m, nullptr)) {}
+        Guard(const Guard &) = delete;
+        Guard &operator=(const Guard &) = delete;
+        Guard &operator=(Guard &&) = delete;
+        ~Guard()
+        {
+            if (m)
+                m->unlock();
+        }
+
+    private:
+        AsyncMutex *m;
+    };
+
+    auto lock()
+    {
+        struct Awaiter
+        {
+            AsyncMutex &m;
+            std::coroutine_handle<> waiter;
+            ~Awaiter()
+            {
+                if (waiter)
+                    m.forget(waiter); // its coroutine was destroyed while waiting
+            }
+            bool await_ready()
+            {
+                if (m.locked)
+                    return false;
+                m.locked = true;
+                return true;
+            }
+            void await_suspend(std::coroutine_handle<> h)
+            {
+                waiter = h;
+                m.waiters.push_back(h);
+            }
+            Guard await_resume() // handed over by unlock()
+            {
+                waiter = nullptr;
+                return Guard(&m);
+            }
+        };
+        return Awaiter{*this, nullptr};
+    }
+
+private:
+    // Passes the lock to the oldest waiter (resumed by the loop).
+    void unlock()
+    {
+        if (waiters.empty())
+        {
+            locked = false;
+            return;
+        }
+        loop.post(waiters.front());
+        waiters.erase(waiters.begin());
+    }
+
+    // Drops a waiter that will never run; if the lock was already handed
+    // to it, passes the lock on.
+    void forget(std::coroutine_handle<> h)
+    {
+        auto it = std::find(waiters.begin(), waiters.end(), h);
+        if (it != waiters.end())
+            waiters.erase(it);
+        else if (loop.unpost(h))
+            unlock();
+    }
+
+    EventLoop &loop;
+    bool locked = false;
+    std::vector<std::coroutine_handle<>> waiters;
+};
@@ -0,0 +1,219 @@
+#include "Batch.h"
+#include <charconv>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Stats.h"
+#include "Utils.h"
+
+// splits "op arg rest..." -> op, arg, rest (rest keeps inner spaces)
+static void splitCommand(const std::string &line, std::string &op, std::string &arg, std::string &rest)
+{
+    std::istringstream ss(line);
+    ss >> op >> arg;
+    std::getline(ss, rest);
+    if (!rest.empty() && rest[0] == ' ')
+        rest.erase(0, 1);
+}
+
+// s[from..] as a decimal number; false if it is anything else or overflows
+static bool parseNumber(const std::string &s, size_t from, uint32_t &out)
+{
+    const char *first = s.data() + from, *last = s.data() + s.size();
+    const auto [end, ec] = std::from_chars(first, last, out);
+    return ec == std::errc() && end == last && first != last;
+}
+
+int runBatch(ClientSession &session, std::istream &in, std::ostream &out)
+{
+    using clock = std::chrono::steady_clock;
+    int failures = 0;
+    size_t lineNo = 0;
+    std::string line;
+    // reused across commands so repeated list/pull lines keep their capacity
+    std::vector<std::string> names;
+    std::vector<ReceivedMessage> msgs;
+    std::vector<HistoryMessage> page;
+
+    while (std::getline(in, line))
+    {
+        ++lineNo;
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        size_t first = line.find_first_not_of(" \t");
+        if (first == std::string::npos || line[first] == '#')
+            continue;
+
+        std::string op, arg, rest;
+        splitCommand(line, op, arg, rest);
+
+        std::string extra; // additional JSON fields, each starting with ','
+        OpResult res;
+        const auto t0 = clock::now();
+
+        if (op == "register")
+        {
+            res = session.registerUser(arg);
+        }
+        else if (op == "list")
+        {
+            res = session.refreshClients(&names);
+            if (res.ok)
+            {
+                extra = ",\"clients\":[";
+                for (size_t i = 0; i < names.size(); ++i)
+                    extra += (i ? ",\"" : "\"") + jsonEscape(names[i]) + "\"";
+                extra += "]";
+            }
+        }
+        else if (op == "pubkey")
+        {
+            // several names: one bulk request for all of them
+            std::istringstream more(rest);
+            names.assign(1, arg);
+            for (std::string n; more >> n;)
+                names.push_back(n);
+            res = names.size() == 1 ? session.fetchPublicKey(arg) : session.fetchPublicKeys(names);
+        }
+        else if (op == "prefetch")
+        {
+            size_t fetched = 0;
+            res = session.prefetchPublicKeys(&fetched);
+            extra = ",\"fetched\":" + std::to_string(fetched);
+        }
+        else if (op == "lookup")
+        {
+            res = session.lookupUser(arg);
+        }
+        else if (op == "reqkey")
+        {
+            res = session.requestSymmetricKey(arg);
+        }
+        else if (op == "sendkey")
+        {
+            res = session.sendSymmetricKey(arg);
+        }
+        else if (op == "send")
+        {
+            res = session.sendText(arg, rest);
+        }
+        else if (op == "queue")
+        {
+            res = session.queueText(arg, rest);
+        }
+        else if (op == "flush")
+        {
+            size_t sent = 0;
+            res = session.flushOutbox(&sent);
+            extra = ",\"sent\":" + std::to_string(sent) + ",\"pending\":" + std::to_string(session.outboxSize());
+        }
+        else if (op == "pull")
+        {
+            res = session.pullMessages(msgs);
+            if (res.ok)
+            {
+                extra = ",\"messages\":[";
+                for (size_t i = 0; i < msgs.size(); ++i)
+                {
+                    const auto &m = msgs[i];
+                    if (i)
+                        extra += ",";
+                    extra += "{\"from\":\"" + jsonEscape(m.fromName) + "\"" +
+                             ",\"known\":" + (m.nameResolved ? "true" : "false") +
+                             ",\"id\":" + std::to_string(m.msgId) +
+                             ",\"type\":" + std::to_string(m.type) +
+                             ",\"ok\":" + (m.failed ? "false" : "true") +
+                             ",\"text\":\"" + jsonEscape(m.text) + "\"}";
+                }
+                extra += "]";
+            }
+        }
+        else if (op == "history")
+        {
+            // rest: [count] [before=<msgId>|until=<unixTime>]
+            std::istringstream ss(rest);
+            size_t count = 20;
+            uint32_t cursor = 0;
+            std::string tok;
+            bool known = true, valid = true;
+            uint32_t n = 0;
+            while (valid && ss >> tok)
+            {
+                if (tok.rfind("before=", 0) == 0)
+                {
+                    if ((valid = parseNumber(tok, 7, n)))
+                        known = (cursor = session.historyCursorAt(n)) != 0;
+                }
+                else if (tok.rfind("until=", 0) == 0)
+                {
+                    if ((valid = parseNumber(tok, 6, n)))
+                        cursor = session.historyCursorAfter(n);
+                }
+                else if ((valid = parseNumber(tok, 0, n)))
+                    count = n;
+            }
+            if (!valid)
+                res = OpResult::failure("not a number: " + tok);
+            else
+                res = known ? session.historyPage(arg, cursor, count, page)
+                            : OpResult::failure("message id is not in the history");
+            if (res.ok)
+            {
+                extra = ",\"messages\":[";
+                for (size_t i = 0; i < page.size(); ++i)
+                {
+                    const auto &m = page[i];
+                    if (i)
+                        extra += ",";
+                    extra += "{\"ref\":" + std::to_string(m.ref) +
+                             ",\"id\":" + std::to_string(m.msgId) +
+                             ",\"time\":" + std::to_string(m.time) +
+                             ",\"type\":" + std::to_string(m.type) +
+                             ",\"ok\":" + (m.failed ? "false" : "true") +
+                             ",\"text\":\"" + jsonEscape(m.text) + "\"}";
+                }
+                extra += "]";
+            }
+        }
+        else if (op == "stats")
+        {
+            std::ostringstream ss;
+            ClientStats::instance().print(ss);
+            res = OpResult::success();
+            extra = ",\"stats\":\"" + jsonEscape(ss.str()) + "\"";
+        }
+        else if (op == "serverstats")
+        {
+            res = session.serverStats(names, arg == "reset");
+            if (res.ok)
+            {
+                extra = ",\"servers\":[";
+                for (size_t i = 0; i < names.size(); ++i)
+                    extra += (i ? "," : "") + names[i]; // already JSON
+                extra += "]";
+            }
+        }
+        else
+        {
+            res = OpResult::failure("unknown command");
+        }
+
+        const double us = std::chrono::duration<double, std::micro>(clock::now() - t0).count();
+        if (!res.ok)
+            ++failures;
+
+        std::ostringstream rec;
+        rec.setf(std::ios::fixed);
+        rec.precision(1);
+        rec << "{\"line\":" << lineNo << ",\"op\":\"" << jsonEscape(op) << "\",\"ok\":"
+            << (res.ok ? "true" : "false") << ",\"us\":" << us;
+        if (!res.ok)
+            rec << ",\"error\":\"" << jsonEscape(res.error) << "\"";
+        rec << extra << "}\n";
+        out << rec.str();
+    }
+    out.flush();
+    return failures;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <istream>
+#include <ostream>
+
+#include "ClientSession.h"
+
+//
+// ============================================================================
+//  Batch.h
+//  --------------------------------------------------------------------------
+//  Non-interactive mode: reads one operation per line and runs them back to
+//  back on the session's connection, without any menu output.
+//
+//  Commands (blank lines and lines starting with '#' are ignored):
+//      register <username>
+//      list
+//      pubkey   <username> [<username>...]  (several: one 611 request)
+//      prefetch                     (611: keys of every cached peer)
+//      lookup   <username>          (608: id + key without 'list')
+//      reqkey   <username>          (151)
+//      sendkey  <username>          (152)
+//      send     <username> <text...>
+//      queue    <username> <text...> (encrypt into the outbox only)
+//      flush                        (deliver the outbox in 607 batches)
+//      pull
+//      history  <username> [count] [before=<msgId>|until=<unixTime>]
+//      stats
+//      serverstats [reset]          (610 to every node; reset only over unix:)
+//
+//  Output: one JSON object per command, e.g.
+//      {"line":3,"op":"send","ok":true,"us":412.7}
+//      {"line":4,"op":"pubkey","ok":false,"us":9.1,"error":"Unknown user."}
+//  'list' adds "clients":[...], 'pull' adds "messages":[{...}],
+//  'flush' adds "sent":N,"pending":M; 'prefetch' adds "fetched":N; 'history' adds "messages":[{"ref":..}]
+//  oldest first; 'serverstats' adds "servers":[{...}], one per node.
+// ============================================================================
+//
+
+// Runs every command from 'in'. Returns the number of failed operations.
+int runBatch(ClientSession &session, std::istream &in, std::ostream &out);
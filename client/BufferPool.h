@@ -0,0 +1,107 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+//
+// ============================================================================
+//  BufferPool.h
+//  --------------------------------------------------------------------------
+//  Per-session arena of reusable byte buffers for the request/response path.
+//
+//  acquire() hands out an empty buffer that keeps the capacity it had in
+//  earlier operations; reset() makes every buffer available again. An
+//  operation takes a Scope at its start, so once the buffers have grown to
+//  the working-set size, building requests, receiving replies and crypto
+//  output no longer touch the heap.
+//
+//  A Scope assumes operations nest. Coroutines (Async.h) that hold a
+//  buffer across a suspension take a Lease instead: it is returned when
+//  the Lease ends, whatever else ran in between.
+// ============================================================================
+//
+
+class BufferPool
+{
+public:
+    using Buffer = std::vector<uint8_t>;
+
+    // Returns a cleared buffer (size 0, capacity kept) valid until reset().
+    Buffer &acquire()
+    {
+        if (used == buffers.size())
+            buffers.push_back(std::make_unique<Buffer>());
+        Buffer &b = *buffers[used++];
+        b.clear();
+        return b;
+    }
+
+    // Makes every buffer available again. Capacity is retained.
+    void reset() { used = 0; }
+
+    // Buffers currently handed out / owned.
+    size_t inUse() const { return used; }
+    size_t size() const { return buffers.size(); }
+
+    // Total capacity held, in bytes.
+    size_t capacityBytes() const
+    {
+        size_t n = 0;
+        for (const auto &b : buffers)
+            n += b->capacity();
+        for (const auto &b : spare)
+            n += b->capacity();
+        return n;
+    }
+
+    // Resets the pool when the owning operation ends.
+    class Scope
+    {
+    public:
+        explicit Scope(BufferPool &pool) : pool(pool), mark(pool.used) {}
+        ~Scope() { pool.used = mark; }
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+    private:
+        BufferPool &pool;
+        size_t mark;
+    };
+
+    // One buffer owned until the Lease is destroyed, independent of
+    // Scopes and of other leases.
+    class Lease
+    {
+    public:
+        explicit Lease(BufferPool &pool) : pool(pool)
+        {
+            if (pool.spare.empty())
+            {
+                buf = std::make_unique<Buffer>();
+            }
+            else
+            {
+                buf = std::move(pool.spare.back());
+                pool.spare.pop_back();
+                buf->clear();
+            }
+        }
+        ~Lease() { pool.spare.push_back(std::move(buf)); }
+        Lease(const Lease &) = delete;
+        Lease &operator=(const Lease &) = delete;
+
+        Buffer &operator*() { return *buf; }
+        Buffer *operator->() { return buf.get(); }
+
+    private:
+        BufferPool &pool;
+        std::unique_ptr<Buffer> buf;
+    };
+
+private:
+    // unique_ptr keeps handed-out references valid while the pool grows
+    std::vector<std::unique_ptr<Buffer>> buffers;
+    size_t used = 0;
+    std::vector<std::unique_ptr<Buffer>> spare; // not leased right now
+};
@@ -0,0 +1,1312 @@
+#include "ClientSession.h"
+#include <algorithm>
+
+#include "Codec.h"
+#include "FileConfig.h"
+#include "Encryption.h"
+#include "Stats.h"
+#include "Utils.h"
+
+static const char *NOT_REGISTERED = "Not registered. Please run 110 first.";
+static const char *SERVER_ERROR = "server responded with an error";
+static const char *UNKNOWN_USER = "Unknown user.";
+static const std::string JOIN_FAILED = "Could not register on server ";
+
+// my.info key line of an X25519 identity: prefix + Base64 of the raw private key
+static const std::string X25519_KEY_PREFIX = "x25519:";
+
+static std::atomic<uint64_t> nextSessionSerial{1};
+
+ClientSession::ClientSession(ServerCluster &cluster)
+    : cluster(cluster), serial(nextSessionSerial++), history(FileConfig::historyPath()),
+      outbox(FileConfig::outboxPath())
+{
+}
+
+// A thread remembers the last session it worked for, so the map is only
+// consulted (under the lock) when it switches sessions.
+ClientSession::Worker &ClientSession::worker()
+{
+    thread_local uint64_t cachedSerial = 0;
+    thread_local Worker *cached = nullptr;
+    if (cachedSerial == serial)
+        return *cached;
+
+    std::lock_guard<std::mutex> lock(workersMutex);
+    auto &w = workers[std::this_thread::get_id()];
+    if (!w)
+        w = std::make_unique<Worker>(cluster);
+    cachedSerial = serial;
+    cached = w.get();
+    return *w;
+}
+
+bool ClientSession::loadIdentity()
+{
+    if (identityLoaded.load(std::memory_order_acquire))
+        return true;
+    std::lock_guard<std::mutex> lock(identityMutex);
+    if (identityLoaded.load(std::memory_order_relaxed))
+        return true;
+    try
+    {
+        auto me = FileConfig::readFullMyInfo();
+        myName = std::get<0>(me);
+        myId = std::get<1>(me);
+        myPrivB64 = std::get<2>(me);
+        if (myPrivB64.compare(0, X25519_KEY_PREFIX.size(), X25519_KEY_PREFIX) == 0)
+        {
+            std::vector<uint8_t> raw;
+            if (!Codec::base64Decode(myPrivB64.data() + X25519_KEY_PREFIX.size(),
+                                     myPrivB64.size() - X25519_KEY_PREFIX.size(), raw) ||
+                raw.size() != myX25519Priv.size())
+            {
+                return false;
+            }
+            std::copy(raw.begin(), raw.end(), myX25519Priv.begin());
+            myX25519Pub = Encryption::X25519PublicFromPrivate(myX25519Priv);
+            myKeyType = KEY_TYPE_X25519;
+        }
+        else
+        {
+            // needed to join other nodes and to seal our own key records;
+            // left empty (and those fail) if the key does not parse
+            try
+            {
+                myPubB64 = Encryption::RsaPublicFromPrivateBase64(myPrivB64);
+            }
+            catch (const std::exception &)
+            {
+            }
+        }
+        identityLoaded.store(true, std::memory_order_release);
+    }
+    catch (...)
+    {
+        return false;
+    }
+    return true;
+}
+
+// Registers on a node under our existing UUID ("join", see ServerCluster.h).
+// The server treats a repeated join as success, so the first contact with
+// each node in a session does it unconditionally.
+Task<bool> ClientSession::ensureJoined(size_t node)
+{
+    if (cluster.size() == 1 || cluster.isJoined(node))
+        co_return true;
+
+    if (myKeyType == KEY_TYPE_RSA && myPubB64.empty())
+        co_return false;
+
+    Worker &w = worker();
+    ServerReply reply{};
+    BufferPool::Lease payload(w.buffers);
+    bool sent;
+    if (myKeyType == KEY_TYPE_X25519)
+    {
+        auto req = timedPhase(CODE_REGISTRATION_V2_REQ, Phase::Serialize, [&] {
+            return Protocol::buildRegistrationV2(myId, myName, KEY_TYPE_X25519, myX25519Pub);
+        });
+        sent = co_await sendAndRecv(w, node, req, reply, *payload);
+    }
+    else
+    {
+        auto req = timedPhase(CODE_REGISTRATION_REQ, Phase::Serialize,
+                              [&] { return Protocol::buildRegistration(myId, myName, myPubB64); });
+        sent = co_await sendAndRecv(w, node, req, reply, *payload);
+    }
+    if (!sent ||
+        !Protocol::isOk(reply, CODE_REGISTRATION_OK) ||
+        payload->size() != CLIENT_ID_LEN ||
+        !std::equal(payload->begin(), payload->end(), myId.begin()))
+    {
+        co_return false;
+    }
+    cluster.setJoined(node, true);
+    co_return true;
+}
+
+// Id of peer 'name' from the cache, or looked up on the seed (608) on a
+// miss. False if no such user (or the lookup failed).
+Task<bool> ClientSession::resolvePeer(const std::string &name, Uuid &id, bool *lookedUp)
+{
+    if (lookedUp)
+        *lookedUp = false;
+    bool cached = false;
+    {
+        std::shared_lock<std::shared_mutex> lock(peersLock);
+        if (const PeerInfo *peer = peerCache.find(name))
+        {
+            id = peer->id;
+            cached = true;
+        }
+    }
+    if (cached)
+        co_return true;
+    if (!(co_await lookupUserAsync(name)).ok)
+        co_return false;
+    if (lookedUp)
+        *lookedUp = true;
+
+    std::shared_lock<std::shared_mutex> lock(peersLock);
+    const PeerInfo *peer = peerCache.find(name);
+    if (peer)
+        id = peer->id;
+    co_return peer != nullptr;
+}
+
+
+// ------------------------- 110 -------------------------
+
+Task<OpResult> ClientSession::registerUserAsync(std::string username)
+{
+    if (FileConfig::myInfoExists())
+        co_return OpResult::failure("Already registered. 'my.info' exists.");
+    if (username.empty())
+        co_return OpResult::failure("Invalid username.");
+
+    // Prepare registration
+    Uuid zero{};
+    zero.fill(0);
+
+    Worker &w = worker();
+    ServerReply reply{};
+    BufferPool::Lease payload(w.buffers);
+
+    // produce private key and public key, then send the matching request
+    // to the seed server, which assigns the UUID
+    const bool x25519 = registrationKeyType == KEY_TYPE_X25519;
+    Encryption::RsaKeyPair rsa;
+    Encryption::X25519KeyPair xkp{};
+    std::string privLine;
+    bool sent;
+    if (x25519)
+    {
+        xkp = timedPhase(CODE_REGISTRATION_V2_REQ, Phase::Crypto,
+                         [] { return Encryption::GenerateX25519Keypair(); });
+        privLine = X25519_KEY_PREFIX + Codec::base64Encode(xkp.privateKey.data(), xkp.privateKey.size());
+        auto req = timedPhase(CODE_REGISTRATION_V2_REQ, Phase::Serialize, [&] {
+            return Protocol::buildRegistrationV2(zero, username, KEY_TYPE_X25519, xkp.publicKey);
+        });
+        sent = co_await sendAndRecv(w, ServerCluster::SEED, req, reply, *payload);
+    }
+    else
+    {
+        rsa = timedPhase(CODE_REGISTRATION_REQ, Phase::Crypto,
+                         [] { return Encryption::GenerateRsaKeypair1024(); });
+        privLine = rsa.privateKeyBase64;
+        //build request protocol
+        auto req = timedPhase(CODE_REGISTRATION_REQ, Phase::Serialize,
+                              [&] { return Protocol::buildRegistration(zero, username, rsa.publicKeyBase64); });
+        sent = co_await sendAndRecv(w, ServerCluster::SEED, req, reply, *payload);
+    }
+    if (!sent)
+        co_return OpResult::failure(SERVER_ERROR);
+
+    //check the reposinse from the server
+    if (!Protocol::isOk(reply, CODE_REGISTRATION_OK) || payload->size() != CLIENT_ID_LEN)
+        co_return OpResult::failure("Server responded with error or unexpected payload.");
+
+    Uuid id{};
+    //fetching id
+    std::copy_n(payload->data(), CLIENT_ID_LEN, id.data());
+    try
+    {
+        //save in my.info
+        FileConfig::writeMyInfo(username, id, privLine);
+    }
+    catch (const std::exception &ex)
+    {
+        co_return OpResult::failure(std::string("Registration succeeded but saving key failed: ") + ex.what());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(identityMutex);
+        myName = username.substr(0, REG_NAME_LEN);
+        myId = id;
+        myKeyType = registrationKeyType;
+        myPrivB64 = privLine;
+        myPubB64 = rsa.publicKeyBase64;
+        myX25519Priv = xkp.privateKey;
+        myX25519Pub = xkp.publicKey;
+        identityLoaded.store(true, std::memory_order_release);
+    }
+
+    // join the other nodes now; any that fail are retried on first use
+    cluster.setJoined(ServerCluster::SEED, true);
+    for (size_t node = 0; node < cluster.size(); ++node)
+        co_await ensureJoined(node);
+    co_return OpResult::success();
+}
+
+// ------------------------- 120 -------------------------
+
+// Asks the server for the list of registered users and merges it into the
+// peer cache (existing public/symmetric keys are kept).
+Task<OpResult> ClientSession::refreshClientsAsync(std::vector<std::string> *namesOut)
+{
+    if (!loadIdentity())
+        co_return OpResult::failure(NOT_REGISTERED);
+
+    //prepare request for server
+    auto req = timedPhase(CODE_CLIENTS_LIST_REQ, Phase::Serialize,
+                          [&] { return Protocol::buildClientsListReq(myId); });
+
+    Worker &w = worker();
+    ServerReply reply{};
+    BufferPool::Lease payload(w.buffers);
+    if (!co_await sendAndRecv(w, ServerCluster::SEED, req, reply, *payload) ||
+        !Protocol::isOk(reply, CODE_CLIENTS_LIST_OK))
+    {
+        co_return OpResult::failure(SERVER_ERROR);
+    }
+
+    auto &list = w.listScratch;
+    Protocol::parseClientsList(payload->data(), payload->size(), list);
+    if (namesOut)
+        namesOut->resize(list.size());
+    std::unique_lock<std::shared_mutex> lock(peersLock);
+    peerCache.reserve(list.size());
+    for (size_t i = 0; i < list.size(); ++i)
+    {
+        const auto &e = list[i];
+        peerCache.upsert(e.name, e.id); // keeps existing pub/symmetric keys
+        if (namesOut)
+            (*namesOut)[i].assign(e.name);
+    }
+    co_return OpResult::success();
+}
+
+// ------------------------- 130 -------------------------
+
+Task<OpResult> ClientSession::fetchPublicKeyAsync(std::string name)
+{
+    if (!loadIdentity())
+        co_return OpResult::failure(NOT_REGISTERED);
+
+    bool lookedUp = false;
+    Uuid targetId;
+    if (!co_await resolvePeer(name, targetId, &lookedUp))
+        co_return OpResult::failure(UNKNOWN_USER);
+    if (lookedUp)
+        co_return OpResult::success(); // the lookup reply carried the key
+
+    // 606: the reply code tells which kind of key the peer has
+    auto req = timedPhase(CODE_PUBLIC_KEY_V2_REQ, Phase::Serialize,
+                          [&] { return Protocol::buildPublicKeyV2Req(myId, targetId); });
+
+    Worker &w = worker();
+    ServerReply reply{};
+    BufferPool::Lease payload(w.buffers);
+    if (!co_await sendAndRecv(w, cluster.ownerOf(targetId), req, reply, *payload))
+        co_return OpResult::failure(SERVER_ERROR);
+
+    // other tasks may have grown the registry while we waited
+    std::unique_lock<std::shared_mutex> lock(peersLock);
+    PeerInfo *peer = peerCache.findById(targetId);
+    if (!peer)
+        co_return OpResult::failure(UNKNOWN_USER);
+    const uint8_t *p = payload->data();
+    if (Protocol::isOk(reply, CODE_PUBLIC_KEY_V2_OK) && payload->size() == PublicKeyV2ReplyPayload::size)
+    {
+        // payload: [16B clientId][1B keyType][32B raw key]
+        const uint8_t *key = PublicKeyV2ReplyPayload::get<PublicKeyV2ReplyPayload::PublicKey>(p);
+        if (peerCache.setPublicKey(*peer, PublicKeyV2ReplyPayload::get<PublicKeyV2ReplyPayload::KeyType>(p), key,
+                                   X25519_PUB_LEN))
+            co_return OpResult::success();
+    }
+    if (Protocol::isOk(reply, CODE_PUBLIC_KEY_OK) && payload->size() == PublicKeyReplyPayload::size)
+    {
+        // payload: [16B clientId][400B base64-ascii + NUL padding]
+        using KeyField = PublicKeyReplyPayload::field<PublicKeyReplyPayload::PublicKey>;
+        const uint8_t *key = p + PublicKeyReplyPayload::offset<PublicKeyReplyPayload::PublicKey>();
+        if (peerCache.setPublicKey(*peer, KEY_TYPE_RSA, key, KeyField::length(key)))
+            co_return OpResult::success();
+    }
+    co_return OpResult::failure(SERVER_ERROR);
+}
+
+OpResult ClientSession::fetchPublicKeys(const std::vector<std::string> &names, std::vector<OpResult> *results)
+{
+    std::vector<OpResult> all = worker().loop.run(fetchPublicKeysAsync(names));
+    OpResult res = OpResult::success();
+    for (size_t i = 0; i < all.size(); ++i)
+    {
+        if (!all[i].ok && res.ok)
+            res = OpResult::failure(names[i] + ": " + all[i].error);
+    }
+    if (results)
+        *results = std::move(all);
+    return res;
+}
+
+// Every name resolved at once (a lookup brings its key along), then the
+// keys of the cached ones in 611 frames. A server without 611 gets one
+// 606 per name, all in flight together.
+Task<std::vector<OpResult>> ClientSession::fetchPublicKeysAsync(const std::vector<std::string> &names)
+{
+    const size_t n = names.size();
+    std::vector<OpResult> results(n, OpResult::success());
+    if (!loadIdentity())
+    {
+        results.assign(n, OpResult::failure(NOT_REGISTERED));
+        co_return results;
+    }
+
+    std::vector<Uuid> ids(n);
+    std::unique_ptr<bool[]> lookedUp(new bool[n]());
+    std::vector<Task<bool>> resolves;
+    resolves.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+        resolves.push_back(resolvePeer(names[i], ids[i], &lookedUp[i]));
+    const std::vector<bool> known = co_await whenAll(std::move(resolves));
+
+    std::vector<Uuid> wanted;
+    std::vector<size_t> nameOf; // index in 'names' of each wanted id
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (!known[i])
+            results[i] = OpResult::failure(UNKNOWN_USER);
+        else if (!lookedUp[i])
+        {
+            wanted.push_back(ids[i]);
+            nameOf.push_back(i);
+        }
+    }
+
+    std::unique_ptr<char[]> stored(new char[wanted.size()]());
+    for (size_t from = 0; from < wanted.size(); from += PUBLIC_KEYS_MAX_ITEMS)
+    {
+        const size_t count = std::min(PUBLIC_KEYS_MAX_ITEMS, wanted.size() - from);
+        if ((co_await publicKeysAsync(wanted.data() + from, count, stored.get() + from)).ok)
+            continue;
+
+        std::vector<Task<OpResult>> fetches;
+        for (size_t j = from; j < wanted.size(); ++j)
+            fetches.push_back(fetchPublicKeyAsync(names[nameOf[j]]));
+        const std::vector<OpResult> each = co_await whenAll(std::move(fetches));
+        for (size_t j = from; j < wanted.size(); ++j)
+            results[nameOf[j]] = each[j - from];
+        co_return results;
+    }
+    for (size_t j = 0; j < wanted.size(); ++j)
+    {
+        if (!stored[j])
+            results[nameOf[j]] = OpResult::failure(SERVER_ERROR);
+    }
+    co_return results;
+}
+
+Task<OpResult> ClientSession::prefetchPublicKeysAsync(size_t *fetched)
+{
+    if (fetched)
+        *fetched = 0;
+    if (!loadIdentity())
+        co_return OpResult::failure(NOT_REGISTERED);
+
+    std::vector<Uuid> wanted;
+    {
+        std::shared_lock<std::shared_mutex> lock(peersLock);
+        for (const PeerInfo &peer : peerCache)
+        {
+            if (!peer.hasPublicKey())
+                wanted.push_back(peer.id);
+        }
+    }
+
+    std::unique_ptr<char[]> stored(new char[wanted.size()]());
+    for (size_t from = 0; from < wanted.size(); from += PUBLIC_KEYS_MAX_ITEMS)
+    {
+        const size_t count = std::min(PUBLIC_KEYS_MAX_ITEMS, wanted.size() - from);
+        OpResult res = co_await publicKeysAsync(wanted.data() + from, count, stored.get() + from);
+        if (!res.ok)
+            co_return res;
+    }
+    if (fetched)
+        *fetched = static_cast<size_t>(std::count(stored.get(), stored.get() + wanted.size(), 1));
+    co_return OpResult::success();
+}
+
+Task<OpResult> ClientSession::publicKeysAsync(const Uuid *ids, size_t n, char *stored)
+{
+    Worker &w = worker();
+    BufferPool::Lease req(w.buffers);
+    timedPhase(CODE_PUBLIC_KEYS_REQ, Phase::Serialize,
+               [&] { Protocol::buildPublicKeysReq(*req, myId, ids, n); });
+
+    ServerReply reply{};
+    BufferPool::Lease payload(w.buffers);
+    if (!co_await sendAndRecv(w, ServerCluster::SEED, *req, reply, *payload))
+        co_return OpResult::failure(SERVER_ERROR);
+    std::vector<PublicKeyView> &keys = w.keyScratch;
+    if (!Protocol::isOk(reply, CODE_PUBLIC_KEYS_OK) ||
+        !Protocol::parsePublicKeys(payload->data(), payload->size(), keys) || keys.size() != n)
+    {
+        co_return OpResult::failure(SERVER_ERROR);
+    }
+
+    // entries come back in request order
+    std::unique_lock<std::shared_mutex> lock(peersLock);
+    for (size_t i = 0; i < n; ++i)
+    {
+        const PublicKeyView &k = keys[i];
+        PeerInfo *peer = k.keyLen && k.id == ids[i] ? peerCache.findById(k.id) : nullptr;
+        stored[i] = peer && peerCache.setPublicKey(*peer, k.keyType, k.key, k.keyLen);
+    }
+    co_return OpResult::success();
+}
+
+// ------------------------- lookup -------------------------
+
+// 608 to the seed, which sees every registration: id and public key of
+// one user in a single small reply, without downloading the clients list.
+Task<OpResult> ClientSession::lookupUserAsync(std::string name)
+{
+    if (!loadIdentity())
+        co_return OpResult::failure(NOT_REGISTERED);
+
+    auto req = timedPhase(CODE_LOOKUP_USER_REQ, Phase::Serialize,
+                          [&] { return Protocol::buildLookupUserReq(myId, name); });
+
+    Worker &w = worker();
+    ServerReply reply{};
+    BufferPool::Lease payload(w.buffers);
+    if (!co_await sendAndRecv(w, ServerCluster::SEED, req, reply, *payload))
+        co_return OpResult::failure(SERVER_ERROR);
+    if (!Protocol::isOk(reply, CODE_LOOKUP_USER_OK) || payload->size() < LookupUserReplyHead::size)
+        co_return OpResult::failure(UNKNOWN_USER);
+
+    // payload: [16B clientId][1B keyType][key: rest of the payload]
+    // a symmetric key we may already share with this user is kept
+    const uint8_t *p = payload->data();
+    Uuid id;
+    std::copy_n(LookupUserReplyHead::get<LookupUserReplyHead::ClientId>(p), CLIENT_ID_LEN, id.begin());
+    std::unique_lock<std::shared_mutex> lock(peersLock);
+    PeerInfo &peer = peerCache.upsert(name, id);
+    if (!peerCache.setPublicKey(peer, LookupUserReplyHead::get<LookupUserReplyHead::KeyType>(p),
+                                p + LookupUserReplyHead::size, payload->size() - LookupUserReplyHead::size))
+    {
+        co_return OpResult::failure(SERVER_ERROR);
+    }
+    co_return OpResult::success();
+}
+
+// ------------------------- 140 -------------------------
+
+Task<OpResult> ClientSession::pullMessagesAsync(std::vector<ReceivedMessage> &out)
+{
+    size_t count = 0;
+    if (!loadIdentity())
+    {
+        out.clear();
+        co_return OpResult::failure(NOT_REGISTERED);
+    }
+
+    // our inbox lives on our home node
+    const size_t home = cluster.ownerOf(myId);
+    if (!co_await ensureJoined(home))
+    {
+        out.clear();
+        co_return OpResult::failure(JOIN_FAILED + cluster.label(home));
+    }
+
+    auto req = timedPhase(CODE_PULL_WAITING_REQ, Phase::Serialize,
+                          [&] { return Protocol::buildPullWaitingReq(myId); });
+
+    Worker &w = worker();
+    ServerReply rep{};
+    BufferPool::Lease payload(w.buffers);
+    //sending to server
+    if (!co_await sendAndRecv(w, home, req, rep, *payload) ||
+        !Protocol::isOk(rep, CODE_PULL_WAITING_OK))
+    {
+        out.clear();
+        co_return OpResult::failure(SERVER_ERROR);
+    }
+
+    // views point into 'payload'; nothing is copied until decryption
+    auto &inbox = w.inboxScratch;
+    Protocol::parseWaitingMessages(payload->data(), payload->size(), inbox);
+
+    // Auto-refresh the clients list once (option 120) if it cant find a
+    // sender's username by the id. Other tasks may use the scratch views
+    // while we wait, so parse again afterwards.
+    bool unknownSender;
+    {
+        std::shared_lock<std::shared_mutex> lock(peersLock);
+        unknownSender = std::any_of(inbox.begin(), inbox.end(),
+                                    [&](const WaitingMessageView &wm) { return !peerCache.findById(wm.fromId); });
+    }
+    if (unknownSender)
+    {
+        co_await refreshClientsAsync();
+        Protocol::parseWaitingMessages(payload->data(), payload->size(), inbox);
+    }
+
+    BufferPool::Lease plain(w.buffers);
+    BufferPool::Lease wrapped(w.buffers);
+    // no suspension from here on: the registry stays locked while the
+    // batch is stored and decrypted
+    std::unique_lock<std::shared_mutex> peersGuard(peersLock);
+    for (const auto &wm : inbox)
+    {
+        // reuse the caller's element (and its string capacity) when there is one
+        if (count == out.size())
+            out.emplace_back();
+        ReceivedMessage &rm = out[count++];
+        rm.nameResolved = true;
+        rm.failed = false;
+        rm.msgId = wm.msgId;
+        rm.type = wm.type;
+
+        // see if you can find the username by the id
+        PeerInfo *sender = peerCache.findById(wm.fromId);
+        if (sender)
+        {
+            rm.fromName.assign(peerCache.nameOf(*sender));
+        }
+        else
+        {
+            rm.fromName = toHex32(wm.fromId);
+            rm.nameResolved = false;
+        }
+
+        // keep the ciphertext; a text record points at the key it was sent under
+        const bool isText = wm.type == MSG_TYPE_TEXT_CBC || wm.type == MSG_TYPE_TEXT_GCM;
+        if (isText && sender && !sender->hasSymmetricKey)
+            restoreKey(*sender);
+        uint32_t ref;
+        {
+            std::lock_guard<std::mutex> lock(historyLock);
+            ref = history.append(wm.fromId, wm.msgId, wm.type, 0, isText && sender ? sender->historyKey : 0,
+                                 wm.content, wm.contentSize);
+        }
+
+        // Analyzing the messages
+        if (wm.type == MSG_TYPE_KEY_REQUEST)
+        {
+            rm.text = "Request for symmetric key";
+            if (sender && wm.contentSize >= 1)
+                sender->caps = wm.content[0];
+        }
+        // symetric key was sent
+        else if (wm.type == MSG_TYPE_KEY || wm.type == MSG_TYPE_KEY_X25519)
+        {
+            bool ok = false;
+            // decrypt it with the private key
+            std::vector<uint8_t> recovered;
+            if (wm.type == MSG_TYPE_KEY_X25519)
+            {
+                ok = myKeyType == KEY_TYPE_X25519 && timedPhase(CODE_PULL_WAITING_REQ, Phase::Crypto, [&] {
+                         return Encryption::X25519Open(myX25519Priv, wm.content, wm.contentSize, recovered);
+                     });
+            }
+            else if (myKeyType == KEY_TYPE_RSA)
+            {
+                wrapped->assign(wm.content, wm.content + wm.contentSize);
+                recovered = timedPhase(CODE_PULL_WAITING_REQ, Phase::Crypto, [&] {
+                    return Encryption::RsaDecryptOaepWithBase64Priv(myPrivB64, *wrapped, ok);
+                });
+            }
+            if (!ok || recovered.size() < 16)
+            {
+                rm.text = "Failed to decrypt symmetric key.";
+                rm.failed = true;
+            }
+            else
+            {
+                // unknown senders are kept under their hex id
+                PeerInfo &peer = sender ? *sender : peerCache.upsert(rm.fromName, wm.fromId);
+                std::copy_n(recovered.begin(), 16, peer.symmetricKey.begin());
+                peer.hasSymmetricKey = true;
+                peer.historyKey = ref;
+                if (recovered.size() > 16)
+                    peer.caps = recovered[16];
+                rm.text = "Symmetric key stored for " + rm.fromName + ".";
+            }
+        }
+        // first message from a peer: its key and text in one
+        else if (wm.type == MSG_TYPE_TEXT_SEALED)
+        {
+            SealedTextView st;
+            std::vector<uint8_t> recovered;
+            std::array<uint8_t, 16> key;
+            const bool ok = Protocol::parseSealedText(wm.content, wm.contentSize, st) &&
+                            timedPhase(CODE_PULL_WAITING_REQ, Phase::Crypto, [&] {
+                                if (!openKey(sealedKeyType(), st.wrapped, st.wrappedSize, recovered) ||
+                                    recovered.size() < 16)
+                                    return false;
+                                std::copy_n(recovered.begin(), 16, key.begin());
+                                return Encryption::AesGcmOpen(key, st.text, st.textSize, *plain);
+                            });
+            if (!ok)
+            {
+                rm.text = "can't decrypt message";
+                rm.failed = true;
+            }
+            else
+            {
+                PeerInfo &peer = sender ? *sender : peerCache.upsert(rm.fromName, wm.fromId);
+                peer.symmetricKey = key;
+                peer.hasSymmetricKey = true;
+                peer.historyKey = ref;
+                peer.caps = recovered.size() > 16 ? recovered[16] : CAP_AES_GCM;
+                rm.text.assign(reinterpret_cast<const char *>(plain->data()), plain->size());
+            }
+        }
+        // text message was sent
+        else if (wm.type == MSG_TYPE_TEXT_CBC || wm.type == MSG_TYPE_TEXT_GCM)
+        {
+            bool ok = false;
+            if (sender && sender->hasSymmetricKey)
+            {
+                //decrypt with symetric key
+                const auto &key = sender->symmetricKey;
+                ok = timedPhase(CODE_PULL_WAITING_REQ, Phase::Crypto, [&] {
+                    return wm.type == MSG_TYPE_TEXT_GCM
+                               ? Encryption::AesGcmOpen(key, wm.content, wm.contentSize, *plain)
+                               : Encryption::AesCbcDecryptZeroIV(key, wm.content, wm.contentSize, *plain);
+                });
+                if (ok && wm.type == MSG_TYPE_TEXT_GCM)
+                    sender->caps |= CAP_AES_GCM;
+                if (ok)
+                    rm.text.assign(reinterpret_cast<const char *>(plain->data()), plain->size());
+            }
+            if (!ok)
+            {
+                rm.text = "can't decrypt message";
+                rm.failed = true;
+            }
+        }
+        else
+        {
+            rm.text = "(unknown type)";
+            rm.failed = true;
+        }
+    }
+    out.resize(count);
+    peersGuard.unlock();
+
+    // the server is reachable again: deliver what was queued meanwhile
+    if (!outbox.empty())
+        co_await flushOutboxAsync();
+    co_return OpResult::success();
+}
+
+// ------------------------- 141 -------------------------
+
+Task<OpResult> ClientSession::historyPageAsync(std::string name, uint32_t before, size_t count,
+                                               std::vector<HistoryMessage> &out)
+{
+    out.clear();
+    if (!loadIdentity())
+        co_return OpResult::failure(NOT_REGISTERED);
+    if (!history.isOpen())
+        co_return OpResult::failure("Message history is not available.");
+    Uuid peerId;
+    if (!co_await resolvePeer(name, peerId))
+        co_return OpResult::failure(UNKNOWN_USER);
+
+    std::lock_guard<std::mutex> lock(historyLock);
+    // newest record of the conversation below the cursor (index entries only)
+    uint32_t ref = history.lastOf(peerId);
+    while (before && ref >= before)
+        ref = history.record(ref).prev;
+
+    // keys unwrapped for this page only
+    std::vector<std::pair<uint32_t, std::array<uint8_t, 16>>> keys;
+    Worker &w = worker();
+    BufferPool::Scope scope(w.buffers);
+    auto &plain = w.buffers.acquire();
+    while (ref && out.size() < count)
+    {
+        const HistoryRecord rec = history.record(ref);
+        out.emplace_back();
+        HistoryMessage &m = out.back();
+        m.ref = ref;
+        m.msgId = (rec.flags & HISTORY_OWN_KEY) ? 0 : rec.msgId;
+        m.time = rec.time;
+        m.type = rec.type;
+
+        if (rec.type == MSG_TYPE_KEY_REQUEST)
+        {
+            m.text = "Request for symmetric key";
+        }
+        else if (rec.type == MSG_TYPE_KEY || rec.type == MSG_TYPE_KEY_X25519)
+        {
+            m.text = (rec.flags & HISTORY_OWN_KEY) ? "Symmetric key sent to " + name + "."
+                                                   : "Symmetric key received from " + name + ".";
+        }
+        else if (rec.type == MSG_TYPE_TEXT_CBC || rec.type == MSG_TYPE_TEXT_GCM)
+        {
+            auto it = std::find_if(keys.begin(), keys.end(), [&](const auto &k) { return k.first == rec.keyRef; });
+            if (it == keys.end())
+            {
+                std::array<uint8_t, 16> key;
+                if (historyKey(rec.keyRef, key))
+                    it = keys.insert(keys.end(), {rec.keyRef, key});
+            }
+            bool ok = false;
+            if (it != keys.end())
+            {
+                ok = timedPhase(CODE_PULL_WAITING_REQ, Phase::Crypto, [&] {
+                    return rec.type == MSG_TYPE_TEXT_GCM
+                               ? Encryption::AesGcmOpen(it->second, rec.content, rec.size, plain)
+                               : Encryption::AesCbcDecryptZeroIV(it->second, rec.content, rec.size, plain);
+                });
+            }
+            if (ok)
+                m.text.assign(reinterpret_cast<const char *>(plain.data()), plain.size());
+            else
+            {
+                m.text = "can't decrypt message";
+                m.failed = true;
+            }
+        }
+        else if (rec.type == MSG_TYPE_TEXT_SEALED)
+        {
+            // the record holds its own key
+            std::array<uint8_t, 16> key;
+            SealedTextView st;
+            const bool ok = historyKey(ref, key) && Protocol::parseSealedText(rec.content, rec.size, st) &&
+                            timedPhase(CODE_PULL_WAITING_REQ, Phase::Crypto, [&] {
+                                return Encryption::AesGcmOpen(key, st.text, st.textSize, plain);
+                            });
+            if (ok)
+                m.text.assign(reinterpret_cast<const char *>(plain.data()), plain.size());
+            else
+            {
+                m.text = "can't decrypt message";
+                m.failed = true;
+            }
+        }
+        else
+        {
+            m.text = "(unknown type)";
+            m.failed = true;
+        }
+        ref = rec.prev;
+    }
+    std::reverse(out.begin(), out.end());
+    co_return OpResult::success();
+}
+
+uint32_t ClientSession::historyCursorAt(uint32_t msgId) const
+{
+    std::lock_guard<std::mutex> lock(historyLock);
+    return history.findMessage(msgId);
+}
+
+uint32_t ClientSession::historyCursorAfter(uint32_t time) const
+{
+    std::lock_guard<std::mutex> lock(historyLock);
+    return history.firstAfter(time);
+}
+
+uint32_t ClientSession::recordOwnKey(const Uuid &peerId, const std::array<uint8_t, 16> &key)
+{
+    std::vector<uint8_t> sealed;
+    try
+    {
+        if (myKeyType == KEY_TYPE_X25519)
+        {
+            if (!Encryption::X25519Seal(myX25519Pub, key.data(), key.size(), sealed))
+                return 0;
+        }
+        else
+        {
+            sealed = Encryption::RsaEncryptOaepWithBase64Pub(myPubB64, std::vector<uint8_t>(key.begin(), key.end()));
+        }
+    }
+    catch (const std::exception &)
+    {
+        return 0;
+    }
+    const uint8_t type = myKeyType == KEY_TYPE_X25519 ? MSG_TYPE_KEY_X25519 : MSG_TYPE_KEY;
+    std::lock_guard<std::mutex> lock(historyLock);
+    return history.append(peerId, 0, type, HISTORY_OWN_KEY, 0, sealed.data(), sealed.size());
+}
+
+bool ClientSession::restoreKey(PeerInfo &peer)
+{
+    std::lock_guard<std::mutex> lock(historyLock);
+    for (uint32_t ref = history.lastOf(peer.id); ref;)
+    {
+        const HistoryRecord rec = history.record(ref);
+        if (rec.type == MSG_TYPE_KEY || rec.type == MSG_TYPE_KEY_X25519 || rec.type == MSG_TYPE_TEXT_SEALED)
+        {
+            if (!historyKey(ref, peer.symmetricKey))
+                return false;
+            peer.hasSymmetricKey = true;
+            peer.historyKey = ref;
+            return true;
+        }
+        ref = rec.prev;
+    }
+    return false;
+}
+
+bool ClientSession::historyKey(uint32_t keyRef, std::array<uint8_t, 16> &key)
+{
+    if (!keyRef || keyRef > history.size())
+        return false;
+    const HistoryRecord rec = history.record(keyRef);
+    std::vector<uint8_t> recovered;
+    bool ok;
+    if (rec.type == MSG_TYPE_TEXT_SEALED)
+    {
+        SealedTextView st;
+        ok = Protocol::parseSealedText(rec.content, rec.size, st) &&
+             openKey(sealedKeyType(), st.wrapped, st.wrappedSize, recovered);
+    }
+    else
+    {
+        ok = openKey(rec.type, rec.content, rec.size, recovered);
+    }
+    if (!ok || recovered.size() < 16)
+        return false;
+    std::copy_n(recovered.begin(), 16, key.begin());
+    return true;
+}
+
+bool ClientSession::openKey(uint8_t type, const uint8_t *wrapped, size_t len, std::vector<uint8_t> &recovered)
+{
+    bool ok = false;
+    if (type == MSG_TYPE_KEY_X25519 && myKeyType == KEY_TYPE_X25519)
+    {
+        ok = Encryption::X25519Open(myX25519Priv, wrapped, len, recovered);
+    }
+    else if (type == MSG_TYPE_KEY && myKeyType == KEY_TYPE_RSA)
+    {
+        const std::vector<uint8_t> in(wrapped, wrapped + len);
+        recovered = Encryption::RsaDecryptOaepWithBase64Priv(myPrivB64, in, ok);
+    }
+    return ok;
+}
+
+// ------------------------- 150 -------------------------
+
+Task<OpResult> ClientSession::sendTextAsync(std::string name, std::string text)
+{
+    OutboxEntry mine; // in this frame: sends on one thread interleave
+    OpResult queued = co_await queueTextAsync(std::move(name), std::move(text), &mine);
+    if (!queued.ok)
+        co_return queued;
+    co_return co_await flushAsync(nullptr, &mine);
+}
+
+// What a one-shot send queued, for its flush to report on.
+static void notePushed(OutboxEntry *pushed, const Uuid &destId, uint8_t type, const std::vector<uint8_t> &content)
+{
+    if (!pushed)
+        return;
+    pushed->destId = destId;
+    pushed->type = type;
+    pushed->content.assign(content.begin(), content.end());
+}
+
+Task<OpResult> ClientSession::queueTextAsync(std::string name, std::string text)
+{
+    co_return co_await queueTextAsync(std::move(name), std::move(text), nullptr);
+}
+
+Task<OpResult> ClientSession::queueTextAsync(std::string name, std::string text, OutboxEntry *pushed)
+{
+    if (!loadIdentity())
+        co_return OpResult::failure(NOT_REGISTERED);
+
+    Uuid targetId;
+    if (!co_await resolvePeer(name, targetId))
+        co_return OpResult::failure(UNKNOWN_USER);
+
+    // copy the key out: the common case only needs the shared lock, a
+    // key still to be restored from the history the exclusive one
+    std::array<uint8_t, 16> key;
+    uint8_t caps = 0;
+    bool haveKey = false;
+    {
+        std::shared_lock<std::shared_mutex> lock(peersLock);
+        const PeerInfo *peer = peerCache.findById(targetId);
+        if (peer && peer->hasSymmetricKey)
+        {
+            key = peer->symmetricKey;
+            caps = peer->caps;
+            haveKey = true;
+        }
+    }
+    if (!haveKey)
+    {
+        std::unique_lock<std::shared_mutex> lock(peersLock);
+        PeerInfo *peer = peerCache.findById(targetId);
+        if (peer && (peer->hasSymmetricKey || restoreKey(*peer)))
+        {
+            key = peer->symmetricKey;
+            caps = peer->caps;
+            haveKey = true;
+        }
+    }
+    if (!haveKey)
+        co_return co_await queueWithNewKey(targetId, name, text, pushed);
+
+    // GCM only once the peer has told us it understands it
+    const bool gcm = (caps & CAP_AES_GCM) != 0;
+    const uint8_t type = gcm ? MSG_TYPE_TEXT_GCM : MSG_TYPE_TEXT_CBC;
+
+    Worker &w = worker();
+    BufferPool::Scope scope(w.buffers);
+    auto &cipher = w.buffers.acquire();
+    timedPhase(CODE_SEND_MESSAGE_REQ, Phase::Crypto, [&] {
+        const auto *plain = reinterpret_cast<const uint8_t *>(text.data());
+        if (gcm)
+            Encryption::AesGcmSeal(key, plain, text.size(), cipher);
+        else
+            Encryption::AesCbcEncryptZeroIV(key, plain, text.size(), cipher);
+    });
+
+    if (!outbox.push(targetId, type, cipher.data(), cipher.size()))
+        co_return OpResult::failure("Could not write the outbox file.");
+    notePushed(pushed, targetId, type, cipher);
+    co_return OpResult::success();
+}
+
+// First contact. A new key goes out wrapped to the peer's public key:
+// together with the text (type 6) if the peer can open that, otherwise
+// as a key message (type 2/5, like 152) queued ahead of the text. Later
+// texts use it like a key sent with 152.
+Task<OpResult> ClientSession::queueWithNewKey(Uuid targetId, std::string name, std::string text,
+                                              OutboxEntry *pushed)
+{
+    bool havePub;
+    {
+        std::shared_lock<std::shared_mutex> lock(peersLock);
+        const PeerInfo *peer = peerCache.findById(targetId);
+        havePub = peer && peer->hasPublicKey();
+    }
+    if (!havePub && !(co_await fetchPublicKeyAsync(name)).ok)
+        co_return OpResult::failure("No symmetric key with " + name + " and no public key to send one to.");
+
+    Worker &w = worker();
+    BufferPool::Scope scope(w.buffers);
+    auto &cipher = w.buffers.acquire();
+    auto &content = w.buffers.acquire();
+
+    // all under the lock: a text queued meanwhile by another thread must
+    // not reach the outbox ahead of the key it is encrypted with
+    std::unique_lock<std::shared_mutex> lock(peersLock);
+    PeerInfo *peer = peerCache.findById(targetId);
+    if (!peer || !peer->hasPublicKey())
+        co_return OpResult::failure(UNKNOWN_USER);
+    if (peer->hasSymmetricKey)
+    {
+        lock.unlock();
+        co_return co_await queueTextAsync(std::move(name), std::move(text), pushed); // lost the race: plain text
+    }
+
+    // type 6 only to peers that said they open it (with their key request)
+    const bool sealed = (peer->caps & CAP_SEALED_TEXT) != 0;
+    const bool gcm = sealed || (peer->caps & CAP_AES_GCM) != 0;
+    const uint8_t keyType = peer->keyType == KEY_TYPE_X25519 ? MSG_TYPE_KEY_X25519 : MSG_TYPE_KEY;
+
+    const std::array<uint8_t, 16> key = Encryption::GenerateAesKey();
+    std::vector<uint8_t> keyRaw(key.begin(), key.end());
+    keyRaw.push_back(CLIENT_CAPS);
+    std::vector<uint8_t> keyEnc;
+    try
+    {
+        const bool ok = timedPhase(CODE_SEND_MESSAGE_REQ, Phase::Crypto, [&] {
+            const uint8_t *pub = peerCache.publicKey(*peer);
+            if (keyType == MSG_TYPE_KEY_X25519)
+            {
+                Encryption::X25519Key xkey;
+                std::copy_n(pub, X25519_PUB_LEN, xkey.begin());
+                if (!Encryption::X25519Seal(xkey, keyRaw.data(), keyRaw.size(), keyEnc))
+                    return false;
+            }
+            else
+            {
+                keyEnc = Encryption::RsaEncryptOaepWithDerPub(pub, peer->keyLen, keyRaw);
+            }
+            const auto *plain = reinterpret_cast<const uint8_t *>(text.data());
+            if (gcm)
+                Encryption::AesGcmSeal(key, plain, text.size(), cipher);
+            else
+                Encryption::AesCbcEncryptZeroIV(key, plain, text.size(), cipher);
+            return !sealed ||
+                   Protocol::buildSealedText(content, keyEnc.data(), keyEnc.size(), cipher.data(), cipher.size());
+        });
+        if (!ok)
+            co_return OpResult::failure("Invalid public key for " + name + ".");
+    }
+    catch (const std::exception &)
+    {
+        co_return OpResult::failure("Invalid public key for " + name + ".");
+    }
+
+    // the key is ours once it is in the outbox, not before
+    const bool keyQueued = sealed ? outbox.push(targetId, MSG_TYPE_TEXT_SEALED, content.data(), content.size())
+                                  : outbox.push(targetId, keyType, keyEnc.data(), keyEnc.size());
+    if (!keyQueued)
+        co_return OpResult::failure("Could not write the outbox file.");
+    peer->symmetricKey = key;
+    peer->hasSymmetricKey = true;
+    peer->historyKey = recordOwnKey(targetId, key);
+    if (sealed)
+    {
+        notePushed(pushed, targetId, MSG_TYPE_TEXT_SEALED, content);
+        co_return OpResult::success();
+    }
+    const uint8_t textType = gcm ? MSG_TYPE_TEXT_GCM : MSG_TYPE_TEXT_CBC;
+    if (!outbox.push(targetId, textType, cipher.data(), cipher.size()))
+        co_return OpResult::failure("Could not write the outbox file.");
+    notePushed(pushed, targetId, textType, cipher);
+    co_return OpResult::success();
+}
+
+// ------------------------- outbox -------------------------
+
+Task<OpResult> ClientSession::enqueueAndFlush(const Uuid &destId, uint8_t type, const uint8_t *content, size_t size)
+{
+    if (!outbox.push(destId, type, content, size))
+        co_return OpResult::failure("Could not write the outbox file.");
+    OutboxEntry mine;
+    mine.destId = destId;
+    mine.type = type;
+    mine.content.assign(content, content + size);
+    co_return co_await flushAsync(nullptr, &mine);
+}
+
+Task<OpResult> ClientSession::flushOutboxAsync(size_t *sent)
+{
+    co_return co_await flushAsync(sent, nullptr);
+}
+
+// Groups the queue by home node and sends each group as 607 frames of at
+// most SEND_BATCH_MAX_ITEMS items / SEND_BATCH_MAX_BYTES. Messages keep
+// their queue order per node, so a key always precedes the text that
+// uses it. Flushes to one node take turns (Outbox::lockFlush), across
+// threads and processes sharing the outbox: a later message never
+// overtakes one another flush is still sending. Messages queued
+// meanwhile are left for the next flush.
+Task<OpResult> ClientSession::flushAsync(size_t *sent, const OutboxEntry *mine)
+{
+    if (sent)
+        *sent = 0;
+    if (!loadIdentity())
+        co_return OpResult::failure(NOT_REGISTERED);
+    Worker &w = worker();
+    auto guard = co_await w.flushLock.lock(); // this thread's flushes never wait on each other's file locks
+    while (w.nodeFlush.size() < cluster.size())
+        w.nodeFlush.emplace_back();
+
+    BufferPool::Lease reqBuf(w.buffers);
+    BufferPool::Lease payload(w.buffers);
+    BufferPool::Lease doneBuf(w.buffers);
+    auto &req = *reqBuf;
+    auto &done = *doneBuf; // per claimed entry: 1 = acked, 2 = rejected
+    auto &claimed = w.claimScratch;
+    auto &batch = w.batchScratch;
+    auto &acks = w.ackScratch;
+
+    size_t queued = 0, delivered = 0, rejected = 0;
+    int mineDone = -1; // the caller's message: its done[] value, -1 if another flush had sent it
+    bool unsettled = false; // sent, but still in the file
+    std::string unreachable;
+    for (size_t node = 0; node < cluster.size(); ++node)
+    {
+        // a one-shot send only needs its own node's queue
+        if (mine && cluster.ownerOf(mine->destId) != node)
+            continue;
+        FileLock &nodeLock = w.nodeFlush[node];
+        if (!outbox.lockFlush(node, nodeLock))
+            co_return OpResult::failure("Could not lock the outbox file.");
+        std::unique_lock<FileLock> flushing(nodeLock, std::adopt_lock);
+
+        if (!outbox.claim(claimed, [this, node](const Uuid &id) { return cluster.ownerOf(id) == node; }))
+            co_return OpResult::failure("Could not lock the outbox file.");
+        const size_t n = claimed.size();
+        if (n == 0)
+            continue;
+        queued += n;
+        done.assign(n, 0);
+
+        if (!co_await ensureJoined(node))
+            unreachable = cluster.label(node);
+        else
+        {
+            size_t i = 0;
+            while (i < n)
+            {
+                batch.clear();
+                timedPhase(CODE_SEND_BATCH_REQ, Phase::Serialize, [&] {
+                    Protocol::beginSendBatch(req, myId);
+                    while (i < n && batch.size() < SEND_BATCH_MAX_ITEMS &&
+                           (batch.empty() || req.size() + claimed[i].content.size() <= SEND_BATCH_MAX_BYTES))
+                    {
+                        const OutboxEntry &e = claimed[i];
+                        Protocol::appendSendBatchItem(req, e.destId, e.type, e.content.data(), e.content.size());
+                        batch.push_back(i++);
+                    }
+                });
+
+                ServerReply rep{};
+                if (!co_await sendAndRecv(w, node, req, rep, *payload) ||
+                    !Protocol::isOk(rep, CODE_SEND_BATCH_OK) ||
+                    !Protocol::parseSendBatchAck(payload->data(), payload->size(), acks) ||
+                    acks.size() != batch.size())
+                {
+                    unreachable = cluster.label(node);
+                    break;
+                }
+                for (size_t k = 0; k < batch.size(); ++k)
+                {
+                    done[batch[k]] = acks[k] ? 1 : 2;
+                    ++(acks[k] ? delivered : rejected);
+                }
+            }
+        }
+        if (!outbox.settle(claimed, done))
+            unsettled = true;
+
+        // the caller's message: the last one queued like it
+        for (size_t k = n; mine && k-- > 0;)
+        {
+            if (claimed[k].sameMessage(*mine))
+            {
+                mineDone = done[k];
+                break;
+            }
+        }
+    }
+
+    if (sent)
+        *sent = delivered;
+    if (unsettled)
+        co_return OpResult::failure("Could not update the outbox file; delivered messages may be sent again.");
+    if (mine)
+    {
+        if (mineDone == 0)
+            co_return OpResult::failure("Message kept in the outbox; could not deliver to " + unreachable);
+        if (mineDone == 2)
+            co_return OpResult::failure("Message rejected by the server (unknown recipient)");
+        co_return OpResult::success();
+    }
+    if (delivered + rejected < queued)
+        co_return OpResult::failure(std::to_string(queued - delivered - rejected) +
+                                    " message(s) kept in the outbox; could not deliver to " + unreachable);
+    if (rejected)
+        co_return OpResult::failure(std::to_string(rejected) +
+                                    " message(s) rejected by the server (unknown recipient)");
+    co_return OpResult::success();
+}
+
+// ------------------------- 151 -------------------------
+
+Task<OpResult> ClientSession::requestSymmetricKeyAsync(std::string name)
+{
+    if (!loadIdentity())
+        co_return OpResult::failure(NOT_REGISTERED);
+
+    Uuid peerId;
+    if (!co_await resolvePeer(name, peerId))
+        co_return OpResult::failure(UNKNOWN_USER);
+    co_return co_await enqueueAndFlush(peerId, MSG_TYPE_KEY_REQUEST, &CLIENT_CAPS, 1);
+}
+
+// ------------------------- 152 -------------------------
+
+Task<OpResult> ClientSession::sendSymmetricKeyAsync(std::string name)
+{
+    if (!loadIdentity())
+        co_return OpResult::failure(NOT_REGISTERED);
+
+    Uuid toId;
+    if (!co_await resolvePeer(name, toId))
+        co_return OpResult::failure(UNKNOWN_USER);
+
+    // settle on the key and copy out what the encryption needs
+    std::vector<uint8_t> keyRaw;
+    std::vector<uint8_t> pub;
+    bool x25519;
+    {
+        std::unique_lock<std::shared_mutex> lock(peersLock);
+        PeerInfo *peer = peerCache.findById(toId);
+        if (!peer)
+            co_return OpResult::failure(UNKNOWN_USER);
+        if (!peer->hasPublicKey())
+            co_return OpResult::failure("No public key for " + name + ". Run 130 first.");
+
+        // ensure we have a symmetric key for this peer (generate once)
+        if (!peer->hasSymmetricKey && !restoreKey(*peer))
+        {
+            peer->symmetricKey = Encryption::GenerateAesKey();
+            peer->hasSymmetricKey = true;
+        }
+        if (!peer->historyKey)
+            peer->historyKey = recordOwnKey(toId, peer->symmetricKey);
+
+        keyRaw.assign(peer->symmetricKey.begin(), peer->symmetricKey.end());
+        const uint8_t *key = peerCache.publicKey(*peer);
+        pub.assign(key, key + peer->keyLen);
+        x25519 = peer->keyType == KEY_TYPE_X25519;
+    }
+
+    // encrypt the 16B AES key (+ our capabilities) to the peer's public key:
+    // X25519 seal for X25519 peers, RSA-OAEP (base64 key) otherwise;
+    // old clients read only the first 16 bytes
+    keyRaw.push_back(CLIENT_CAPS);
+    std::vector<uint8_t> keyEnc;
+    const uint8_t type = x25519 ? MSG_TYPE_KEY_X25519 : MSG_TYPE_KEY;
+    try
+    {
+        bool ok = timedPhase(CODE_SEND_MESSAGE_REQ, Phase::Crypto, [&] {
+            if (x25519)
+            {
+                Encryption::X25519Key key;
+                std::copy_n(pub.data(), X25519_PUB_LEN, key.begin());
+                return Encryption::X25519Seal(key, keyRaw.data(), keyRaw.size(), keyEnc);
+            }
+            keyEnc = Encryption::RsaEncryptOaepWithDerPub(pub.data(), pub.size(), keyRaw);
+            return true;
+        });
+        if (!ok)
+            co_return OpResult::failure("Invalid public key for " + name + ".");
+    }
+    catch (const std::exception &)
+    {
+        co_return OpResult::failure("Invalid public key for " + name + ".");
+    }
+
+    co_return co_await enqueueAndFlush(toId, type, keyEnc.data(), keyEnc.size());
+}
+
+// ------------------------- server stats -------------------------
+
+// No identity needed: operators may ask without being registered.
+Task<OpResult> ClientSession::nodeStats(size_t node, uint8_t flags, std::string &json)
+{
+    auto req = Protocol::buildServerStatsReq(Uuid{}, flags);
+    Worker &w = worker();
+    ServerReply reply{};
+    BufferPool::Lease payload(w.buffers);
+    if (!co_await sendAndRecv(w, node, req, reply, *payload) || !Protocol::isOk(reply, CODE_SERVER_STATS_OK))
+        co_return OpResult::failure(std::string(SERVER_ERROR) + " (" + cluster.label(node) + ")");
+    json.assign(reinterpret_cast<const char *>(payload->data()), payload->size());
+    co_return OpResult::success();
+}
+
+// All nodes asked at once.
+Task<OpResult> ClientSession::serverStatsAsync(std::vector<std::string> &perNode, bool reset)
+{
+    perNode.assign(cluster.size(), std::string());
+    std::vector<Task<OpResult>> asks;
+    asks.reserve(cluster.size());
+    for (size_t node = 0; node < cluster.size(); ++node)
+        asks.push_back(nodeStats(node, reset ? SERVER_STATS_RESET : 0, perNode[node]));
+    for (const OpResult &r : co_await whenAll(std::move(asks)))
+    {
+        if (!r.ok)
+            co_return r;
+    }
+    co_return OpResult::success();
+}
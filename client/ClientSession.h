@@ -0,0 +1,340 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Async.h"
+#include "ServerCluster.h"
+#include "Protocol.h"
+#include "BufferPool.h"
+#include "Outbox.h"
+#include "History.h"
+#include "PeerRegistry.h"
+
+//
+// ============================================================================
+//  ClientSession.h
+//  --------------------------------------------------------------------------
+//  The client operations behind the menu (110..152), independent of any UI.
+//  Both the interactive menu and batch mode drive a ClientSession; it owns
+//  the peer cache and the identity loaded from "my.info".
+//
+//  Operations never print. They return an OpResult whose 'error' holds the
+//  message to show the user when ok == false.
+//
+//  Requests, replies and AES output go through the session's BufferPool,
+//  so a steady send/pull loop reuses the same buffers instead of
+//  allocating per operation.
+//
+//  Requests are routed through a ServerCluster: sends and public-key
+//  fetches go to the recipient's home node, pulls to our own home node,
+//  registration and the clients list to the seed node.
+//
+//  New accounts get an X25519 identity by default (605/606, symmetric keys
+//  sent as message type 5); accounts whose my.info holds an RSA key keep
+//  using RSA. A key is wrapped for whatever type the recipient has.
+//
+//  Every pulled message is kept, still encrypted, in the local History
+//  (141 pages through it); key records there also let a new session
+//  pick up the symmetric keys of earlier ones.
+//
+//  Outgoing messages (150/151/152) go through the persistent Outbox and
+//  are delivered in 607 batches, one frame per home node; anything the
+//  server could not be reached for stays queued for the next flush.
+//
+//  Every operation is a coroutine on the session's EventLoop (Async.h);
+//  the plain methods run one to completion. The *Async forms can be
+//  started together and driven with loop().run(), e.g. whenAll() over
+//  many public-key fetches: their requests are pipelined on each node's
+//  connection instead of waiting for one reply at a time.
+//
+//  A session can be used from several threads at once. Each thread gets
+//  its own event loop, buffers and server connections (a Worker); what
+//  they share is guarded: the peer registry by a reader-writer lock
+//  (lookups on the send path only read, and copy the few bytes they need
+//  out), the history by a mutex, the outbox by its own lock and a file
+//  lock shared with other processes (Outbox.h). The only lock held across
+//  a co_await or a server round trip is the outbox's flush lock of a
+//  node: one flush at a time, in any thread or process, sends the
+//  messages queued for that node.
+// ============================================================================
+//
+
+struct OpResult
+{
+    bool ok = false;
+    std::string error;
+
+    static OpResult success() { return {true, {}}; }
+    static OpResult failure(std::string msg) { return {false, std::move(msg)}; }
+};
+
+// One inbox entry after decoding (option 140).
+struct ReceivedMessage
+{
+    std::string fromName;      // username, or hex UUID if unknown
+    bool nameResolved = true;  // false -> fromName is the hex UUID
+    uint32_t msgId = 0;
+    uint8_t type = 0;          // 1=req sym key, 2/5=sym key (RSA/X25519), 3/4=text (CBC/GCM), 6=key+text
+    std::string text;          // decrypted text or a status line
+    bool failed = false;       // decryption failed / unknown type
+};
+
+// One stored message of a conversation, decrypted when its page is viewed.
+struct HistoryMessage
+{
+    uint32_t ref = 0;   // history cursor: pass as 'before' for older messages
+    uint32_t msgId = 0; // 0 for keys we sent
+    uint32_t time = 0;  // local receive time, seconds since the epoch
+    uint8_t type = 0;
+    std::string text;   // decrypted text or a status line
+    bool failed = false;
+};
+
+class ClientSession
+{
+public:
+    explicit ClientSession(ServerCluster &cluster);
+
+    // 110) Register 'username' and create my.info, with a new identity
+    // key of the type set by setRegistrationKeyType (X25519 by default).
+    OpResult registerUser(const std::string &username) { return worker().loop.run(registerUserAsync(username)); }
+
+    // KEY_TYPE_RSA registers accounts that clients without X25519 can reach.
+    void setRegistrationKeyType(uint8_t keyType) { registrationKeyType = keyType; }
+
+    // 120) Refresh the clients list. Names are returned in server order
+    // (elements already in *namesOut are reused).
+    OpResult refreshClients(std::vector<std::string> *namesOut = nullptr)
+    {
+        return worker().loop.run(refreshClientsAsync(namesOut));
+    }
+
+    // 130) Fetch and cache 'name's public key (either type).
+    OpResult fetchPublicKey(const std::string &name) { return worker().loop.run(fetchPublicKeyAsync(name)); }
+
+    // 130 for several users at once: the keys of cached users come in one
+    // 611 request, unknown ones are looked up (608) concurrently.
+    // 'results' (optional) gets one entry per name; fails if any failed.
+    OpResult fetchPublicKeys(const std::vector<std::string> &names, std::vector<OpResult> *results = nullptr);
+
+    // The public key of every cached peer that has none yet, in one 611
+    // request per PUBLIC_KEYS_MAX_ITEMS peers; '*fetched' gets the number
+    // stored. Fails against servers without 611.
+    OpResult prefetchPublicKeys(size_t *fetched = nullptr)
+    {
+        return worker().loop.run(prefetchPublicKeysAsync(fetched));
+    }
+
+    // Resolves 'name' to its id and public key on the server (608), so
+    // 130/150-152 work without refreshing the whole clients list first.
+    // Called automatically when 'name' is not in the cache.
+    OpResult lookupUser(const std::string &name) { return worker().loop.run(lookupUserAsync(name)); }
+
+    // 140) Pull and decode waiting messages. Elements already in 'out'
+    // are overwritten in place, so callers can reuse the same vector.
+    OpResult pullMessages(std::vector<ReceivedMessage> &out) { return worker().loop.run(pullMessagesAsync(out)); }
+
+    // 141) Up to 'count' stored messages with 'name' older than history
+    // ref 'before' (0 = newest), oldest first. Only the records on the
+    // page are read and decrypted.
+    OpResult historyPage(const std::string &name, uint32_t before, size_t count, std::vector<HistoryMessage> &out)
+    {
+        return worker().loop.run(historyPageAsync(name, before, count, out));
+    }
+
+    // History cursors: the message with server id 'msgId' (0 if not
+    // stored) / the first one received after 'time'.
+    uint32_t historyCursorAt(uint32_t msgId) const;
+    uint32_t historyCursorAfter(uint32_t time) const;
+
+    // 150) Send a text message. AES-GCM if the peer announced
+    // CAP_AES_GCM, otherwise zero-IV CBC. Without a symmetric key with
+    // 'name', a new one is wrapped to their public key and sent first: in
+    // the same message as the text (type 6) to peers that announced
+    // CAP_SEALED_TEXT, as a 152 key message to everyone else.
+    // Same as queueText followed by flushOutbox, but fails only if this
+    // message could not be delivered.
+    OpResult sendText(const std::string &name, const std::string &text) { return worker().loop.run(sendTextAsync(name, text)); }
+
+    // Encrypts and queues a text message without contacting the server
+    // (except to look 'name' up).
+    OpResult queueText(const std::string &name, const std::string &text)
+    {
+        return worker().loop.run(queueTextAsync(name, text));
+    }
+
+    // Delivers everything in the outbox in batches. Fails if messages had
+    // to be kept (server unreachable) or were rejected; '*sent' gets the
+    // number delivered. Waits while a flush in another thread or process
+    // (sharing the outbox file) is sending.
+    OpResult flushOutbox(size_t *sent = nullptr) { return worker().loop.run(flushOutboxAsync(sent)); }
+
+    size_t outboxSize() const { return outbox.size(); }
+
+    // 151) Ask 'name' for a symmetric key.
+    OpResult requestSymmetricKey(const std::string &name) { return worker().loop.run(requestSymmetricKeyAsync(name)); }
+
+    // 152) Send our symmetric key to 'name' (needs their public key).
+    OpResult sendSymmetricKey(const std::string &name) { return worker().loop.run(sendSymmetricKeyAsync(name)); }
+
+    // What every server node recorded about its requests (610): one JSON
+    // document per node, in server.info order. 'reset' starts the
+    // servers' counters over; a node refuses it except over unix:.
+    OpResult serverStats(std::vector<std::string> &perNode, bool reset = false)
+    {
+        return worker().loop.run(serverStatsAsync(perNode, reset));
+    }
+
+    // ---- awaitable forms ----
+    // Arguments passed by reference must outlive the task. A task runs on
+    // the loop of the thread that created it (eventLoop()).
+    Task<OpResult> registerUserAsync(std::string username);
+    Task<OpResult> refreshClientsAsync(std::vector<std::string> *namesOut = nullptr);
+    Task<OpResult> fetchPublicKeyAsync(std::string name);
+    Task<std::vector<OpResult>> fetchPublicKeysAsync(const std::vector<std::string> &names);
+    Task<OpResult> prefetchPublicKeysAsync(size_t *fetched = nullptr);
+    Task<OpResult> lookupUserAsync(std::string name);
+    Task<OpResult> pullMessagesAsync(std::vector<ReceivedMessage> &out);
+    Task<OpResult> historyPageAsync(std::string name, uint32_t before, size_t count, std::vector<HistoryMessage> &out);
+    Task<OpResult> sendTextAsync(std::string name, std::string text);
+    Task<OpResult> queueTextAsync(std::string name, std::string text);
+    Task<OpResult> flushOutboxAsync(size_t *sent = nullptr);
+    Task<OpResult> requestSymmetricKeyAsync(std::string name);
+    Task<OpResult> serverStatsAsync(std::vector<std::string> &perNode, bool reset = false);
+    Task<OpResult> sendSymmetricKeyAsync(std::string name);
+
+    // The calling thread's loop.
+    EventLoop &eventLoop() { return worker().loop; }
+
+    // Not synchronized: only while no other thread uses the session.
+    const PeerRegistry &peers() const { return peerCache; }
+
+private:
+    // Everything one thread needs to run operations; capacity survives
+    // between operations.
+    struct Worker
+    {
+        explicit Worker(ServerCluster &cluster) : loop(cluster), flushLock(loop) {}
+
+        EventLoop loop;
+        AsyncMutex flushLock; // one flush of this thread at a time
+        std::deque<FileLock> nodeFlush; // Outbox::lockFlush per node, this thread's handles
+        BufferPool buffers;
+        std::vector<ClientEntry> listScratch;
+        std::vector<WaitingMessageView> inboxScratch;
+        std::vector<OutboxEntry> claimScratch;
+        std::vector<uint32_t> ackScratch;
+        std::vector<size_t> batchScratch;
+        std::vector<PublicKeyView> keyScratch;
+    };
+
+    // The calling thread's worker, created on first use.
+    Worker &worker();
+
+    // Loads username/id/private key from my.info once and caches them.
+    // An "x25519:" prefix on the key line marks an X25519 identity.
+    bool loadIdentity();
+
+    // one request–response exchange with server node 'node', awaited:
+    // co_await sendAndRecv(...) is false on a transport failure.
+    // Any contiguous frame: std::vector or a FixedRequest<...>::Frame.
+    template <typename Frame>
+    EventLoop::Exchange sendAndRecv(Worker &w, size_t node, const Frame &req, ServerReply &hdr,
+                                    std::vector<uint8_t> &payload)
+    {
+        return w.loop.exchange(node, req.data(), req.size(), hdr, payload);
+    }
+
+    // Registers this client on 'node' under its existing UUID, once per
+    // session. No-op with a single server.
+    Task<bool> ensureJoined(size_t node);
+
+    // Queues one message, then flushes its node's queue; the result is
+    // that message's. The content is copied into the outbox before the
+    // first suspension.
+    Task<OpResult> enqueueAndFlush(const Uuid &destId, uint8_t type, const uint8_t *content, size_t size);
+
+    // flushOutboxAsync; with 'mine' (a message queued by the caller) only
+    // its node's queue is sent, and the result is that message's.
+    Task<OpResult> flushAsync(size_t *sent, const OutboxEntry *mine);
+
+    // queueTextAsync, copying the message it queued into '*pushed' (the
+    // text; with a 152 key ahead of it, still the text).
+    Task<OpResult> queueTextAsync(std::string name, std::string text, OutboxEntry *pushed);
+
+    // Seals our symmetric key for 'peerId' to our own identity and keeps
+    // it in the history, so texts under it can be read again later.
+    // Returns the history ref (0 if not stored).
+    uint32_t recordOwnKey(const Uuid &peerId, const std::array<uint8_t, 16> &key);
+
+    // A new session knows no symmetric keys: takes the newest key record
+    // (sent or received) of the conversation with 'peer' from the history.
+    // Caller holds peersLock exclusively.
+    bool restoreKey(PeerInfo &peer);
+
+    // Unwraps the symmetric key held in history record 'keyRef' (a key
+    // or a type 6 text). Caller holds historyLock.
+    bool historyKey(uint32_t keyRef, std::array<uint8_t, 16> &key);
+
+    // Decrypts key material wrapped to our identity as a message of
+    // 'type' (MSG_TYPE_KEY or MSG_TYPE_KEY_X25519) carries it.
+    bool openKey(uint8_t type, const uint8_t *wrapped, size_t len, std::vector<uint8_t> &recovered);
+
+    // How a type 6 message to us wraps its key: like 2 or 5, by our identity.
+    uint8_t sealedKeyType() const { return myKeyType == KEY_TYPE_X25519 ? MSG_TYPE_KEY_X25519 : MSG_TYPE_KEY; }
+
+    // queueText to a peer we share no key with: a new key travels with the
+    // text (type 6) if the peer announced CAP_SEALED_TEXT, otherwise as a
+    // 152 key message queued ahead of the text.
+    Task<OpResult> queueWithNewKey(Uuid targetId, std::string name, std::string text, OutboxEntry *pushed);
+
+    // Id of peer 'name' from the cache, looked up (608) on a miss; false
+    // if unknown. '*lookedUp' tells whether the lookup just ran (and
+    // fetched the key). Registry entries are found again by id under the
+    // lock: other tasks and threads may add peers (and move the registry).
+    Task<bool> resolvePeer(const std::string &name, Uuid &id, bool *lookedUp = nullptr);
+
+    // 611 to the seed for 'n' ids (at most PUBLIC_KEYS_MAX_ITEMS); stores
+    // every key in the reply and sets stored[i] for each id that got one.
+    Task<OpResult> publicKeysAsync(const Uuid *ids, size_t n, char *stored);
+
+    // 610 to one node; its JSON into 'json'.
+    Task<OpResult> nodeStats(size_t node, uint8_t flags, std::string &json);
+
+    ServerCluster &cluster;
+    const uint64_t serial; // tells sessions apart in the per-thread worker cache
+
+    std::mutex workersMutex;
+    std::map<std::thread::id, std::unique_ptr<Worker>> workers;
+
+    // written once, before identityLoaded is set; read-only afterwards
+    std::mutex identityMutex;
+    std::atomic<bool> identityLoaded{false};
+    std::string myName;
+    Uuid myId{};
+    uint8_t myKeyType = KEY_TYPE_RSA;
+    std::string myPrivB64;                             // RSA
+    std::string myPubB64;                              // RSA
+    std::array<uint8_t, X25519_PUB_LEN> myX25519Priv{}; // X25519
+    std::array<uint8_t, X25519_PUB_LEN> myX25519Pub{};
+    uint8_t registrationKeyType = KEY_TYPE_X25519;
+
+    // every other user: id, public key, symmetric key; by name and by UUID
+    // (lock order: peersLock, then historyLock)
+    mutable std::shared_mutex peersLock;
+    PeerRegistry peerCache;
+
+    mutable std::mutex historyLock;
+    History history;
+
+    Outbox outbox;
+};
@@ -0,0 +1,510 @@
+#include "Codec.h"
+#include <atomic>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CODEC_X86 1
+#include <immintrin.h>
+#define TARGET_SSE4 __attribute__((target("ssse3,sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+// Each kernel set processes whole blocks from the start of the input and
+// returns how much it consumed; the scalar code finishes the remainder.
+// A SIMD decoder stops at the first block holding anything unusual
+// ('=', whitespace, an invalid char) and leaves that block to the scalar
+// decoder, which then decides whether it is an error.
+namespace {
+
+// ---------- Scalar ----------
+
+const char HEX_DIGITS[] = "0123456789abcdef";
+const char B64_ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+const uint8_t HEX_BAD = 0xFF;
+const uint8_t B64_BAD = 0xFF;
+const uint8_t B64_SPACE = 0xFE;
+const uint8_t B64_PAD = 0xFD;
+
+struct Tables {
+    char hexPairs[256][2];
+    uint8_t hexValue[256];
+    uint8_t b64Value[256];
+
+    Tables()
+    {
+        for (int i = 0; i < 256; ++i) {
+            hexPairs[i][0] = HEX_DIGITS[i >> 4];
+            hexPairs[i][1] = HEX_DIGITS[i & 0xF];
+            hexValue[i] = HEX_BAD;
+            b64Value[i] = B64_BAD;
+        }
+        for (int i = 0; i < 10; ++i) hexValue['0' + i] = static_cast<uint8_t>(i);
+        for (int i = 0; i < 6; ++i) {
+            hexValue['a' + i] = static_cast<uint8_t>(10 + i);
+            hexValue['A' + i] = static_cast<uint8_t>(10 + i);
+        }
+        for (int i = 0; i < 64; ++i) b64Value[static_cast<uint8_t>(B64_ALPHABET[i])] = static_cast<uint8_t>(i);
+        for (char c : {' ', '\t', '\r', '\n'}) b64Value[static_cast<uint8_t>(c)] = B64_SPACE;
+        b64Value['='] = B64_PAD;
+    }
+};
+
+const Tables& tables()
+{
+    static const Tables t;
+    return t;
+}
+
+void hexEncodeScalar(const uint8_t* src, size_t n, char* dst)
+{
+    const Tables& t = tables();
+    for (size_t i = 0; i < n; ++i) {
+        dst[2 * i] = t.hexPairs[src[i]][0];
+        dst[2 * i + 1] = t.hexPairs[src[i]][1];
+    }
+}
+
+bool hexDecodeScalar(const char* src, size_t n, uint8_t* dst)
+{
+    const Tables& t = tables();
+    for (size_t i = 0; i < n; ++i) {
+        const uint8_t hi = t.hexValue[static_cast<uint8_t>(src[2 * i])];
+        const uint8_t lo = t.hexValue[static_cast<uint8_t>(src[2 * i + 1])];
+        if (hi == HEX_BAD || lo == HEX_BAD) return false;
+        dst[i] = static_cast<uint8_t>((hi << 4) | lo);
+    }
+    return true;
+}
+
+void base64EncodeScalar(const uint8_t* src, size_t n, char* dst)
+{
+    size_t i = 0;
+    for (; i + 3 <= n; i += 3) {
+        const uint32_t v = (uint32_t(src[i]) << 16) | (uint32_t(src[i + 1]) << 8) | src[i + 2];
+        *dst++ = B64_ALPHABET[(v >> 18) & 63];
+        *dst++ = B64_ALPHABET[(v >> 12) & 63];
+        *dst++ = B64_ALPHABET[(v >> 6) & 63];
+        *dst++ = B64_ALPHABET[v & 63];
+    }
+    if (n - i == 1) {
+        const uint32_t v = uint32_t(src[i]) << 16;
+        *dst++ = B64_ALPHABET[(v >> 18) & 63];
+        *dst++ = B64_ALPHABET[(v >> 12) & 63];
+        *dst++ = '=';
+        *dst++ = '=';
+    } else if (n - i == 2) {
+        const uint32_t v = (uint32_t(src[i]) << 16) | (uint32_t(src[i + 1]) << 8);
+        *dst++ = B64_ALPHABET[(v >> 18) & 63];
+        *dst++ = B64_ALPHABET[(v >> 12) & 63];
+        *dst++ = B64_ALPHABET[(v >> 6) & 63];
+        *dst++ = '=';
+    }
+}
+
+// Decodes src[0, len) (starting on a quartet boundary) to dst; returns the
+// number of bytes written or -1 on error. Whitespace is skipped; after the
+// first '=' only '=' and whitespace may follow. Missing padding is accepted.
+long base64DecodeScalar(const char* src, size_t len, uint8_t* dst)
+{
+    const Tables& t = tables();
+    uint8_t* o = dst;
+    uint32_t quad = 0;
+    int k = 0;
+    for (size_t i = 0; i < len; ++i) {
+        const uint8_t v = t.b64Value[static_cast<uint8_t>(src[i])];
+        if (v < 64) {
+            quad = (quad << 6) | v;
+            if (++k == 4) {
+                *o++ = static_cast<uint8_t>(quad >> 16);
+                *o++ = static_cast<uint8_t>(quad >> 8);
+                *o++ = static_cast<uint8_t>(quad);
+                quad = 0;
+                k = 0;
+            }
+        } else if (v == B64_SPACE) {
+            continue;
+        } else if (v == B64_PAD) {
+            if (k < 2) return -1;
+            for (++i; i < len; ++i) {
+                const uint8_t rest = t.b64Value[static_cast<uint8_t>(src[i])];
+                if (rest != B64_PAD && rest != B64_SPACE) return -1;
+            }
+            break;
+        } else {
+            return -1;
+        }
+    }
+    if (k == 1) return -1;
+    if (k == 2) {
+        *o++ = static_cast<uint8_t>(quad >> 4);
+    } else if (k == 3) {
+        *o++ = static_cast<uint8_t>(quad >> 10);
+        *o++ = static_cast<uint8_t>(quad >> 2);
+    }
+    return static_cast<long>(o - dst);
+}
+
+size_t noBlocksEncode(const uint8_t*, size_t, char*) { return 0; }
+size_t noBlocksDecode(const char*, size_t, uint8_t*) { return 0; }
+
+#ifdef CODEC_X86
+
+// ---------- SSE4.1 (SSSE3 pshufb) ----------
+
+// 16 bytes -> 32 hex chars per iteration
+TARGET_SSE4 size_t hexEncodeSse4(const uint8_t* src, size_t n, char* dst)
+{
+    const __m128i lut = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7',
+                                      '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        const __m128i hi = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(v, 4), mask));
+        const __m128i lo = _mm_shuffle_epi8(lut, _mm_and_si128(v, mask));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+    return i;
+}
+
+// 16 ASCII hex chars -> 16 nibble values; 'ok' lanes are 0xFF where valid
+TARGET_SSE4 inline __m128i hexNibblesSse4(__m128i v, __m128i& ok)
+{
+    const __m128i d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    const __m128i isDigit = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+    const __m128i l = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    const __m128i isAlpha = _mm_cmpeq_epi8(_mm_min_epu8(l, _mm_set1_epi8(5)), l);
+    ok = _mm_or_si128(isDigit, isAlpha);
+    return _mm_or_si128(_mm_and_si128(isDigit, d),
+                        _mm_and_si128(isAlpha, _mm_add_epi8(l, _mm_set1_epi8(10))));
+}
+
+// 32 hex chars -> 16 bytes per iteration; n is the byte count
+TARGET_SSE4 size_t hexDecodeSse4(const char* src, size_t n, uint8_t* dst)
+{
+    const __m128i weights = _mm_set1_epi16(0x0110); // hi * 16 + lo * 1
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i okA, okB;
+        const __m128i a = hexNibblesSse4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i)), okA);
+        const __m128i b = hexNibblesSse4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i + 16)), okB);
+        if (_mm_movemask_epi8(_mm_and_si128(okA, okB)) != 0xFFFF) break;
+        const __m128i bytes = _mm_packus_epi16(_mm_maddubs_epi16(a, weights), _mm_maddubs_epi16(b, weights));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), bytes);
+    }
+    return i;
+}
+
+// 12 bytes -> 16 chars per iteration (reads 16). Mula/Lemire method.
+TARGET_SSE4 inline __m128i base64IndicesSse4(__m128i in)
+{
+    in = _mm_shuffle_epi8(in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+    const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0FC0FC00));
+    const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003F03F0));
+    const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t1, t3);
+}
+
+TARGET_SSE4 inline __m128i base64AsciiSse4(__m128i idx)
+{
+    const __m128i shiftLut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                           '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                           '/' - 63, 'A', 0, 0);
+    // 0..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12; then 0..25 -> 13
+    __m128i r = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+    const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), idx);
+    r = _mm_or_si128(r, _mm_and_si128(less, _mm_set1_epi8(13)));
+    return _mm_add_epi8(_mm_shuffle_epi8(shiftLut, r), idx);
+}
+
+TARGET_SSE4 size_t base64EncodeSse4(const uint8_t* src, size_t n, char* dst)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 12, dst += 16) {
+        const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), base64AsciiSse4(base64IndicesSse4(in)));
+    }
+    return i;
+}
+
+// 16 chars -> 6-bit values; returns false if any char is outside the alphabet
+TARGET_SSE4 inline bool base64ValuesSse4(__m128i in, __m128i& values)
+{
+    const char linv = 1, hinv = 0;
+    const __m128i lowerLut = _mm_setr_epi8(linv, linv, 0x2B, 0x30, 0x41, 0x50, 0x61, 0x70,
+                                           linv, linv, linv, linv, linv, linv, linv, linv);
+    const __m128i upperLut = _mm_setr_epi8(hinv, hinv, 0x2B, 0x39, 0x4F, 0x5A, 0x6F, 0x7A,
+                                           hinv, hinv, hinv, hinv, hinv, hinv, hinv, hinv);
+    const __m128i shiftLut = _mm_setr_epi8(0, 0, 0x3E - 0x2B, 0x34 - 0x30, 0x00 - 0x41, 0x0F - 0x50,
+                                           0x1A - 0x61, 0x29 - 0x70, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i hiNibble = _mm_and_si128(_mm_srli_epi32(in, 4), _mm_set1_epi8(0x0F));
+    const __m128i below = _mm_cmpgt_epi8(_mm_shuffle_epi8(lowerLut, hiNibble), in);
+    const __m128i above = _mm_cmpgt_epi8(in, _mm_shuffle_epi8(upperLut, hiNibble));
+    const __m128i isSlash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+    if (_mm_movemask_epi8(_mm_andnot_si128(isSlash, _mm_or_si128(below, above))))
+        return false;
+    values = _mm_add_epi8(_mm_add_epi8(in, _mm_shuffle_epi8(shiftLut, hiNibble)),
+                          _mm_and_si128(isSlash, _mm_set1_epi8(-3)));
+    return true;
+}
+
+// 4 x 6-bit values per 32-bit lane -> 3 bytes, big-endian, packed to the front
+TARGET_SSE4 inline __m128i base64PackSse4(__m128i values)
+{
+    const __m128i ab = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    const __m128i abcd = _mm_madd_epi16(ab, _mm_set1_epi32(0x00011000));
+    return _mm_shuffle_epi8(abcd, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+// 16 chars -> 12 bytes per iteration (writes 16)
+TARGET_SSE4 size_t base64DecodeSse4(const char* src, size_t len, uint8_t* dst)
+{
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16, dst += 12) {
+        __m128i values;
+        if (!base64ValuesSse4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)), values))
+            break;
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), base64PackSse4(values));
+    }
+    return i;
+}
+
+// ---------- AVX2 ----------
+// Same algorithms on two 128-bit lanes; the SSE4.1 kernels finish the tail.
+// GCC does not emit vzeroupper before those calls from a target("avx2")
+// function, and the legacy-SSE tail then pays a state-transition stall on
+// every call, so each kernel clears the upper halves itself.
+
+TARGET_AVX2 size_t hexEncodeAvx2(const uint8_t* src, size_t n, char* dst)
+{
+    const __m256i lut = _mm256_broadcastsi128_si256(_mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7',
+                                                                  '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'));
+    const __m256i mask = _mm256_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        const __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), mask));
+        const __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, mask));
+        const __m256i a = _mm256_unpacklo_epi8(hi, lo); // lanes: bytes 0-7, 16-23
+        const __m256i b = _mm256_unpackhi_epi8(hi, lo); // lanes: bytes 8-15, 24-31
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 2 * i), _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 2 * i + 32), _mm256_permute2x128_si256(a, b, 0x31));
+    }
+    _mm256_zeroupper();
+    return i + hexEncodeSse4(src + i, n - i, dst + 2 * i);
+}
+
+TARGET_AVX2 inline __m256i hexNibblesAvx2(__m256i v, __m256i& ok)
+{
+    const __m256i d = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+    const __m256i isDigit = _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(9)), d);
+    const __m256i l = _mm256_sub_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+    const __m256i isAlpha = _mm256_cmpeq_epi8(_mm256_min_epu8(l, _mm256_set1_epi8(5)), l);
+    ok = _mm256_or_si256(isDigit, isAlpha);
+    return _mm256_or_si256(_mm256_and_si256(isDigit, d),
+                           _mm256_and_si256(isAlpha, _mm256_add_epi8(l, _mm256_set1_epi8(10))));
+}
+
+TARGET_AVX2 size_t hexDecodeAvx2(const char* src, size_t n, uint8_t* dst)
+{
+    const __m256i weights = _mm256_set1_epi16(0x0110);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i okA, okB;
+        const __m256i a = hexNibblesAvx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 2 * i)), okA);
+        const __m256i b = hexNibblesAvx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 2 * i + 32)), okB);
+        if (_mm256_movemask_epi8(_mm256_and_si256(okA, okB)) != -1) break;
+        // packus works per lane: fix the order of the four 8-byte groups
+        const __m256i packed = _mm256_packus_epi16(_mm256_maddubs_epi16(a, weights), _mm256_maddubs_epi16(b, weights));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+    _mm256_zeroupper();
+    return i + hexDecodeSse4(src + 2 * i, n - i, dst + i);
+}
+
+// 24 bytes -> 32 chars per iteration (reads 28)
+TARGET_AVX2 size_t base64EncodeAvx2(const uint8_t* src, size_t n, char* dst)
+{
+    const __m256i shuffle = _mm256_broadcastsi128_si256(
+        _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+    const __m256i shiftLut = _mm256_broadcastsi128_si256(
+        _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                      '/' - 63, 'A', 0, 0));
+    size_t i = 0;
+    for (; i + 28 <= n; i += 24, dst += 32) {
+        const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 12));
+        __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        in = _mm256_shuffle_epi8(in, shuffle);
+        const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0FC0FC00));
+        const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003F03F0));
+        const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+        const __m256i idx = _mm256_or_si256(t1, t3);
+        __m256i r = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+        const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx);
+        r = _mm256_or_si256(r, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+        r = _mm256_add_epi8(_mm256_shuffle_epi8(shiftLut, r), idx);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), r);
+    }
+    _mm256_zeroupper();
+    return i + base64EncodeSse4(src + i, n - i, dst);
+}
+
+// 32 chars -> 24 bytes per iteration (writes 32)
+TARGET_AVX2 size_t base64DecodeAvx2(const char* src, size_t len, uint8_t* dst)
+{
+    const char linv = 1, hinv = 0;
+    const __m256i lowerLut = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+        linv, linv, 0x2B, 0x30, 0x41, 0x50, 0x61, 0x70, linv, linv, linv, linv, linv, linv, linv, linv));
+    const __m256i upperLut = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+        hinv, hinv, 0x2B, 0x39, 0x4F, 0x5A, 0x6F, 0x7A, hinv, hinv, hinv, hinv, hinv, hinv, hinv, hinv));
+    const __m256i shiftLut = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+        0, 0, 0x3E - 0x2B, 0x34 - 0x30, 0x00 - 0x41, 0x0F - 0x50, 0x1A - 0x61, 0x29 - 0x70, 0, 0, 0, 0, 0, 0, 0, 0));
+    const __m256i pack = _mm256_broadcastsi128_si256(
+        _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32, dst += 24) {
+        const __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        const __m256i hiNibble = _mm256_and_si256(_mm256_srli_epi32(in, 4), _mm256_set1_epi8(0x0F));
+        const __m256i below = _mm256_cmpgt_epi8(_mm256_shuffle_epi8(lowerLut, hiNibble), in);
+        const __m256i above = _mm256_cmpgt_epi8(in, _mm256_shuffle_epi8(upperLut, hiNibble));
+        const __m256i isSlash = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('/'));
+        if (_mm256_movemask_epi8(_mm256_andnot_si256(isSlash, _mm256_or_si256(below, above))))
+            break;
+        const __m256i values = _mm256_add_epi8(_mm256_add_epi8(in, _mm256_shuffle_epi8(shiftLut, hiNibble)),
+                                               _mm256_and_si256(isSlash, _mm256_set1_epi8(-3)));
+        const __m256i ab = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+        const __m256i abcd = _mm256_madd_epi16(ab, _mm256_set1_epi32(0x00011000));
+        const __m256i lanes = _mm256_shuffle_epi8(abcd, pack); // 12 bytes at the front of each lane
+        const __m256i packed = _mm256_permutevar8x32_epi32(lanes, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), packed);
+    }
+    _mm256_zeroupper();
+    return i + base64DecodeSse4(src + i, len - i, dst);
+}
+
+#endif // CODEC_X86
+
+// ---------- Dispatch ----------
+
+struct Kernels {
+    Codec::Isa isa;
+    size_t (*hexEncode)(const uint8_t*, size_t, char*);
+    size_t (*hexDecode)(const char*, size_t, uint8_t*);
+    size_t (*base64Encode)(const uint8_t*, size_t, char*);
+    size_t (*base64Decode)(const char*, size_t, uint8_t*);
+};
+
+const Kernels SCALAR_KERNELS = {Codec::Isa::Scalar, noBlocksEncode, noBlocksDecode, noBlocksEncode, noBlocksDecode};
+#ifdef CODEC_X86
+const Kernels SSE4_KERNELS = {Codec::Isa::Sse4, hexEncodeSse4, hexDecodeSse4, base64EncodeSse4, base64DecodeSse4};
+const Kernels AVX2_KERNELS = {Codec::Isa::Avx2, hexEncodeAvx2, hexDecodeAvx2, base64EncodeAvx2, base64DecodeAvx2};
+#endif
+
+const Kernels* kernelsFor(Codec::Isa isa)
+{
+#ifdef CODEC_X86
+    if (isa == Codec::Isa::Avx2) return &AVX2_KERNELS;
+    if (isa == Codec::Isa::Sse4) return &SSE4_KERNELS;
+#endif
+    (void)isa;
+    return &SCALAR_KERNELS;
+}
+
+std::atomic<const Kernels*> g_kernels{nullptr};
+
+const Kernels& active()
+{
+    const Kernels* k = g_kernels.load(std::memory_order_acquire);
+    if (!k) {
+        k = kernelsFor(Codec::bestIsa());
+        g_kernels.store(k, std::memory_order_release);
+    }
+    return *k;
+}
+
+} // namespace
+
+Codec::Isa Codec::bestIsa()
+{
+#ifdef CODEC_X86
+    static const Isa best = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return Isa::Avx2;
+        if (__builtin_cpu_supports("sse4.1")) return Isa::Sse4;
+        return Isa::Scalar;
+    }();
+    return best;
+#else
+    return Isa::Scalar;
+#endif
+}
+
+Codec::Isa Codec::activeIsa() { return active().isa; }
+
+Codec::Isa Codec::setIsa(Isa isa)
+{
+    if (static_cast<int>(isa) > static_cast<int>(bestIsa())) isa = bestIsa();
+    g_kernels.store(kernelsFor(isa), std::memory_order_release);
+    return isa;
+}
+
+const char* Codec::isaName(Isa isa)
+{
+    switch (isa) {
+    case Isa::Avx2: return "avx2";
+    case Isa::Sse4: return "sse4";
+    default: return "scalar";
+    }
+}
+
+void Codec::hexEncode(const uint8_t* src, size_t n, char* dst)
+{
+    const size_t done = active().hexEncode(src, n, dst);
+    hexEncodeScalar(src + done, n - done, dst + 2 * done);
+}
+
+std::string Codec::hexEncode(const uint8_t* src, size_t n)
+{
+    std::string s(2 * n, '\0');
+    hexEncode(src, n, &s[0]);
+    return s;
+}
+
+bool Codec::hexDecode(const char* src, size_t n, uint8_t* dst)
+{
+    const size_t done = active().hexDecode(src, n, dst);
+    return hexDecodeScalar(src + 2 * done, n - done, dst + done);
+}
+
+void Codec::base64Encode(const uint8_t* src, size_t n, char* dst)
+{
+    const size_t done = active().base64Encode(src, n, dst);
+    base64EncodeScalar(src + done, n - done, dst + done / 3 * 4);
+}
+
+std::string Codec::base64Encode(const uint8_t* src, size_t n)
+{
+    std::string s(base64EncodedLength(n), '\0');
+    base64Encode(src, n, &s[0]);
+    return s;
+}
+
+bool Codec::base64Decode(const char* src, size_t len, std::vector<uint8_t>& out)
+{
+    // SIMD kernels store a full register per block: leave room past the end
+    out.resize(len / 4 * 3 + 3 + 32);
+    const size_t done = active().base64Decode(src, len, out.data());
+    const long tail = base64DecodeScalar(src + done, len - done, out.data() + done / 4 * 3);
+    if (tail < 0) {
+        out.clear();
+        return false;
+    }
+    out.resize(done / 4 * 3 + static_cast<size_t>(tail));
+    return true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//
+// ============================================================================
+//  Codec.h
+//  --------------------------------------------------------------------------
+//  Hex and Base64 encode/decode with scalar, SSE4.1 and AVX2 kernels.
+//
+//  The widest kernel the CPU supports is picked on first use
+//  (__builtin_cpu_supports); setIsa() can force a narrower one, which the
+//  benchmarks use to compare implementations. All kernels produce
+//  byte-identical output.
+//
+//  Hex is lowercase on encode; decode accepts either case.
+//  Base64 is the standard alphabet with '=' padding and no line breaks,
+//  the same format Crypto++'s Base64Encoder(..., false) writes. The
+//  decoder skips whitespace like Crypto++'s Base64Decoder, but rejects
+//  any other character outside the alphabet.
+// ============================================================================
+//
+
+class Codec {
+public:
+    enum class Isa { Scalar, Sse4, Avx2 };
+
+    // Kernel set in use / widest one this CPU supports.
+    static Isa activeIsa();
+    static Isa bestIsa();
+    static const char* isaName(Isa isa);
+
+    // Selects the kernel set; clamped to bestIsa(). Returns the one in use.
+    static Isa setIsa(Isa isa);
+
+    // ---------- Hex ----------
+    // Writes 2*n lowercase hex chars to dst (no terminator).
+    static void hexEncode(const uint8_t* src, size_t n, char* dst);
+    static std::string hexEncode(const uint8_t* src, size_t n);
+
+    // Reads 2*n hex chars from src into n bytes at dst.
+    // Returns false (dst contents unspecified) on a non-hex char.
+    static bool hexDecode(const char* src, size_t n, uint8_t* dst);
+
+    // ---------- Base64 ----------
+    static size_t base64EncodedLength(size_t n) { return (n + 2) / 3 * 4; }
+
+    // Writes base64EncodedLength(n) chars to dst (no terminator).
+    static void base64Encode(const uint8_t* src, size_t n, char* dst);
+    static std::string base64Encode(const uint8_t* src, size_t n);
+
+    // Decodes into 'out' (resized, capacity reused). Returns false on a
+    // character outside the alphabet or truncated input.
+    static bool base64Decode(const char* src, size_t len, std::vector<uint8_t>& out);
+    static bool base64Decode(const std::string& s, std::vector<uint8_t>& out)
+    {
+        return base64Decode(s.data(), s.size(), out);
+    }
+};
@@ -0,0 +1,329 @@
+#include "Daemon.h"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "SocketApi.h"
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+// ------------------------- socket I/O -------------------------
+
+static bool sendAll(SOCKET s, const uint8_t *data, size_t len)
+{
+    size_t sent = 0;
+    while (sent < len)
+    {
+        const int chunk = static_cast<int>(std::min<size_t>(len - sent, INT_MAX));
+        int n = ::send(s, reinterpret_cast<const char *>(data) + sent, chunk, 0);
+        if (n <= 0)
+            return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static bool recvExact(SOCKET s, uint8_t *dst, size_t len)
+{
+    size_t got = 0;
+    while (got < len)
+    {
+        const int chunk = static_cast<int>(std::min<size_t>(len - got, INT_MAX));
+        int n = ::recv(s, reinterpret_cast<char *>(dst) + got, chunk, 0);
+        if (n <= 0)
+            return false;
+        got += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// ------------------------- requests -------------------------
+
+namespace
+{
+// Buffers of one listener thread, reused from request to request.
+struct Conn
+{
+    std::vector<uint8_t> req;
+    std::vector<uint8_t> reply; // DaemonHead, then the payload
+    std::vector<ReceivedMessage> msgs;
+};
+} // namespace
+
+// send / queue payload: nameLen(1) name text
+static bool splitNameText(const std::vector<uint8_t> &p, std::string &name, std::string &text)
+{
+    if (p.empty() || p.size() < 1u + p[0])
+        return false;
+    const char *c = reinterpret_cast<const char *>(p.data());
+    name.assign(c + 1, p[0]);
+    text.assign(c + 1 + p[0], p.size() - 1 - p[0]);
+    return true;
+}
+
+// Runs one request; the reply payload goes after the head in c.reply.
+static OpResult handle(ClientSession &session, uint8_t op, Conn &c)
+{
+    std::string name, text;
+    switch (op)
+    {
+    case DAEMON_OP_SEND:
+    case DAEMON_OP_QUEUE:
+        if (!splitNameText(c.req, name, text))
+            return OpResult::failure("Malformed request.");
+        return op == DAEMON_OP_SEND ? session.sendText(name, text) : session.queueText(name, text);
+
+    case DAEMON_OP_FLUSH:
+    {
+        size_t sent = 0;
+        OpResult res = session.flushOutbox(&sent);
+        append_u32_le(c.reply, static_cast<uint32_t>(sent));
+        append_u32_le(c.reply, static_cast<uint32_t>(session.outboxSize()));
+        return res;
+    }
+
+    case DAEMON_OP_PULL:
+    {
+        OpResult res = session.pullMessages(c.msgs);
+        if (!res.ok)
+            return res;
+        append_u32_le(c.reply, static_cast<uint32_t>(c.msgs.size()));
+        for (const auto &m : c.msgs)
+        {
+            const size_t nameLen = std::min<size_t>(m.fromName.size(), UINT8_MAX);
+            const size_t at = c.reply.size();
+            c.reply.resize(at + PulledHead::size);
+            uint8_t *h = c.reply.data() + at;
+            PulledHead::put<PulledHead::MsgId>(h, m.msgId);
+            PulledHead::put<PulledHead::Type>(h, m.type);
+            PulledHead::put<PulledHead::Failed>(h, static_cast<uint8_t>(m.failed));
+            PulledHead::put<PulledHead::NameLen>(h, static_cast<uint8_t>(nameLen));
+            PulledHead::put<PulledHead::TextLen>(h, static_cast<uint32_t>(m.text.size()));
+            c.reply.insert(c.reply.end(), m.fromName.begin(), m.fromName.begin() + nameLen);
+            c.reply.insert(c.reply.end(), m.text.begin(), m.text.end());
+        }
+        return res;
+    }
+
+    case DAEMON_OP_PREFETCH:
+    {
+        size_t fetched = 0;
+        OpResult res = session.prefetchPublicKeys(&fetched);
+        append_u32_le(c.reply, static_cast<uint32_t>(fetched));
+        return res;
+    }
+
+    default:
+        return OpResult::failure("Unknown operation " + std::to_string(op) + ".");
+    }
+}
+
+// Serves one connection until it closes or sends something malformed.
+static void serve(ClientSession &session, SOCKET s, Conn &c)
+{
+    uint8_t head[DaemonHead::size];
+    while (recvExact(s, head, sizeof(head)))
+    {
+        const uint8_t op = DaemonHead::get<DaemonHead::Op>(head);
+        const uint32_t size = DaemonHead::get<DaemonHead::PayloadSize>(head);
+        if (size > DAEMON_MAX_REQUEST)
+            return;
+        c.req.resize(size);
+        if (size && !recvExact(s, c.req.data(), size))
+            return;
+
+        c.reply.resize(DaemonHead::size);
+        OpResult res = handle(session, op, c);
+        if (!res.ok)
+        {
+            c.reply.resize(DaemonHead::size);
+            c.reply.insert(c.reply.end(), res.error.begin(), res.error.end());
+        }
+        DaemonHead::put<DaemonHead::Op>(c.reply.data(), res.ok ? DAEMON_OK : DAEMON_FAILED);
+        DaemonHead::put<DaemonHead::PayloadSize>(c.reply.data(),
+                                                 static_cast<uint32_t>(c.reply.size() - DaemonHead::size));
+        if (!sendAll(s, c.reply.data(), c.reply.size()))
+            return;
+    }
+}
+
+// Only our own user may drive the session (and read what it pulls).
+static bool sameUser(SOCKET s)
+{
+#if defined(_WIN32)
+    (void)s;
+    return true; // no peer credentials: the ACL of the socket's directory decides
+#elif defined(SO_PEERCRED)
+    ucred cred{};
+    socklen_t len = sizeof(cred);
+    return getsockopt(s, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0 && cred.uid == geteuid();
+#else
+    uid_t uid;
+    gid_t gid;
+    return getpeereid(s, &uid, &gid) == 0 && uid == geteuid();
+#endif
+}
+
+// Set by SIGINT / SIGTERM, which also wake the listeners.
+static std::atomic<bool> g_stopping{false};
+static std::atomic<SOCKET> g_listener{INVALID_SOCKET};
+
+static void onStopSignal(int)
+{
+    g_stopping = true;
+#ifdef _WIN32
+    closesocket(g_listener); // the only way to wake accept() there
+#else
+    shutdown(g_listener, SD_BOTH);
+#endif
+}
+
+static void acceptLoop(ClientSession &session, SOCKET listener)
+{
+    Conn c;
+    for (;;)
+    {
+        SOCKET s = ::accept(listener, nullptr, nullptr);
+        if (s == INVALID_SOCKET)
+        {
+            if (!g_stopping)
+                std::cerr << "accept() failed: " << WSAGetLastError() << "\n";
+            return;
+        }
+        if (sameUser(s))
+            serve(session, s, c);
+        else
+            std::cerr << "Refused a connection from another user\n";
+        closesocket(s);
+    }
+}
+
+// ------------------------- daemon -------------------------
+
+// True if 'path' is a socket file (Windows: AF_UNIX sockets are reparse points).
+static bool isSocketFile(const std::string &path)
+{
+#ifdef _WIN32
+    const DWORD attrs = GetFileAttributesA(path.c_str());
+    return attrs != INVALID_FILE_ATTRIBUTES && (attrs & FILE_ATTRIBUTE_REPARSE_POINT);
+#else
+    struct stat st;
+    return lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode);
+#endif
+}
+
+// Makes way for bind(): removes a socket left by a daemon that is gone.
+// A live daemon's socket, or a file that is not a socket, is left alone.
+static bool removeStaleSocket(const std::string &path, const sockaddr_un &addr)
+{
+    std::error_code ec;
+    if (!std::filesystem::exists(std::filesystem::symlink_status(path, ec)))
+        return true;
+    if (!isSocketFile(path))
+    {
+        std::cerr << path << " exists and is not a socket; not replacing it\n";
+        return false;
+    }
+    SOCKET probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    const bool live = probe != INVALID_SOCKET &&
+                      ::connect(probe, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) != SOCKET_ERROR;
+    if (probe != INVALID_SOCKET)
+        closesocket(probe);
+    if (live)
+    {
+        std::cerr << "Another daemon is serving on " << path << "\n";
+        return false;
+    }
+    if (std::remove(path.c_str()) != 0)
+    {
+        std::cerr << "Cannot remove the stale socket " << path << "\n";
+        return false;
+    }
+    return true;
+}
+
+int runDaemon(ClientSession &session, const std::string &socketPath, unsigned threads)
+{
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+    {
+        std::cerr << "WSAStartup failed\n";
+        return 1;
+    }
+
+    sockaddr_un addr{};
+    if (socketPath.size() >= sizeof(addr.sun_path))
+    {
+        std::cerr << "unix socket path too long: " << socketPath << "\n";
+        WSACleanup();
+        return 1;
+    }
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+    if (!removeStaleSocket(socketPath, addr))
+    {
+        WSACleanup();
+        return 1;
+    }
+    SOCKET listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    const bool bound = listener != INVALID_SOCKET &&
+                       ::bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != SOCKET_ERROR;
+    bool ok = bound;
+#ifndef _WIN32
+    // owner only, before anyone can connect (sameUser() checks again)
+    ok = ok && ::chmod(socketPath.c_str(), S_IRUSR | S_IWUSR) == 0;
+#endif
+    if (!ok || ::listen(listener, SOMAXCONN) == SOCKET_ERROR)
+    {
+        std::cerr << "Cannot listen on " << socketPath << ": " << WSAGetLastError() << "\n";
+        if (listener != INVALID_SOCKET)
+            closesocket(listener);
+        if (bound)
+            std::remove(socketPath.c_str());
+        WSACleanup();
+        return 1;
+    }
+
+    // deliver what an earlier run left queued (main() already connected
+    // this thread, the first listener, to the seed)
+    if (session.outboxSize() != 0)
+        session.flushOutbox();
+
+    g_listener = listener;
+    std::signal(SIGINT, onStopSignal);
+    std::signal(SIGTERM, onStopSignal);
+#ifndef _WIN32
+    std::signal(SIGPIPE, SIG_IGN); // a client that hangs up fails its send(), not the daemon
+#endif
+
+    std::cout << "Serving on unix:" << socketPath << " (" << threads << " thread(s))" << std::endl;
+    std::vector<std::thread> extra;
+    for (unsigned i = 1; i < threads; ++i)
+        extra.emplace_back(acceptLoop, std::ref(session), listener);
+    acceptLoop(session, listener);
+
+    shutdown(listener, SD_BOTH); // wakes the other listeners
+    for (auto &t : extra)
+        t.join();
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+#ifdef _WIN32
+    if (!g_stopping) // the signal handler closed it already
+#endif
+        closesocket(listener);
+    g_listener = INVALID_SOCKET;
+    std::remove(socketPath.c_str());
+    WSACleanup();
+    return g_stopping ? 0 : 1;
+}
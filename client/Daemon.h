@@ -0,0 +1,67 @@
+#pragma once
+#include <string>
+
+#include "ClientSession.h"
+
+//
+// ============================================================================
+//  Daemon.h
+//  --------------------------------------------------------------------------
+//  Long-running mode: one session (identity, peer and key caches, warm
+//  server connections) serves local processes over a Unix-domain socket,
+//  so a short-lived script pays for none of that setup.
+//
+//  Each connection sends requests and reads one reply per request, in
+//  order, for as long as it stays open. All integers little-endian.
+//
+//      request  op(1) payloadSize(4) payload
+//      reply    status(1) payloadSize(4) payload
+//               status 0 = ok; otherwise the payload is the error text
+//
+//      op  request payload                  ok reply payload
+//      1   send:     nameLen(1) name text   -
+//      2   queue:    nameLen(1) name text   -   (encrypt into the outbox only)
+//      3   flush:    -                      sent(4) pending(4)
+//      4   pull:     -                      count(4), count x PulledHead +
+//                                           name + text
+//      5   prefetch: -                      fetched(4)
+//
+//  Every listener thread serves one connection at a time on its own
+//  server connection (see ClientSession.h); 'threads' of them serve that
+//  many scripts at once.
+// ============================================================================
+//
+
+constexpr uint8_t DAEMON_OP_SEND = 1;
+constexpr uint8_t DAEMON_OP_QUEUE = 2;
+constexpr uint8_t DAEMON_OP_FLUSH = 3;
+constexpr uint8_t DAEMON_OP_PULL = 4;
+constexpr uint8_t DAEMON_OP_PREFETCH = 5;
+
+constexpr uint8_t DAEMON_OK = 0;
+constexpr uint8_t DAEMON_FAILED = 1;
+
+constexpr size_t DAEMON_MAX_REQUEST = 1u << 20; // larger requests close the connection
+
+// op(1) / status(1), payloadSize(4 LE)
+struct DaemonHead : schema::Layout<schema::U8, schema::U32>
+{
+    enum { Op, PayloadSize };
+};
+
+// pull reply entry head: msgId(4) type(1) failed(1) nameLen(1) textLen(4)
+struct PulledHead : schema::Layout<schema::U32, schema::U8, schema::U8, schema::U8, schema::U32>
+{
+    enum { MsgId, Type, Failed, NameLen, TextLen };
+};
+
+// Listens on 'socketPath' and serves until SIGINT / SIGTERM (returns 0)
+// or until the listening socket fails (returns 1). A socket file left by
+// a daemon that is gone is replaced; a live daemon's socket or any other
+// file there makes it return 1 without listening.
+//
+// The socket is for the user running the daemon only: mode 0600 and a
+// peer-credential check on every connection (SO_PEERCRED / getpeereid).
+// Windows has neither, so put the socket in a directory only that user
+// can open.
+int runDaemon(ClientSession &session, const std::string &socketPath, unsigned threads = 1);
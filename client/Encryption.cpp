@@ -1,53 +1,196 @@
 #include "Encryption.h"
+#include "Codec.h"
 
 #include <cryptopp/osrng.h>
 #include <cryptopp/aes.h>
 #include <cryptopp/modes.h>
+#include <cryptopp/gcm.h>
 #include <cryptopp/filters.h>
 #include <cryptopp/rsa.h>
-#include <cryptopp/base64.h>
 #include <cryptopp/queue.h>
 #include <cryptopp/secblock.h>
+#include <cryptopp/sha.h>
+#include <cryptopp/xed25519.h>
+#include <cstring>
+#include <stdexcept>
 #include <string>
 #include <iostream>
 
 using byte = CryptoPP::byte;
 
+namespace
+{
+// Rekeying a Crypto++ mode object is cheap; constructing one (and running
+// it through a filter chain) allocates. Keep one pair per thread.
+struct CbcCache
+{
+    std::array<uint8_t, 16> encKey{};
+    std::array<uint8_t, 16> decKey{};
+    bool encKeyed = false;
+    bool decKeyed = false;
+    CryptoPP::CBC_Mode<CryptoPP::AES>::Encryption enc;
+    CryptoPP::CBC_Mode<CryptoPP::AES>::Decryption dec;
+};
+
+thread_local CbcCache t_cbc;
+
+// Same idea for GCM: key once, then each message resynchronizes with its
+// nonce inside EncryptAndAuthenticate/DecryptAndVerify.
+struct GcmCache
+{
+    std::array<uint8_t, 16> encKey{};
+    std::array<uint8_t, 16> decKey{};
+    bool encKeyed = false;
+    bool decKeyed = false;
+    CryptoPP::GCM<CryptoPP::AES>::Encryption enc;
+    CryptoPP::GCM<CryptoPP::AES>::Decryption dec;
+    CryptoPP::AutoSeededRandomPool rng; // nonces
+};
+
+thread_local GcmCache t_gcm;
+
+const byte ZERO_IV[CryptoPP::AES::BLOCKSIZE] = {0};
+
+// AES key for one X25519 seal: SHA-256(shared || ephemeralPub), first 16 bytes.
+// Hashing in the ephemeral key binds the AES key to this one message.
+std::array<uint8_t, 16> sealKeyFromShared(const byte *shared, const byte *ephemeralPub)
+{
+    CryptoPP::SHA256 h;
+    h.Update(shared, CryptoPP::x25519::SHARED_KEYLENGTH);
+    h.Update(ephemeralPub, CryptoPP::x25519::PUBLIC_KEYLENGTH);
+    std::array<uint8_t, 16> key{};
+    h.TruncatedFinal(key.data(), key.size());
+    return key;
+}
+} // namespace
+
 std::vector<uint8_t> Encryption::AesCbcEncryptZeroIV(
     const std::array<uint8_t, 16> &key, const std::vector<uint8_t> &plain)
 {
-    using namespace CryptoPP;
     std::vector<uint8_t> out;
-    SecByteBlock iv(AES::BLOCKSIZE); // zeros by default
-    memset(iv, 0, iv.size());
-
-    CBC_Mode<AES>::Encryption enc(key.data(), key.size(), iv);
-    StringSource ss(plain.data(), plain.size(), true,
-                    new StreamTransformationFilter(enc, new VectorSink(out)));
+    AesCbcEncryptZeroIV(key, plain.data(), plain.size(), out);
     return out;
 }
 
 std::vector<uint8_t> Encryption::AesCbcDecryptZeroIV(
     const std::array<uint8_t, 16> &key, const std::vector<uint8_t> &cipher, bool &ok)
 {
-    using namespace CryptoPP;
     std::vector<uint8_t> out;
-    ok = false;
-    try
+    ok = AesCbcDecryptZeroIV(key, cipher.data(), cipher.size(), out);
+    if (!ok)
+        out.clear();
+    return out;
+}
+
+void Encryption::AesCbcEncryptZeroIV(const std::array<uint8_t, 16> &key,
+                                     const uint8_t *plain, size_t len,
+                                     std::vector<uint8_t> &out)
+{
+    using namespace CryptoPP;
+    if (!t_cbc.encKeyed || t_cbc.encKey != key)
     {
-        SecByteBlock iv(AES::BLOCKSIZE); // zeros
-        memset(iv, 0, iv.size());
+        t_cbc.enc.SetKeyWithIV(key.data(), key.size(), ZERO_IV);
+        t_cbc.encKey = key;
+        t_cbc.encKeyed = true;
+    }
+    else
+    {
+        t_cbc.enc.Resynchronize(ZERO_IV);
+    }
 
-        CBC_Mode<AES>::Decryption dec(key.data(), key.size(), iv);
-        StringSource ss(cipher.data(), cipher.size(), true,
-                        new StreamTransformationFilter(dec, new VectorSink(out)));
-        ok = true;
+    // PKCS#7: always 1..16 bytes of padding, each equal to the pad length
+    const size_t pad = AES::BLOCKSIZE - (len % AES::BLOCKSIZE);
+    out.resize(len + pad);
+    if (len)
+        memcpy(out.data(), plain, len);
+    memset(out.data() + len, static_cast<int>(pad), pad);
+    t_cbc.enc.ProcessData(out.data(), out.data(), out.size());
+}
+
+bool Encryption::AesCbcDecryptZeroIV(const std::array<uint8_t, 16> &key,
+                                     const uint8_t *cipher, size_t len,
+                                     std::vector<uint8_t> &out)
+{
+    using namespace CryptoPP;
+    out.clear();
+    if (len == 0 || len % AES::BLOCKSIZE != 0)
+        return false;
+
+    if (!t_cbc.decKeyed || t_cbc.decKey != key)
+    {
+        t_cbc.dec.SetKeyWithIV(key.data(), key.size(), ZERO_IV);
+        t_cbc.decKey = key;
+        t_cbc.decKeyed = true;
     }
-    catch (...)
+    else
     {
-        ok = false;
+        t_cbc.dec.Resynchronize(ZERO_IV);
     }
-    return out;
+
+    out.resize(len);
+    t_cbc.dec.ProcessData(out.data(), cipher, len);
+
+    const uint8_t pad = out.back();
+    if (pad == 0 || pad > AES::BLOCKSIZE)
+    {
+        out.clear();
+        return false;
+    }
+    for (size_t i = len - pad; i < len; ++i)
+    {
+        if (out[i] != pad)
+        {
+            out.clear();
+            return false;
+        }
+    }
+    out.resize(len - pad);
+    return true;
+}
+
+void Encryption::AesGcmSeal(const std::array<uint8_t, 16> &key,
+                            const uint8_t *plain, size_t len,
+                            std::vector<uint8_t> &out)
+{
+    out.resize(GCM_NONCE_LEN + len + GCM_TAG_LEN);
+    byte *nonce = out.data();
+    t_gcm.rng.GenerateBlock(nonce, GCM_NONCE_LEN);
+
+    if (!t_gcm.encKeyed || t_gcm.encKey != key)
+    {
+        t_gcm.enc.SetKeyWithIV(key.data(), key.size(), nonce, GCM_NONCE_LEN);
+        t_gcm.encKey = key;
+        t_gcm.encKeyed = true;
+    }
+    t_gcm.enc.EncryptAndAuthenticate(nonce + GCM_NONCE_LEN, nonce + GCM_NONCE_LEN + len, GCM_TAG_LEN,
+                                     nonce, GCM_NONCE_LEN, nullptr, 0, plain, len);
+}
+
+bool Encryption::AesGcmOpen(const std::array<uint8_t, 16> &key,
+                            const uint8_t *sealed, size_t len,
+                            std::vector<uint8_t> &out)
+{
+    out.clear();
+    if (len < GCM_NONCE_LEN + GCM_TAG_LEN)
+        return false;
+    const byte *nonce = sealed;
+    const byte *cipher = sealed + GCM_NONCE_LEN;
+    const size_t cipherLen = len - GCM_NONCE_LEN - GCM_TAG_LEN;
+
+    if (!t_gcm.decKeyed || t_gcm.decKey != key)
+    {
+        t_gcm.dec.SetKeyWithIV(key.data(), key.size(), nonce, GCM_NONCE_LEN);
+        t_gcm.decKey = key;
+        t_gcm.decKeyed = true;
+    }
+    out.resize(cipherLen);
+    if (!t_gcm.dec.DecryptAndVerify(out.data(), cipher + cipherLen, GCM_TAG_LEN,
+                                    nonce, GCM_NONCE_LEN, nullptr, 0, cipher, cipherLen))
+    {
+        out.clear();
+        return false;
+    }
+    return true;
 }
 
 std::array<uint8_t, 16> Encryption::GenerateAesKey()
@@ -68,34 +211,111 @@ Encryption::RsaKeyPair Encryption::GenerateRsaKeypair1024()
     RSA::PublicKey pub(priv);
 
     // DER -> Base64 (no line breaks)
-    std::string pubB64, privB64;
+    auto toBase64 = [](ByteQueue &q) {
+        std::vector<uint8_t> der(static_cast<size_t>(q.MaxRetrievable()));
+        q.Get(der.data(), der.size());
+        return Codec::base64Encode(der.data(), der.size());
+    };
 
     ByteQueue pubQ;
     pub.DEREncode(pubQ);
-    Base64Encoder pubEnc(new StringSink(pubB64), false /*insertLineBreaks*/);
-    pubQ.CopyTo(pubEnc);
-    pubEnc.MessageEnd();
 
     ByteQueue privQ;
     priv.DEREncodePrivateKey(privQ); // <-- PKCS#1 private key DER
-    Base64Encoder privEnc(new StringSink(privB64), false);
-    privQ.CopyTo(privEnc);
-    privEnc.MessageEnd();
 
-    return {pubB64, privB64};
+    return {toBase64(pubQ), toBase64(privQ)};
 }
 
-std::vector<uint8_t> Encryption::RsaEncryptOaepWithBase64Pub(
-    const std::string &asciiBase64DerPublic, const std::vector<uint8_t> &plain)
+std::string Encryption::RsaPublicFromPrivateBase64(const std::string &asciiBase64DerPrivate)
 {
     using namespace CryptoPP;
 
+    std::vector<uint8_t> der;
+    if (!Codec::base64Decode(asciiBase64DerPrivate, der))
+        throw std::runtime_error("private key is not valid Base64");
+
+    ByteQueue q;
+    q.Put(der.data(), der.size());
+    q.MessageEnd();
+
+    RSA::PrivateKey priv;
+    priv.BERDecodePrivateKey(q, false, q.MaxRetrievable());
+    RSA::PublicKey pub(priv);
+
+    ByteQueue pubQ;
+    pub.DEREncode(pubQ);
+    std::vector<uint8_t> pubDer(static_cast<size_t>(pubQ.MaxRetrievable()));
+    pubQ.Get(pubDer.data(), pubDer.size());
+    return Codec::base64Encode(pubDer.data(), pubDer.size());
+}
+
+Encryption::X25519KeyPair Encryption::GenerateX25519Keypair()
+{
+    CryptoPP::AutoSeededRandomPool rng;
+    X25519KeyPair kp{};
+    CryptoPP::x25519().GenerateKeyPair(rng, kp.privateKey.data(), kp.publicKey.data());
+    return kp;
+}
+
+Encryption::X25519Key Encryption::X25519PublicFromPrivate(const X25519Key &privateKey)
+{
+    X25519Key pub{};
+    // deterministic; the RNG argument is unused for a given private key
+    CryptoPP::x25519().GeneratePublicKey(CryptoPP::NullRNG(), privateKey.data(), pub.data());
+    return pub;
+}
+
+bool Encryption::X25519Seal(const X25519Key &recipientPublic,
+                            const uint8_t *plain, size_t len,
+                            std::vector<uint8_t> &out)
+{
+    const auto eph = GenerateX25519Keypair();
+    byte shared[CryptoPP::x25519::SHARED_KEYLENGTH];
+    if (!CryptoPP::x25519().Agree(shared, eph.privateKey.data(), recipientPublic.data()))
+        return false;
+
+    std::vector<uint8_t> body;
+    AesGcmSeal(sealKeyFromShared(shared, eph.publicKey.data()), plain, len, body);
+    out.assign(eph.publicKey.begin(), eph.publicKey.end());
+    out.insert(out.end(), body.begin(), body.end());
+    return true;
+}
+
+bool Encryption::X25519Open(const X25519Key &myPrivate,
+                            const uint8_t *sealed, size_t len,
+                            std::vector<uint8_t> &out)
+{
+    if (len < X25519_KEY_LEN + GCM_NONCE_LEN + GCM_TAG_LEN)
+    {
+        out.clear();
+        return false;
+    }
+    byte shared[CryptoPP::x25519::SHARED_KEYLENGTH];
+    if (!CryptoPP::x25519().Agree(shared, myPrivate.data(), sealed))
+    {
+        out.clear();
+        return false;
+    }
+    return AesGcmOpen(sealKeyFromShared(shared, sealed), sealed + X25519_KEY_LEN, len - X25519_KEY_LEN, out);
+}
+
+std::vector<uint8_t> Encryption::RsaEncryptOaepWithBase64Pub(
+    const std::string &asciiBase64DerPublic, const std::vector<uint8_t> &plain)
+{
     // Base64 decode DER bytes
-    std::string der;
-    StringSource b64(asciiBase64DerPublic, true, new Base64Decoder(new StringSink(der)));
+    std::vector<uint8_t> der;
+    if (!Codec::base64Decode(asciiBase64DerPublic, der))
+        throw std::runtime_error("public key is not valid Base64");
+    return RsaEncryptOaepWithDerPub(der.data(), der.size(), plain);
+}
+
+std::vector<uint8_t> Encryption::RsaEncryptOaepWithDerPub(
+    const uint8_t *der, size_t derLen, const std::vector<uint8_t> &plain)
+{
+    using namespace CryptoPP;
 
     ByteQueue q;
-    q.Put(reinterpret_cast<const byte *>(der.data()), der.size());
+    q.Put(der, derLen);
     q.MessageEnd();
 
     RSA::PublicKey pub;
@@ -120,11 +340,12 @@ std::vector<uint8_t> Encryption::RsaDecryptOaepWithBase64Priv(
     try
     {
         // Base64 decode DER bytes
-        std::string der;
-        StringSource b64(asciiBase64DerPrivate, true, new Base64Decoder(new StringSink(der)));
+        std::vector<uint8_t> der;
+        if (!Codec::base64Decode(asciiBase64DerPrivate, der))
+            return {};
 
         ByteQueue q;
-        q.Put(reinterpret_cast<const byte *>(der.data()), der.size());
+        q.Put(der.data(), der.size());
         q.MessageEnd();
 
         RSA::PrivateKey priv;
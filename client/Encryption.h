@@ -14,6 +14,31 @@ public:
                                                     const std::vector<uint8_t>& cipher,
                                                     bool& ok);
 
+    // Allocation-free variants writing into 'out' (resized, capacity reused).
+    // The cipher objects are cached per thread and rekeyed only when the key
+    // changes. PKCS#7 padding, byte-compatible with the functions above.
+    static void AesCbcEncryptZeroIV(const std::array<uint8_t,16>& key,
+                                    const uint8_t* plain, size_t len,
+                                    std::vector<uint8_t>& out);
+    static bool AesCbcDecryptZeroIV(const std::array<uint8_t,16>& key,
+                                    const uint8_t* cipher, size_t len,
+                                    std::vector<uint8_t>& out);
+
+    // ---------- AES-GCM ----------
+    // AES-128-GCM with a fresh random 96-bit nonce per message.
+    // Sealed layout: nonce[12] || ciphertext || tag[16]. Crypto++ uses
+    // AES-NI/PCLMUL when the CPU has them; objects are cached per thread
+    // like the CBC ones.
+    static constexpr size_t GCM_NONCE_LEN = 12;
+    static constexpr size_t GCM_TAG_LEN = 16;
+    static void AesGcmSeal(const std::array<uint8_t,16>& key,
+                           const uint8_t* plain, size_t len,
+                           std::vector<uint8_t>& out);
+    // Returns false if the input is too short or fails authentication.
+    static bool AesGcmOpen(const std::array<uint8_t,16>& key,
+                           const uint8_t* sealed, size_t len,
+                           std::vector<uint8_t>& out);
+
     // Utility: produce a 16-byte random AES key
     static std::array<uint8_t,16> GenerateAesKey();
 
@@ -22,6 +47,10 @@ public:
     static std::vector<uint8_t> RsaEncryptOaepWithBase64Pub(const std::string& asciiBase64DerPublic,
                                                             const std::vector<uint8_t>& plain);
 
+    // Same with the public key already decoded to DER bytes (as PeerRegistry keeps it).
+    static std::vector<uint8_t> RsaEncryptOaepWithDerPub(const uint8_t* der, size_t derLen,
+                                                         const std::vector<uint8_t>& plain);
+
     // RSA-OAEP(SHA) decrypt with my private key provided as Base64 DER (Crypto++ RSA::PrivateKey::DEREncode output)
     // Returns plaintext. 'ok' indicates success/failure.
     static std::vector<uint8_t> RsaDecryptOaepWithBase64Priv(const std::string& asciiBase64DerPrivate,
@@ -34,4 +63,34 @@ public:
         std::string privateKeyBase64;  // matches RSA::PrivateKey::DEREncode + Base64
     };
     static RsaKeyPair GenerateRsaKeypair1024();
+
+    // Public half of a Base64 DER private key, Base64 DER encoded like
+    // RsaKeyPair::publicKeyBase64. Throws on a malformed key.
+    static std::string RsaPublicFromPrivateBase64(const std::string& asciiBase64DerPrivate);
+
+    // ---------- X25519 ----------
+    // Curve25519 identity keys: 32-byte raw public/private keys, generated
+    // in microseconds instead of RSA-1024's milliseconds.
+    static constexpr size_t X25519_KEY_LEN = 32;
+    using X25519Key = std::array<uint8_t, X25519_KEY_LEN>;
+    struct X25519KeyPair {
+        X25519Key publicKey;
+        X25519Key privateKey;
+    };
+    static X25519KeyPair GenerateX25519Keypair();
+    static X25519Key X25519PublicFromPrivate(const X25519Key& privateKey);
+
+    // Encrypts 'plain' to a recipient's X25519 public key (the counterpart
+    // of RsaEncryptOaepWithBase64Pub): a fresh ephemeral key pair is agreed
+    // with the recipient's key, SHA-256(shared || ephemeralPub) gives an
+    // AES-128 key, and the plaintext is sealed with AesGcmSeal.
+    // Layout: ephemeralPub[32] || nonce[12] || ciphertext || tag[16].
+    // Returns false if the recipient key is invalid (low order).
+    static bool X25519Seal(const X25519Key& recipientPublic,
+                           const uint8_t* plain, size_t len,
+                           std::vector<uint8_t>& out);
+    // Returns false if the input is malformed or fails authentication.
+    static bool X25519Open(const X25519Key& myPrivate,
+                           const uint8_t* sealed, size_t len,
+                           std::vector<uint8_t>& out);
 };
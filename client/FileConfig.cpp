@@ -1,16 +1,14 @@
 #include "FileConfig.h"
+#include "Codec.h"
 #include <windows.h>
 #include <filesystem>
 #include <fstream>
-#include <sstream>
-#include <iomanip>
 #include <stdexcept>
 
 #include <osrng.h>
 #include <cryptopp/osrng.h>
 #include <cryptopp/rsa.h>
 #include <cryptopp/queue.h>
-#include <cryptopp/base64.h>
 #include <cryptopp/files.h>
 #include <cryptopp/secblock.h>
 
@@ -38,22 +36,36 @@ std::pair<std::string, unsigned short> FileConfig::readServerInfo() {
     return { ip, port };
 }
 
+std::vector<Endpoint> FileConfig::readServerNodes() {
+    auto path = exeDir() / "server.info";
+    ifstream in(path);
+    if (!in) {
+        throw runtime_error("server.info not found at: " + path.string());
+    }
+    std::vector<Endpoint> nodes;
+    string line;
+    while (getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+        try {
+            nodes.push_back(Endpoint::parse(line));
+        } catch (const std::exception& ex) {
+            throw runtime_error(string("server.info: ") + ex.what());
+        }
+    }
+    if (nodes.empty()) throw runtime_error("server.info lists no server");
+    return nodes;
+}
+
 // Helper: hex (16 bytes) -> hex string (32 chars)
-static string bytes16ToHex(const array<uint8_t,16>& a) {
-    ostringstream ss;
-    ss << hex << setfill('0');
-    for (auto b : a) ss << setw(2) << static_cast<int>(b);
-    return ss.str();
+string FileConfig::bytes16ToHex(const array<uint8_t,16>& a) {
+    return Codec::hexEncode(a.data(), a.size());
 }
-static array<uint8_t,16> hexToBytes16(const string& hex) {
+array<uint8_t,16> FileConfig::hexToBytes16(const string& hex) {
     if (hex.size() < 32) throw runtime_error("UUID hex too short");
     array<uint8_t,16> out{};
-    for (size_t i = 0; i < 16; ++i) {
-        unsigned int v;
-        std::istringstream iss(hex.substr(2*i,2));
-        iss >> std::hex >> v;
-        out[i] = static_cast<uint8_t>(v & 0xFF);
-    }
+    if (!Codec::hexDecode(hex.data(), out.size(), out.data()))
+        throw runtime_error("UUID hex invalid");
     return out;
 }
 
@@ -107,10 +119,9 @@ string FileConfig::generateAndSavePrivateKey(const string& username,
     privateKey.DEREncodePrivateKey(queue);
 
     // Base64-encode DER
-    std::string base64;
-    CryptoPP::Base64Encoder encoder(new CryptoPP::StringSink(base64), false);
-    queue.CopyTo(encoder);
-    encoder.MessageEnd();
+    std::vector<uint8_t> der(static_cast<size_t>(queue.MaxRetrievable()));
+    queue.Get(der.data(), der.size());
+    std::string base64 = Codec::base64Encode(der.data(), der.size());
 
     // Write my.info
     writeMyInfo(username, clientId, base64);
@@ -123,4 +134,12 @@ bool FileConfig::myInfoExists() {
     return std::filesystem::exists(path);
 }
 
+std::string FileConfig::outboxPath() {
+    return (exeDir() / "outbox.dat").string();
+}
+
+std::string FileConfig::historyPath() {
+    return (exeDir() / "history").string();
+}
+
 
@@ -2,10 +2,13 @@
 #pragma once
 #include <string>
 #include <utility>
+#include <vector>
 #include <tuple>
 #include <array>
 #include <cstdint>
 
+#include "Transport.h"
+
 // This class provides file I/O utilities for reading and writing configuration
 
 class FileConfig
@@ -21,6 +24,16 @@ public:
     // Throws or returns empty data if file not found or invalid.
     // ------------------------------------------------------------------------
     static std::pair<std::string, unsigned short> readServerInfo();
+
+    // ------------------------------------------------------------------------
+    // Reads every server node from "server.info": one endpoint per line
+    // ("IP:PORT", "unix:/path" or "mem:name", see Transport.h), blank lines
+    // and lines starting with '#' ignored. The first node is the seed, and
+    // the order of the lines decides each client's home node, so it must be
+    // the same for every client (see ServerCluster.h).
+    // Throws if the file is missing, lists no node or has a bad entry.
+    // ------------------------------------------------------------------------
+    static std::vector<Endpoint> readServerNodes();
     
     // ------------------------------------------------------------------------
     // Reads full client info from "my.info".
@@ -29,6 +42,9 @@ public:
     //   <16-byte binary clientId>
     //   <Base64-encoded private key>
     //
+    // The key line is an RSA DER key, or "x25519:" + Base64 of a raw
+    // 32-byte X25519 key; it is returned as-is (see ClientSession).
+    //
     // Returns: (username, clientId[16], privateKeyBase64)
     // ------------------------------------------------------------------------
     static std::tuple<std::string, std::array<uint8_t, 16>, std::string> readFullMyInfo();
@@ -39,7 +55,7 @@ public:
     // Parameters:
     //   username      - ASCII name of the client
     //   clientId      - 16-byte UUID assigned by the server
-    //   privateKeyB64 - Base64-encoded RSA private key
+    //   privateKeyB64 - private key line (RSA Base64 or "x25519:...")
     //
     // Overwrites existing file if present.
     // ------------------------------------------------------------------------
@@ -63,4 +79,25 @@ public:
     // Returns: true if the file exists, false otherwise.
     // ------------------------------------------------------------------------
     static bool myInfoExists();
+
+    // ------------------------------------------------------------------------
+    // Path of the persistent outbox ("outbox.dat", next to my.info).
+    // ------------------------------------------------------------------------
+    static std::string outboxPath();
+
+    // ------------------------------------------------------------------------
+    // Base path of the local message history ("history", next to my.info);
+    // History adds ".idx" and ".dat".
+    // ------------------------------------------------------------------------
+    static std::string historyPath();
+
+    // ------------------------------------------------------------------------
+    // UUID <-> hex helpers used for the id line of "my.info".
+    //
+    // bytes16ToHex: 16 bytes -> 32 lowercase hex chars.
+    // hexToBytes16: first 32 hex chars -> 16 bytes. Throws if too short
+    //               or not hex.
+    // ------------------------------------------------------------------------
+    static std::string bytes16ToHex(const std::array<uint8_t, 16> &);
+    static std::array<uint8_t, 16> hexToBytes16(const std::string &);
 };
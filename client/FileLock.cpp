@@ -0,0 +1,87 @@
+#include "FileLock.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+bool FileLock::isOpen() const { return file != nullptr; }
+
+bool FileLock::open(const std::string &path)
+{
+    close();
+    HANDLE h = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE,
+                           FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_ALWAYS,
+                           FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE)
+        return false;
+    file = h;
+    return true;
+}
+
+bool FileLock::lock()
+{
+    if (!file)
+        return false;
+    OVERLAPPED at{}; // byte 0; a range past the end of the file can be locked
+    return LockFileEx(file, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &at) != 0;
+}
+
+void FileLock::unlock()
+{
+    if (!file)
+        return;
+    OVERLAPPED at{};
+    UnlockFileEx(file, 0, 1, 0, &at);
+}
+
+void FileLock::close()
+{
+    if (file)
+        CloseHandle(file);
+    file = nullptr;
+}
+
+#else
+
+bool FileLock::isOpen() const { return fd >= 0; }
+
+bool FileLock::open(const std::string &path)
+{
+    close();
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    return fd >= 0;
+}
+
+bool FileLock::lock()
+{
+    if (fd < 0)
+        return false;
+    while (flock(fd, LOCK_EX) != 0)
+    {
+        if (errno != EINTR)
+            return false;
+    }
+    return true;
+}
+
+void FileLock::unlock()
+{
+    if (fd >= 0)
+        flock(fd, LOCK_UN);
+}
+
+void FileLock::close()
+{
+    if (fd >= 0)
+        ::close(fd);
+    fd = -1;
+}
+
+#endif
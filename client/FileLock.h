@@ -0,0 +1,44 @@
+#pragma once
+#include <string>
+
+//
+// ============================================================================
+//  FileLock.h
+//  --------------------------------------------------------------------------
+//  An exclusive advisory lock on a file (LockFileEx on Windows, flock
+//  elsewhere), for state several client processes share in one
+//  directory. Every FileLock opens its own handle, so two of them exclude
+//  each other between threads of one process as well; one FileLock must
+//  not be locked from two threads at once.
+//
+//  lock()/unlock() make it usable with std::lock_guard / std::unique_lock.
+//  Closing the handle (or the process exiting) releases the lock.
+// ============================================================================
+//
+
+class FileLock
+{
+public:
+    FileLock() = default;
+    ~FileLock() { close(); }
+    FileLock(const FileLock &) = delete;
+    FileLock &operator=(const FileLock &) = delete;
+
+    // Opens (creating if needed) the file to lock.
+    bool open(const std::string &path);
+
+    // Blocks until this handle holds the lock. False if it cannot be
+    // taken (not open, or an OS error).
+    bool lock();
+    void unlock();
+
+    void close();
+    bool isOpen() const;
+
+private:
+#ifdef _WIN32
+    void *file = nullptr; // HANDLE
+#else
+    int fd = -1;
+#endif
+};
@@ -0,0 +1,46 @@
+#include "HashRing.h"
+#include <algorithm>
+
+// 64-bit FNV-1a followed by a splitmix64 finalizer, so nearby labels
+// ("node0#0", "node0#1") land far apart on the ring.
+static uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return x;
+}
+
+static uint64_t hashBytes(const uint8_t *p, size_t n)
+{
+    uint64_t h = 0xCBF29CE484222325ull;
+    for (size_t i = 0; i < n; ++i)
+    {
+        h ^= p[i];
+        h *= 0x100000001B3ull;
+    }
+    return mix64(h);
+}
+
+void HashRing::addNode(size_t index, const std::string &label)
+{
+    for (int v = 0; v < VNODES; ++v)
+    {
+        const std::string key = label + "#" + std::to_string(v);
+        points.emplace_back(hashBytes(reinterpret_cast<const uint8_t *>(key.data()), key.size()), index);
+    }
+    std::sort(points.begin(), points.end());
+    ++nodes;
+}
+
+size_t HashRing::ownerOf(const std::array<uint8_t, 16> &id) const
+{
+    const uint64_t h = hashBytes(id.data(), id.size());
+    // first point clockwise from h (wrapping to the start)
+    auto it = std::lower_bound(points.begin(), points.end(), std::make_pair(h, size_t(0)));
+    if (it == points.end())
+        it = points.begin();
+    return it->second;
+}
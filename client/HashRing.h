@@ -0,0 +1,40 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+//
+// ============================================================================
+//  HashRing.h
+//  --------------------------------------------------------------------------
+//  Consistent-hash ring mapping 16-byte client UUIDs to server nodes.
+//
+//  Each node is placed on the ring at VNODES points derived from its label,
+//  so ownership depends only on the set of labels. Adding a node moves
+//  roughly 1/N of the UUIDs to it and leaves the rest where they were.
+//  Labels must name the node the same way for every client; never use an
+//  address, which differs between clients reaching the node differently.
+// ============================================================================
+//
+
+class HashRing
+{
+public:
+    static constexpr int VNODES = 256;
+
+    // Adds node 'index' (caller's numbering) under a stable label.
+    void addNode(size_t index, const std::string &label);
+
+    size_t nodeCount() const { return nodes; }
+
+    // Index of the node owning 'id'. The ring must not be empty.
+    size_t ownerOf(const std::array<uint8_t, 16> &id) const;
+
+private:
+    // (ring position, node index), sorted by position
+    std::vector<std::pair<uint64_t, size_t>> points;
+    size_t nodes = 0;
+};
@@ -0,0 +1,191 @@
+#include "History.h"
+#include <algorithm>
+#include <ctime>
+
+static constexpr uint32_t HISTORY_MAGIC = 0x31534948; // "HIS1"
+static constexpr size_t INITIAL_ENTRIES = 1024;
+static constexpr uint64_t MIN_DATA_BYTES = 1u << 20;
+
+History::History(std::string basePath) : basePath(std::move(basePath))
+{
+    load();
+}
+
+const uint8_t *History::entry(uint32_t ref) const
+{
+    return idx.data() + HistoryIndexHeader::size + size_t(ref - 1) * HistoryIndexEntry::size;
+}
+
+void History::load()
+{
+    if (!idx.open(basePath + ".idx") || !dat.open(basePath + ".dat"))
+        return;
+
+    if (idx.size() < HistoryIndexHeader::size)
+    {
+        if (!idx.resize(HistoryIndexHeader::size + INITIAL_ENTRIES * HistoryIndexEntry::size))
+            return;
+        HistoryIndexHeader::put<HistoryIndexHeader::Magic>(idx.data(), HISTORY_MAGIC);
+        HistoryIndexHeader::put<HistoryIndexHeader::Count>(idx.data(), 0u);
+        HistoryIndexHeader::put<HistoryIndexHeader::DataEnd>(idx.data(), uint64_t(0));
+    }
+    const uint8_t *h = idx.data();
+    if (HistoryIndexHeader::get<HistoryIndexHeader::Magic>(h) != HISTORY_MAGIC)
+        return; // not a history index; leave the file alone
+
+    const size_t capacity = (idx.size() - HistoryIndexHeader::size) / HistoryIndexEntry::size;
+    count = uint32_t(std::min<size_t>(HistoryIndexHeader::get<HistoryIndexHeader::Count>(h), capacity));
+    dataEnd = std::min<uint64_t>(HistoryIndexHeader::get<HistoryIndexHeader::DataEnd>(h), dat.size());
+
+    // drop entries whose content did not make it to the data file
+    while (count)
+    {
+        const uint8_t *e = entry(count);
+        if (HistoryIndexEntry::get<HistoryIndexEntry::DataOff>(e) +
+                HistoryIndexEntry::get<HistoryIndexEntry::DataSize>(e) <= dataEnd)
+            break;
+        --count;
+    }
+
+    for (uint32_t ref = 1; ref <= count; ++ref)
+    {
+        const uint8_t *e = entry(ref);
+        Uuid peer;
+        std::copy_n(HistoryIndexEntry::get<HistoryIndexEntry::Peer>(e), CLIENT_ID_LEN, peer.begin());
+        heads[peer] = ref;
+        const uint32_t msgId = HistoryIndexEntry::get<HistoryIndexEntry::MsgId>(e);
+        if (msgId < lastMsgId)
+            idsSorted = false;
+        lastMsgId = msgId;
+        lastTime = HistoryIndexEntry::get<HistoryIndexEntry::Time>(e);
+    }
+    open = true;
+}
+
+// Grows the files (geometrically) to hold 'entries' records and
+// 'dataBytes' of content.
+bool History::reserve(size_t entries, uint64_t dataBytes)
+{
+    const size_t capacity = (idx.size() - HistoryIndexHeader::size) / HistoryIndexEntry::size;
+    if (entries > capacity &&
+        !idx.resize(HistoryIndexHeader::size + std::max(entries, capacity * 2) * HistoryIndexEntry::size))
+    {
+        return false;
+    }
+    if (dataBytes > dat.size() &&
+        !dat.resize(size_t(std::max({dataBytes, uint64_t(dat.size()) + dat.size() / 2, MIN_DATA_BYTES}))))
+    {
+        return false;
+    }
+    return true;
+}
+
+uint32_t History::append(const Uuid &peer, uint32_t msgId, uint8_t type, uint8_t flags, uint32_t keyRef,
+                         const uint8_t *content, size_t size)
+{
+    if (!open || count == UINT32_MAX || size > UINT32_MAX)
+        return 0;
+    if (!reserve(size_t(count) + 1, dataEnd + size))
+        return 0;
+
+    if (size)
+        std::copy_n(content, size, dat.data() + dataEnd);
+
+    if (!msgId)
+        msgId = lastMsgId;
+    else if (msgId < lastMsgId)
+        idsSorted = false;
+    lastTime = std::max(lastTime, uint32_t(std::time(nullptr)));
+
+    uint8_t *e = idx.data() + HistoryIndexHeader::size + size_t(count) * HistoryIndexEntry::size;
+    HistoryIndexEntry::put<HistoryIndexEntry::Peer>(e, peer);
+    HistoryIndexEntry::put<HistoryIndexEntry::Time>(e, lastTime);
+    HistoryIndexEntry::put<HistoryIndexEntry::DataOff>(e, dataEnd);
+    HistoryIndexEntry::put<HistoryIndexEntry::MsgId>(e, msgId);
+    HistoryIndexEntry::put<HistoryIndexEntry::DataSize>(e, uint32_t(size));
+    HistoryIndexEntry::put<HistoryIndexEntry::Prev>(e, lastOf(peer));
+    HistoryIndexEntry::put<HistoryIndexEntry::KeyRef>(e, keyRef);
+    HistoryIndexEntry::put<HistoryIndexEntry::Type>(e, type);
+    HistoryIndexEntry::put<HistoryIndexEntry::Flags>(e, flags);
+
+    // publish: the header count goes last
+    const uint32_t ref = count + 1;
+    dataEnd += size;
+    HistoryIndexHeader::put<HistoryIndexHeader::DataEnd>(idx.data(), dataEnd);
+    HistoryIndexHeader::put<HistoryIndexHeader::Count>(idx.data(), ref);
+    count = ref;
+    lastMsgId = msgId;
+    heads[peer] = ref;
+    return ref;
+}
+
+HistoryRecord History::record(uint32_t ref) const
+{
+    const uint8_t *e = entry(ref);
+    HistoryRecord r;
+    std::copy_n(HistoryIndexEntry::get<HistoryIndexEntry::Peer>(e), CLIENT_ID_LEN, r.peer.begin());
+    r.time = HistoryIndexEntry::get<HistoryIndexEntry::Time>(e);
+    r.msgId = HistoryIndexEntry::get<HistoryIndexEntry::MsgId>(e);
+    r.type = HistoryIndexEntry::get<HistoryIndexEntry::Type>(e);
+    r.flags = HistoryIndexEntry::get<HistoryIndexEntry::Flags>(e);
+    r.keyRef = HistoryIndexEntry::get<HistoryIndexEntry::KeyRef>(e);
+    r.prev = HistoryIndexEntry::get<HistoryIndexEntry::Prev>(e);
+    r.size = HistoryIndexEntry::get<HistoryIndexEntry::DataSize>(e);
+    r.content = dat.data() + HistoryIndexEntry::get<HistoryIndexEntry::DataOff>(e);
+    return r;
+}
+
+uint32_t History::lastOf(const Uuid &peer) const
+{
+    auto it = heads.find(peer);
+    return it == heads.end() ? 0 : it->second;
+}
+
+uint32_t History::firstAfter(uint32_t time) const
+{
+    uint32_t lo = 1, hi = count + 1;
+    while (lo < hi)
+    {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        if (HistoryIndexEntry::get<HistoryIndexEntry::Time>(entry(mid)) <= time)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+uint32_t History::findMessage(uint32_t msgId) const
+{
+    if (!msgId)
+        return 0;
+    auto matches = [&](uint32_t ref) {
+        const uint8_t *e = entry(ref);
+        return HistoryIndexEntry::get<HistoryIndexEntry::MsgId>(e) == msgId &&
+               !(HistoryIndexEntry::get<HistoryIndexEntry::Flags>(e) & HISTORY_OWN_KEY);
+    };
+
+    if (!idsSorted)
+    {
+        // ids restarted (our home node changed): newest match wins
+        for (uint32_t ref = count; ref > 0; --ref)
+            if (matches(ref))
+                return ref;
+        return 0;
+    }
+
+    uint32_t lo = 1, hi = count + 1;
+    while (lo < hi)
+    {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        if (HistoryIndexEntry::get<HistoryIndexEntry::MsgId>(entry(mid)) < msgId)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    // our own key records share the id of the message before them
+    for (uint32_t ref = lo; ref <= count && HistoryIndexEntry::get<HistoryIndexEntry::MsgId>(entry(ref)) == msgId; ++ref)
+        if (matches(ref))
+            return ref;
+    return 0;
+}
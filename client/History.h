@@ -0,0 +1,109 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "MappedFile.h"
+#include "Protocol.h"
+
+//
+// ============================================================================
+//  History.h
+//  --------------------------------------------------------------------------
+//  Local, append-only store of every message pulled from the server (the
+//  server deletes them once delivered), kept as the ciphertext that came
+//  over the wire.
+//
+//  Two files next to my.info:
+//      history.dat  contents, back to back
+//      history.idx  16-byte header + one 48-byte entry per record
+//                   (peer, time, msgId, type, data offset/size, ...)
+//
+//  Both files are memory-mapped. Entries are addressed by 'ref' (index + 1,
+//  0 = none) and each links to the previous entry of the same peer, so a
+//  page of one conversation touches only that page's entries and
+//  contents. Time and message ids grow along the file, so both are found
+//  by binary search. Records are never decrypted here; the session
+//  decrypts a page when it is viewed, with the key record each text
+//  entry points at ('keyRef').
+//
+//  An append writes the content and the entry first and bumps the header
+//  count last; a crash in between leaves the record out on the next open.
+// ============================================================================
+//
+
+// Key record written by us (our own symmetric key sealed to our identity)
+// rather than received from the peer.
+constexpr uint8_t HISTORY_OWN_KEY = 0x01;
+
+struct HistoryIndexHeader : schema::Layout<schema::U32, schema::U32, schema::U64>
+{
+    enum { Magic, Count, DataEnd };
+};
+
+struct HistoryIndexEntry : schema::Layout<schema::Bytes<CLIENT_ID_LEN>, schema::U32, schema::U64, schema::U32,
+                                          schema::U32, schema::U32, schema::U32, schema::U8, schema::U8,
+                                          schema::Bytes<2>>
+{
+    enum { Peer, Time, DataOff, MsgId, DataSize, Prev, KeyRef, Type, Flags, Reserved };
+};
+
+// One record; 'content' points into the mapped data file and is valid
+// until the next append.
+struct HistoryRecord
+{
+    Uuid peer{};
+    uint32_t time = 0;  // local receive time, seconds since the epoch
+    uint32_t msgId = 0; // server message id
+    uint8_t type = 0;   // MSG_TYPE_*
+    uint8_t flags = 0;  // HISTORY_OWN_KEY
+    uint32_t keyRef = 0; // text: the key record it was encrypted under
+    uint32_t prev = 0;   // previous record of the same peer
+    const uint8_t *content = nullptr;
+    uint32_t size = 0;
+};
+
+class History
+{
+public:
+    // Opens (or creates) basePath + ".idx" / ".dat".
+    explicit History(std::string basePath);
+
+    bool isOpen() const { return open; }
+
+    // Appends one record; returns its ref, or 0 if it could not be stored.
+    // Records we write ourselves carry the last pulled msgId so ids stay
+    // non-decreasing along the file.
+    uint32_t append(const Uuid &peer, uint32_t msgId, uint8_t type, uint8_t flags, uint32_t keyRef,
+                    const uint8_t *content, size_t size);
+
+    // Number of records; valid refs are 1..size().
+    uint32_t size() const { return count; }
+    HistoryRecord record(uint32_t ref) const;
+
+    // Newest record of 'peer', 0 if none.
+    uint32_t lastOf(const Uuid &peer) const;
+
+    // First ref received after 'time' (size() + 1 if none).
+    uint32_t firstAfter(uint32_t time) const;
+
+    // Ref of the record with server id 'msgId', 0 if not stored.
+    uint32_t findMessage(uint32_t msgId) const;
+
+private:
+    void load();
+    bool reserve(size_t entries, uint64_t dataBytes);
+    const uint8_t *entry(uint32_t ref) const;
+
+    std::string basePath;
+    MappedFile idx;
+    MappedFile dat;
+    bool open = false;
+    uint32_t count = 0;
+    uint64_t dataEnd = 0;
+    uint32_t lastTime = 0;
+    uint32_t lastMsgId = 0;
+    bool idsSorted = true; // msgIds non-decreasing along the file
+    std::map<Uuid, uint32_t> heads; // newest ref per peer
+};
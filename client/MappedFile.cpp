@@ -0,0 +1,148 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+bool MappedFile::isOpen() const { return file != nullptr; }
+
+bool MappedFile::open(const std::string &path)
+{
+    close();
+    HANDLE h = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                           OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(h, &sz))
+    {
+        CloseHandle(h);
+        return false;
+    }
+    file = h;
+    length = static_cast<size_t>(sz.QuadPart);
+    return map();
+}
+
+bool MappedFile::resize(size_t bytes)
+{
+    if (!file)
+        return false;
+    unmap();
+    LARGE_INTEGER pos;
+    pos.QuadPart = static_cast<LONGLONG>(bytes);
+    if (!SetFilePointerEx(file, pos, nullptr, FILE_BEGIN) || !SetEndOfFile(file))
+    {
+        map(); // keep the old contents reachable
+        return false;
+    }
+    length = bytes;
+    return map();
+}
+
+bool MappedFile::map()
+{
+    if (length == 0)
+        return true; // an empty file cannot be mapped; data() stays null
+    const uint64_t n = length;
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, DWORD(n >> 32), DWORD(n), nullptr);
+    if (!mapping)
+        return false;
+    view = static_cast<uint8_t *>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, length));
+    if (!view)
+    {
+        CloseHandle(mapping);
+        mapping = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::unmap()
+{
+    if (view)
+        UnmapViewOfFile(view);
+    if (mapping)
+        CloseHandle(mapping);
+    view = nullptr;
+    mapping = nullptr;
+}
+
+void MappedFile::close()
+{
+    unmap();
+    if (file)
+        CloseHandle(file);
+    file = nullptr;
+    length = 0;
+}
+
+#else
+
+bool MappedFile::isOpen() const { return fd >= 0; }
+
+bool MappedFile::open(const std::string &path)
+{
+    close();
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0600);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close();
+        return false;
+    }
+    length = static_cast<size_t>(st.st_size);
+    return map();
+}
+
+bool MappedFile::resize(size_t bytes)
+{
+    if (fd < 0)
+        return false;
+    unmap();
+    if (ftruncate(fd, static_cast<off_t>(bytes)) != 0)
+    {
+        map(); // keep the old contents reachable
+        return false;
+    }
+    length = bytes;
+    return map();
+}
+
+bool MappedFile::map()
+{
+    if (length == 0)
+        return true; // nothing to map; data() stays null
+    void *p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+        return false;
+    view = static_cast<uint8_t *>(p);
+    return true;
+}
+
+void MappedFile::unmap()
+{
+    if (view)
+        munmap(view, length);
+    view = nullptr;
+}
+
+void MappedFile::close()
+{
+    unmap();
+    if (fd >= 0)
+        ::close(fd);
+    fd = -1;
+    length = 0;
+}
+
+#endif
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+//
+// ============================================================================
+//  MappedFile.h
+//  --------------------------------------------------------------------------
+//  A file mapped read/write into memory (MapViewOfFile on Windows, mmap
+//  elsewhere). Writes through data() land in the file; the OS pages the
+//  contents in on first touch, so reading a few records of a large file
+//  only faults in the pages they live on.
+//
+//  resize() changes the file length and remaps it, which moves data():
+//  pointers into the old mapping are invalid afterwards.
+// ============================================================================
+//
+
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    // Opens (creating if needed) and maps the whole file.
+    bool open(const std::string &path);
+
+    // Sets the file length to 'bytes' and maps all of it.
+    bool resize(size_t bytes);
+
+    void close();
+
+    bool isOpen() const;
+    uint8_t *data() { return view; }
+    const uint8_t *data() const { return view; }
+    size_t size() const { return length; }
+
+private:
+    bool map();
+    void unmap();
+
+    uint8_t *view = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void *file = nullptr;    // HANDLE
+    void *mapping = nullptr; // HANDLE
+#else
+    int fd = -1;
+#endif
+};
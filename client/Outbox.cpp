@@ -0,0 +1,195 @@
+#include "Outbox.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+// Calls fn(head, content, offset, length) for every whole record in
+// 'raw'. Returns the bytes they cover: less than raw.size() after a torn
+// append.
+template <typename Fn>
+static size_t forEachRecord(const std::vector<uint8_t> &raw, Fn &&fn)
+{
+    schema::Reader rd(raw.data(), raw.size());
+    size_t at = 0;
+    while (rd.remaining() >= SendMessageHead::size)
+    {
+        const uint8_t *head = rd.take<SendMessageHead>();
+        const uint32_t n = SendMessageHead::get<SendMessageHead::ContentSize>(head);
+        const uint8_t *content = rd.takeBytes(n);
+        if (!content)
+            break; // torn append
+        fn(head, content, at, SendMessageHead::size + n);
+        at += SendMessageHead::size + n;
+    }
+    return at;
+}
+
+static bool isEntry(const uint8_t *head, const uint8_t *content, const OutboxEntry &e)
+{
+    const uint32_t n = SendMessageHead::get<SendMessageHead::ContentSize>(head);
+    return SendMessageHead::get<SendMessageHead::Type>(head) == e.type && n == e.content.size() &&
+           std::memcmp(SendMessageHead::get<SendMessageHead::DestId>(head), e.destId.data(), CLIENT_ID_LEN) == 0 &&
+           std::memcmp(content, e.content.data(), n) == 0;
+}
+
+Outbox::Outbox(std::string path) : path(std::move(path))
+{
+    // drop what a crash in the middle of an append left at the end (not
+    // without the lock: that may be another process's append in progress)
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!lockFile())
+        return;
+    std::unique_lock<FileLock> shared(fileLock, std::adopt_lock);
+    readRaw();
+    const size_t whole = forEachRecord(raw, [](const uint8_t *, const uint8_t *, size_t, size_t) {});
+    if (whole < raw.size())
+    {
+        std::error_code ec;
+        fs::resize_file(this->path, whole, ec);
+    }
+}
+
+bool Outbox::lockFile() const
+{
+    if (!fileLock.isOpen() && !fileLock.open(path + ".lock"))
+        return false;
+    return fileLock.lock();
+}
+
+void Outbox::readRaw() const
+{
+    raw.clear();
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in)
+        return; // nothing queued
+    const std::streamoff n = in.tellg();
+    if (n <= 0)
+        return;
+    raw.resize(static_cast<size_t>(n));
+    in.seekg(0);
+    if (!in.read(reinterpret_cast<char *>(raw.data()), n))
+        raw.resize(static_cast<size_t>(std::max<std::streamoff>(in.gcount(), 0)));
+}
+
+bool Outbox::push(const Uuid &destId, uint8_t type, const uint8_t *content, size_t size)
+{
+    uint8_t head[SendMessageHead::size];
+    SendMessageHead::put<SendMessageHead::DestId>(head, destId);
+    SendMessageHead::put<SendMessageHead::Type>(head, type);
+    SendMessageHead::put<SendMessageHead::ContentSize>(head, static_cast<uint32_t>(size));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!lockFile())
+        return false;
+    std::unique_lock<FileLock> shared(fileLock, std::adopt_lock);
+    std::ofstream out(path, std::ios::binary | std::ios::app);
+    if (!out)
+        return false;
+    out.write(reinterpret_cast<const char *>(head), sizeof(head));
+    out.write(reinterpret_cast<const char *>(content), static_cast<std::streamsize>(size));
+    out.flush();
+    return static_cast<bool>(out);
+}
+
+size_t Outbox::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    // without the lock the file is still read whole: records are only
+    // appended, or replaced by a rename, and a torn last one is skipped
+    std::unique_lock<FileLock> shared;
+    if (lockFile())
+        shared = std::unique_lock<FileLock>(fileLock, std::adopt_lock);
+    readRaw();
+    size_t n = 0;
+    forEachRecord(raw, [&](const uint8_t *, const uint8_t *, size_t, size_t) { ++n; });
+    return n;
+}
+
+bool Outbox::lockFlush(size_t node, FileLock &lock) const
+{
+    if (!lock.isOpen() && !lock.open(path + ".node" + std::to_string(node) + ".lock"))
+        return false;
+    return lock.lock();
+}
+
+bool Outbox::claim(std::vector<OutboxEntry> &out, const std::function<bool(const Uuid &)> &select)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!lockFile())
+    {
+        out.clear();
+        return false;
+    }
+    std::unique_lock<FileLock> shared(fileLock, std::adopt_lock);
+    readRaw();
+    size_t n = 0;
+    Uuid destId;
+    forEachRecord(raw, [&](const uint8_t *head, const uint8_t *content, size_t, size_t) {
+        std::copy_n(SendMessageHead::get<SendMessageHead::DestId>(head), CLIENT_ID_LEN, destId.begin());
+        if (!select(destId))
+            return;
+        if (n == out.size())
+            out.emplace_back();
+        OutboxEntry &c = out[n++];
+        c.destId = destId;
+        c.type = SendMessageHead::get<SendMessageHead::Type>(head);
+        c.content.assign(content, content + SendMessageHead::get<SendMessageHead::ContentSize>(head));
+    });
+    out.resize(n);
+    return true;
+}
+
+bool Outbox::settle(const std::vector<OutboxEntry> &claimed, const std::vector<uint8_t> &done)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!lockFile())
+        return false;
+    std::unique_lock<FileLock> shared(fileLock, std::adopt_lock);
+    readRaw();
+    // Only the flush holding their node's lockFlush() removes records
+    // for that node and pushes only append, so the claimed entries are
+    // still in the file, in order, and the first record equal to the next
+    // claimed one is that entry (equal records go to the same node).
+    keep.clear();
+    size_t k = 0;
+    bool dropped = false;
+    forEachRecord(raw, [&](const uint8_t *head, const uint8_t *content, size_t at, size_t len) {
+        if (k < claimed.size() && isEntry(head, content, claimed[k]))
+        {
+            if (done[k++])
+            {
+                dropped = true;
+                return;
+            }
+        }
+        keep.emplace_back(at, len);
+    });
+    return !dropped || rewrite();
+}
+
+// Writes the records that stay to a temp file and renames it over the
+// outbox, so a crash leaves either the old or the new queue.
+bool Outbox::rewrite() const
+{
+    std::error_code ec;
+    if (keep.empty())
+    {
+        fs::remove(path, ec);
+        return !ec;
+    }
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+        for (const auto &[at, len] : keep)
+            out.write(reinterpret_cast<const char *>(raw.data() + at), static_cast<std::streamsize>(len));
+        if (!out.flush())
+            return false;
+    }
+    fs::rename(tmp, path, ec);
+    return !ec;
+}
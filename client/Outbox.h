@@ -0,0 +1,97 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "FileLock.h"
+#include "Protocol.h"
+
+//
+// ============================================================================
+//  Outbox.h
+//  --------------------------------------------------------------------------
+//  Persistent queue of outgoing messages, kept in "outbox.dat" next to
+//  my.info.
+//
+//  Messages are queued already encrypted, exactly as they go on the wire,
+//  so one that could not be delivered (server down, connection lost)
+//  survives until the next flush, even across a restart. Flushing
+//  (ClientSession::flushOutbox) sends them in 607 batches.
+//
+//  The file is a sequence of 603 payloads: destId(16) type(1)
+//  contentSize(4 LE) content. push() appends one record; settle()
+//  rewrites the file with what is still pending. A truncated last record
+//  (crash while appending) is dropped when the outbox is opened.
+//
+//  Several processes may share the directory (daemon, batch and
+//  interactive clients), so the file is the queue: every operation reads
+//  or changes it under an exclusive lock on "outbox.dat.lock", taken
+//  between processes as well as threads, and nothing is cached in memory.
+//
+//  A flush holds a node's lockFlush() from claim() to settle(), so one
+//  flush at a time (in any process) sends the messages for that node:
+//  none is sent twice and none overtakes an earlier one to the same
+//  node. Flushes to different nodes run side by side.
+// ============================================================================
+//
+
+struct OutboxEntry
+{
+    Uuid destId{};
+    uint8_t type = 0;
+    std::vector<uint8_t> content;
+
+    bool sameMessage(const OutboxEntry &o) const
+    {
+        return destId == o.destId && type == o.type && content == o.content;
+    }
+};
+
+class Outbox
+{
+public:
+    explicit Outbox(std::string path);
+
+    // Appends one message to the file. False if it could not be written
+    // or the file lock could not be taken (the message is not queued).
+    bool push(const Uuid &destId, uint8_t type, const uint8_t *content, size_t size);
+
+    // Records in the file (read even if the file lock cannot be taken).
+    size_t size() const;
+    bool empty() const { return size() == 0; }
+
+    // Takes the right to send the messages for server node 'node' (its
+    // index in server.info; lock file "outbox.dat.node<N>.lock"), blocking
+    // while another flush (any thread or process) has it. Kept until
+    // 'lock' is unlocked or destroyed; the handle stays open for reuse.
+    bool lockFlush(size_t node, FileLock &lock) const;
+
+    // Copies every queued entry 'select' accepts into 'out', in queue
+    // order (its elements and their capacity are reused). Caller holds
+    // lockFlush() of every node 'select' accepts. False (and 'out' empty)
+    // if the file lock cannot be taken.
+    bool claim(std::vector<OutboxEntry> &out, const std::function<bool(const Uuid &)> &select);
+
+    // Ends a claim: entry k of 'claimed' is dropped from the file if
+    // done[k] is non-zero. Messages queued since the claim are kept.
+    // False if the file could not be locked or rewritten (nothing dropped).
+    bool settle(const std::vector<OutboxEntry> &claimed, const std::vector<uint8_t> &done);
+
+private:
+    // Takes the file lock, (re)opening "outbox.dat.lock" if needed.
+    bool lockFile() const;
+    // Reads the whole file into 'raw'; caller holds the locks.
+    void readRaw() const;
+    // Replaces the file with the records at 'keep' (offset, length) in 'raw'.
+    bool rewrite() const;
+
+    std::string path;
+    mutable std::mutex mutex; // this process's threads; fileLock the others
+    mutable FileLock fileLock;
+    mutable std::vector<uint8_t> raw;            // file contents, reused
+    std::vector<std::pair<size_t, size_t>> keep; // settle(): records that stay
+};
@@ -0,0 +1,209 @@
+#include "PeerRegistry.h"
+#include <algorithm>
+#include <cstring>
+
+#include "Codec.h"
+
+// splitmix64 finalizer: spreads every input bit over the whole word, so
+// the low bits (table position) and high bits (tag) are independent.
+static uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return x;
+}
+
+static uint64_t hashName(std::string_view name)
+{
+    uint64_t h = 0xCBF29CE484222325ull; // FNV-1a
+    for (unsigned char c : name)
+    {
+        h ^= c;
+        h *= 0x100000001B3ull;
+    }
+    return mix64(h);
+}
+
+static uint64_t hashId(const Uuid &id)
+{
+    uint64_t lo, hi;
+    std::memcpy(&lo, id.data(), 8);
+    std::memcpy(&hi, id.data() + 8, 8);
+    return mix64(lo ^ mix64(hi));
+}
+
+static uint64_t makeSlot(uint64_t hash, uint32_t index)
+{
+    return (hash & 0xFFFFFFFF00000000ull) | (uint64_t(index) + 1);
+}
+
+// ----------------------------------------------------------------------------
+
+template <typename Match>
+size_t PeerRegistry::probe(const std::vector<uint64_t> &table, uint64_t hash, Match match) const
+{
+    if (table.empty())
+        return NONE;
+    const size_t mask = table.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask)
+    {
+        const uint64_t slot = table[i];
+        if (!slot)
+            return NONE;
+        const uint32_t index = uint32_t(slot) - 1;
+        if ((slot >> 32) == (hash >> 32) && match(peers[index]))
+            return index;
+    }
+}
+
+void PeerRegistry::insertSlot(std::vector<uint64_t> &table, uint64_t hash, uint32_t index)
+{
+    const size_t mask = table.size() - 1;
+    size_t i = hash & mask;
+    while (table[i])
+        i = (i + 1) & mask;
+    table[i] = makeSlot(hash, index);
+}
+
+// Removes peer 'index' from the UUID table (backward-shift deletion, so
+// no tombstones are left behind for later probes to walk over).
+void PeerRegistry::eraseIdSlot(uint32_t index)
+{
+    const size_t mask = byId.size() - 1;
+    size_t i = hashId(peers[index].id) & mask;
+    while (uint32_t(byId[i]) != index + 1)
+    {
+        if (!byId[i])
+            return;
+        i = (i + 1) & mask;
+    }
+    for (size_t j = (i + 1) & mask; byId[j]; j = (j + 1) & mask)
+    {
+        // move the entry at j into the hole unless its home lies in (i, j]
+        const size_t home = hashId(peers[uint32_t(byId[j]) - 1].id) & mask;
+        if (((j - home) & mask) >= ((j - i) & mask))
+        {
+            byId[i] = byId[j];
+            i = j;
+        }
+    }
+    byId[i] = 0;
+}
+
+void PeerRegistry::rehash(size_t capacity)
+{
+    byName.assign(capacity, 0);
+    byId.assign(capacity, 0);
+    for (uint32_t i = 0; i < peers.size(); ++i)
+    {
+        insertSlot(byName, hashName(nameOf(peers[i])), i);
+        insertSlot(byId, hashId(peers[i].id), i);
+    }
+}
+
+void PeerRegistry::reserve(size_t n)
+{
+    peers.reserve(n);
+    size_t capacity = 16;
+    while (capacity * 3 < n * 4)
+        capacity *= 2;
+    if (capacity > byName.size())
+        rehash(capacity);
+}
+
+// ----------------------------------------------------------------------------
+
+PeerInfo *PeerRegistry::find(std::string_view name)
+{
+    return const_cast<PeerInfo *>(static_cast<const PeerRegistry *>(this)->find(name));
+}
+
+const PeerInfo *PeerRegistry::find(std::string_view name) const
+{
+    const size_t i = probe(byName, hashName(name), [&](const PeerInfo &p) { return nameOf(p) == name; });
+    return i == NONE ? nullptr : &peers[i];
+}
+
+PeerInfo *PeerRegistry::findById(const Uuid &id)
+{
+    return const_cast<PeerInfo *>(static_cast<const PeerRegistry *>(this)->findById(id));
+}
+
+const PeerInfo *PeerRegistry::findById(const Uuid &id) const
+{
+    const size_t i = probe(byId, hashId(id), [&](const PeerInfo &p) { return p.id == id; });
+    return i == NONE ? nullptr : &peers[i];
+}
+
+PeerInfo &PeerRegistry::upsert(std::string_view name, const Uuid &id)
+{
+    const uint64_t h = hashName(name);
+    const size_t found = probe(byName, h, [&](const PeerInfo &p) { return nameOf(p) == name; });
+    if (found != NONE)
+    {
+        PeerInfo &peer = peers[found];
+        if (peer.id != id)
+        {
+            eraseIdSlot(uint32_t(found));
+            peer.id = id;
+            insertSlot(byId, hashId(id), uint32_t(found));
+        }
+        return peer;
+    }
+
+    if ((peers.size() + 1) * 4 > byName.size() * 3)
+        rehash(std::max<size_t>(16, byName.size() * 2));
+
+    PeerInfo peer;
+    peer.id = id;
+    peer.nameOff = uint32_t(names.size());
+    peer.nameLen = uint16_t(std::min<size_t>(name.size(), UINT16_MAX));
+    names.insert(names.end(), name.data(), name.data() + peer.nameLen);
+
+    const uint32_t index = uint32_t(peers.size());
+    peers.push_back(peer);
+    insertSlot(byName, h, index);
+    insertSlot(byId, hashId(id), index);
+    return peers.back();
+}
+
+bool PeerRegistry::setPublicKey(PeerInfo &peer, uint8_t keyType, const uint8_t *key, size_t len)
+{
+    const uint8_t *src = key;
+    if (keyType == KEY_TYPE_RSA)
+    {
+        if (!Codec::base64Decode(reinterpret_cast<const char *>(key), len, derScratch) ||
+            derScratch.empty() || derScratch.size() > UINT16_MAX)
+        {
+            return false;
+        }
+        src = derScratch.data();
+        len = derScratch.size();
+    }
+    else if (keyType != KEY_TYPE_X25519 || len != X25519_PUB_LEN)
+    {
+        return false;
+    }
+
+    // a re-fetched key of the same length is overwritten in place; a key
+    // of another length is appended (the old bytes stay in the arena)
+    if (len != peer.keyLen)
+    {
+        peer.keyOff = uint32_t(keys.size());
+        keys.resize(keys.size() + len);
+    }
+    std::memcpy(keys.data() + peer.keyOff, src, len);
+    peer.keyLen = uint16_t(len);
+    peer.keyType = keyType;
+    return true;
+}
+
+size_t PeerRegistry::memoryBytes() const
+{
+    return peers.capacity() * sizeof(PeerInfo) +
+           (byName.capacity() + byId.capacity()) * sizeof(uint64_t) +
+           names.capacity() + keys.capacity() + derScratch.capacity();
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "Protocol.h"
+
+//
+// ============================================================================
+//  PeerRegistry.h
+//  --------------------------------------------------------------------------
+//  Every other user the session knows about: id, public key, symmetric key.
+//
+//  Peers live in one dense vector. Two open-addressing (linear probing)
+//  tables index it, one by username and one by UUID, so both "send to
+//  name" and "who sent this inbox message" are a single hashed probe.
+//  Table slots are 8 bytes: the upper half of the key's hash as a tag
+//  (compared before touching the peer) and the peer's index + 1 (0 = empty).
+//
+//  Usernames are interned in one character arena and public keys kept in
+//  a byte arena: RSA keys as decoded DER (~160 bytes instead of ~216
+//  chars of Base64), X25519 keys as their 32 raw bytes. A PeerInfo itself
+//  is 52 bytes with no heap allocations of its own.
+//
+//  References and pointers to a PeerInfo stay valid until the next insert.
+// ============================================================================
+//
+
+struct PeerInfo
+{
+    Uuid id{};
+    std::array<uint8_t, 16> symmetricKey{};
+    uint32_t nameOff = 0; // into the registry's name arena
+    uint32_t keyOff = 0;  // into the registry's key arena
+    uint16_t nameLen = 0;
+    uint16_t keyLen = 0;  // 0 = public key not fetched yet
+    uint8_t keyType = KEY_TYPE_RSA;
+    bool hasSymmetricKey = false;
+    uint8_t caps = 0; // CAP_* bits the peer announced; 0 = old client
+    uint32_t historyKey = 0; // History ref of the record holding symmetricKey
+
+    bool hasPublicKey() const { return keyLen != 0; }
+};
+
+class PeerRegistry
+{
+public:
+    // Peer by username / by UUID, or nullptr.
+    PeerInfo *find(std::string_view name);
+    const PeerInfo *find(std::string_view name) const;
+    PeerInfo *findById(const Uuid &id);
+    const PeerInfo *findById(const Uuid &id) const;
+
+    // Peer 'name' with id 'id', added if missing. An existing peer keeps
+    // its keys; only its id (and the UUID index) is updated.
+    PeerInfo &upsert(std::string_view name, const Uuid &id);
+
+    std::string_view nameOf(const PeerInfo &peer) const
+    {
+        return {names.data() + peer.nameOff, peer.nameLen};
+    }
+
+    // Stores a public key as received from the server: Base64 DER text for
+    // KEY_TYPE_RSA, 32 raw bytes for KEY_TYPE_X25519. False (peer left
+    // unchanged) on an unknown type or a malformed key.
+    bool setPublicKey(PeerInfo &peer, uint8_t keyType, const uint8_t *key, size_t len);
+
+    // hasPublicKey() bytes: DER for RSA, the raw key for X25519.
+    const uint8_t *publicKey(const PeerInfo &peer) const { return keys.data() + peer.keyOff; }
+
+    // Room for 'n' peers without rehashing.
+    void reserve(size_t n);
+
+    size_t size() const { return peers.size(); }
+    std::vector<PeerInfo>::const_iterator begin() const { return peers.begin(); }
+    std::vector<PeerInfo>::const_iterator end() const { return peers.end(); }
+
+    // Heap bytes held by the registry (capacities, not sizes).
+    size_t memoryBytes() const;
+
+private:
+    static constexpr size_t NONE = SIZE_MAX;
+
+    // Probes 'table' for a slot with 'hash' whose peer satisfies 'match';
+    // returns the peer index or NONE.
+    template <typename Match>
+    size_t probe(const std::vector<uint64_t> &table, uint64_t hash, Match match) const;
+
+    void insertSlot(std::vector<uint64_t> &table, uint64_t hash, uint32_t index);
+    void eraseIdSlot(uint32_t index);
+    void rehash(size_t capacity);
+
+    std::vector<PeerInfo> peers;
+    std::vector<uint64_t> byName; // power-of-two sizes, load <= 3/4
+    std::vector<uint64_t> byId;
+    std::vector<char> names;
+    std::vector<uint8_t> keys;
+    std::vector<uint8_t> derScratch;
+};
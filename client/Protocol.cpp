@@ -1,60 +1,141 @@
 #include "Protocol.h"
 #include <algorithm>
+#include <cstring>
 
-std::vector<uint8_t> Protocol::buildRegistration(
+// writes the 23-byte request header at dst
+static void writeRequestHeader(uint8_t* dst, const std::array<uint8_t,16>& clientId,
+                               uint16_t code, uint32_t payloadSize)
+{
+    RequestHeader::put<RequestHeader::ClientId>(dst, clientId);
+    RequestHeader::put<RequestHeader::Version>(dst, CLIENT_VERSION);
+    RequestHeader::put<RequestHeader::Code>(dst, code);
+    RequestHeader::put<RequestHeader::PayloadSize>(dst, payloadSize);
+}
+
+// plain and multiplexed replies differ only in the header
+static bool isServerVersion(uint8_t version)
+{
+    return version == SERVER_VERSION_EXPECTED || version == SERVER_VERSION_MUX;
+}
+
+// header + payload of a fixed-size request; returns the payload start
+template <typename Req>
+static uint8_t* beginFixed(typename Req::Frame& frame, const std::array<uint8_t,16>& clientId)
+{
+    writeRequestHeader(frame.data(), clientId, Req::code,
+                       static_cast<uint32_t>(Req::size - RequestHeader::size));
+    return frame.data() + RequestHeader::size;
+}
+
+RegistrationReq::Frame Protocol::buildRegistration(
     const std::array<uint8_t,16>& clientId,
     const std::string& usernameAscii,
     const std::string& publicKeyAscii)
 {
-    std::vector<uint8_t> payload; payload.resize(REG_NAME_LEN + REG_PUB_LEN, 0);
-    size_t nlen = std::min(usernameAscii.size(), REG_NAME_LEN);
-    std::copy_n(reinterpret_cast<const uint8_t*>(usernameAscii.data()), nlen, payload.data());
-    size_t klen = std::min(publicKeyAscii.size(), REG_PUB_LEN);
-    std::copy_n(reinterpret_cast<const uint8_t*>(publicKeyAscii.data()), klen, payload.data() + REG_NAME_LEN);
+    RegistrationReq::Frame msg;
+    uint8_t* payload = beginFixed<RegistrationReq>(msg, clientId);
+    RegistrationPayload::put<RegistrationPayload::Name>(payload, usernameAscii);
+    RegistrationPayload::put<RegistrationPayload::PublicKey>(payload, publicKeyAscii);
+    return msg;
+}
 
-    std::vector<uint8_t> msg;
-    msg.reserve(16 + 1 + 2 + 4 + payload.size());
-    msg.insert(msg.end(), clientId.begin(), clientId.end());
-    msg.push_back(CLIENT_VERSION);
-    append_u16_le(msg, CODE_REGISTRATION_REQ);
-    append_u32_le(msg, static_cast<uint32_t>(payload.size()));
-    msg.insert(msg.end(), payload.begin(), payload.end());
+RegistrationV2Req::Frame Protocol::buildRegistrationV2(
+    const std::array<uint8_t,16>& clientId,
+    const std::string& usernameAscii,
+    uint8_t keyType,
+    const std::array<uint8_t,X25519_PUB_LEN>& publicKey)
+{
+    RegistrationV2Req::Frame msg;
+    uint8_t* payload = beginFixed<RegistrationV2Req>(msg, clientId);
+    RegistrationV2Payload::put<RegistrationV2Payload::Name>(payload, usernameAscii);
+    RegistrationV2Payload::put<RegistrationV2Payload::KeyType>(payload, keyType);
+    RegistrationV2Payload::put<RegistrationV2Payload::PublicKey>(payload, publicKey);
     return msg;
 }
 
-std::vector<uint8_t> Protocol::buildClientsListReq(
+ClientsListReq::Frame Protocol::buildClientsListReq(
     const std::array<uint8_t,16>& clientId)
 {
-    std::vector<uint8_t> msg;
-    msg.reserve(16 + 1 + 2 + 4);
-    msg.insert(msg.end(), clientId.begin(), clientId.end());
-    msg.push_back(CLIENT_VERSION);
-    append_u16_le(msg, CODE_CLIENTS_LIST_REQ);
-    append_u32_le(msg, 0); // no payload
+    ClientsListReq::Frame msg;
+    beginFixed<ClientsListReq>(msg, clientId); // no payload
     return msg;
 }
 
-std::vector<uint8_t> Protocol::buildPublicKeyReq(
+PublicKeyReq::Frame Protocol::buildPublicKeyReq(
     const std::array<uint8_t,16>& myClientIdHeader,
     const std::array<uint8_t,16>& targetClientIdPayload)
 {
-    std::vector<uint8_t> msg;
-    msg.reserve(16 + 1 + 2 + 4 + 16);
-    // header
-    msg.insert(msg.end(), myClientIdHeader.begin(), myClientIdHeader.end());
-    msg.push_back(CLIENT_VERSION);
-    append_u16_le(msg, CODE_PUBLIC_KEY_REQ);
-    append_u32_le(msg, 16);
+    PublicKeyReq::Frame msg;
+    uint8_t* payload = beginFixed<PublicKeyReq>(msg, myClientIdHeader);
     // payload = target client id (16 bytes)
-    msg.insert(msg.end(), targetClientIdPayload.begin(), targetClientIdPayload.end());
+    PublicKeyReqPayload::put<PublicKeyReqPayload::TargetId>(payload, targetClientIdPayload);
+    return msg;
+}
+
+PublicKeyV2Req::Frame Protocol::buildPublicKeyV2Req(
+    const std::array<uint8_t,16>& myClientIdHeader,
+    const std::array<uint8_t,16>& targetClientIdPayload)
+{
+    PublicKeyV2Req::Frame msg;
+    uint8_t* payload = beginFixed<PublicKeyV2Req>(msg, myClientIdHeader);
+    PublicKeyReqPayload::put<PublicKeyReqPayload::TargetId>(payload, targetClientIdPayload);
+    return msg;
+}
+
+LookupUserReq::Frame Protocol::buildLookupUserReq(
+    const std::array<uint8_t,16>& myClientIdHeader,
+    const std::string& usernameAscii)
+{
+    LookupUserReq::Frame msg;
+    uint8_t* payload = beginFixed<LookupUserReq>(msg, myClientIdHeader);
+    LookupUserPayload::put<LookupUserPayload::Name>(payload, usernameAscii);
     return msg;
 }
 
 ServerReply Protocol::parseServerReplyHeader(const uint8_t* h) {
     ServerReply r;
-    r.version = h[0];
-    r.code = static_cast<uint16_t>(h[1] | (h[2] << 8));
-    r.payloadSize = static_cast<uint32_t>(h[3] | (h[4] << 8) | (h[5] << 16) | (h[6] << 24));
+    r.version = ReplyHeader::get<ReplyHeader::Version>(h);
+    r.code = ReplyHeader::get<ReplyHeader::Code>(h);
+    r.payloadSize = ReplyHeader::get<ReplyHeader::PayloadSize>(h);
+    return r;
+}
+
+HelloReq::Frame Protocol::buildHelloReq()
+{
+    HelloReq::Frame msg;
+    uint8_t* payload = beginFixed<HelloReq>(msg, Uuid{}); // before any identity
+    HelloPayload::put<HelloPayload::Version>(payload, CLIENT_VERSION_MUX);
+    return msg;
+}
+
+ServerStatsReq::Frame Protocol::buildServerStatsReq(
+    const std::array<uint8_t,16>& myClientIdHeader,
+    uint8_t flags)
+{
+    ServerStatsReq::Frame msg;
+    uint8_t* payload = beginFixed<ServerStatsReq>(msg, myClientIdHeader);
+    ServerStatsPayload::put<ServerStatsPayload::Flags>(payload, flags);
+    return msg;
+}
+
+void Protocol::buildMuxFrame(std::vector<uint8_t>& out, const uint8_t* frame, size_t len,
+                             uint32_t requestId)
+{
+    // same fields, new version, the id between header and payload
+    out.resize(len + MuxRequestHeader::size - RequestHeader::size);
+    uint8_t* p = out.data();
+    std::memcpy(p, frame, RequestHeader::size);
+    MuxRequestHeader::put<MuxRequestHeader::Version>(p, CLIENT_VERSION_MUX);
+    MuxRequestHeader::put<MuxRequestHeader::RequestId>(p, requestId);
+    std::memcpy(p + MuxRequestHeader::size, frame + RequestHeader::size, len - RequestHeader::size);
+}
+
+ServerReply Protocol::parseMuxReplyHeader(const uint8_t* h) {
+    ServerReply r;
+    r.version = MuxReplyHeader::get<MuxReplyHeader::Version>(h);
+    r.code = MuxReplyHeader::get<MuxReplyHeader::Code>(h);
+    r.payloadSize = MuxReplyHeader::get<MuxReplyHeader::PayloadSize>(h);
+    r.requestId = MuxReplyHeader::get<MuxReplyHeader::RequestId>(h);
     return r;
 }
 
@@ -64,85 +145,219 @@ std::vector<uint8_t> Protocol::buildSendMessageReq(
     uint8_t messageType,
     const std::vector<uint8_t>& content)
 {
-    std::vector<uint8_t> payload;
-    payload.reserve(16 + 1 + 4 + content.size());
-    payload.insert(payload.end(), destClientId.begin(), destClientId.end());
-    payload.push_back(messageType);
-    append_u32_le(payload, static_cast<uint32_t>(content.size()));
-    payload.insert(payload.end(), content.begin(), content.end());
-
     std::vector<uint8_t> msg;
-    msg.reserve(16 + 1 + 2 + 4 + payload.size());
-    msg.insert(msg.end(), myClientIdHeader.begin(), myClientIdHeader.end());
-    msg.push_back(CLIENT_VERSION);
-    append_u16_le(msg, CODE_SEND_MESSAGE_REQ);
-    append_u32_le(msg, static_cast<uint32_t>(payload.size()));
-    msg.insert(msg.end(), payload.begin(), payload.end());
+    buildSendMessageReq(msg, myClientIdHeader, destClientId, messageType, content.data(), content.size());
     return msg;
 }
 
-std::vector<uint8_t> Protocol::buildPullWaitingReq(
+void Protocol::buildSendMessageReq(
+    std::vector<uint8_t>& out,
+    const std::array<uint8_t,16>& myClientIdHeader,
+    const std::array<uint8_t,16>& destClientId,
+    uint8_t messageType,
+    const uint8_t* content,
+    size_t contentSize)
+{
+    const size_t payloadSize = SendMessageHead::size + contentSize;
+
+    // header, payload head and content written in place
+    out.resize(RequestHeader::size + payloadSize);
+    uint8_t* p = out.data();
+    writeRequestHeader(p, myClientIdHeader, CODE_SEND_MESSAGE_REQ, static_cast<uint32_t>(payloadSize));
+    p += RequestHeader::size;
+    SendMessageHead::put<SendMessageHead::DestId>(p, destClientId);
+    SendMessageHead::put<SendMessageHead::Type>(p, messageType);
+    SendMessageHead::put<SendMessageHead::ContentSize>(p, static_cast<uint32_t>(contentSize));
+    if (contentSize)
+        std::memcpy(p + SendMessageHead::size, content, contentSize);
+}
+
+void Protocol::beginSendBatch(
+    std::vector<uint8_t>& out,
     const std::array<uint8_t,16>& myClientIdHeader)
 {
-    std::vector<uint8_t> msg;
-    msg.reserve(16 + 1 + 2 + 4);
-    msg.insert(msg.end(), myClientIdHeader.begin(), myClientIdHeader.end());
-    msg.push_back(CLIENT_VERSION);
-    append_u16_le(msg, CODE_PULL_WAITING_REQ);
-    append_u32_le(msg, 0);
+    out.resize(RequestHeader::size + BatchCount::size);
+    writeRequestHeader(out.data(), myClientIdHeader, CODE_SEND_BATCH_REQ, BatchCount::size);
+    BatchCount::put<BatchCount::Count>(out.data() + RequestHeader::size, 0u);
+}
+
+void Protocol::appendSendBatchItem(
+    std::vector<uint8_t>& out,
+    const std::array<uint8_t,16>& destClientId,
+    uint8_t messageType,
+    const uint8_t* content,
+    size_t contentSize)
+{
+    const size_t at = out.size();
+    out.resize(at + SendMessageHead::size + contentSize);
+    uint8_t* p = out.data() + at;
+    SendMessageHead::put<SendMessageHead::DestId>(p, destClientId);
+    SendMessageHead::put<SendMessageHead::Type>(p, messageType);
+    SendMessageHead::put<SendMessageHead::ContentSize>(p, static_cast<uint32_t>(contentSize));
+    if (contentSize)
+        std::memcpy(p + SendMessageHead::size, content, contentSize);
+
+    // patch payload size and item count
+    uint8_t* head = out.data();
+    uint8_t* count = head + RequestHeader::size;
+    RequestHeader::put<RequestHeader::PayloadSize>(head, static_cast<uint32_t>(out.size() - RequestHeader::size));
+    BatchCount::put<BatchCount::Count>(count, BatchCount::get<BatchCount::Count>(count) + 1);
+}
+
+void Protocol::buildPublicKeysReq(
+    std::vector<uint8_t>& out,
+    const std::array<uint8_t,16>& myClientIdHeader,
+    const Uuid* ids,
+    size_t n)
+{
+    const size_t payloadSize = BatchCount::size + n * CLIENT_ID_LEN;
+    out.resize(RequestHeader::size + payloadSize);
+    uint8_t* p = out.data();
+    writeRequestHeader(p, myClientIdHeader, CODE_PUBLIC_KEYS_REQ, static_cast<uint32_t>(payloadSize));
+    p += RequestHeader::size;
+    BatchCount::put<BatchCount::Count>(p, static_cast<uint32_t>(n));
+    p += BatchCount::size;
+    for (size_t i = 0; i < n; ++i, p += CLIENT_ID_LEN)
+        std::memcpy(p, ids[i].data(), CLIENT_ID_LEN);
+}
+
+bool Protocol::buildSealedText(
+    std::vector<uint8_t>& out,
+    const uint8_t* wrapped, size_t wrappedSize,
+    const uint8_t* text, size_t textSize)
+{
+    if (wrappedSize > UINT16_MAX)
+        return false;
+    out.resize(SealedTextHead::size + wrappedSize + textSize);
+    uint8_t* p = out.data();
+    SealedTextHead::put<SealedTextHead::WrappedSize>(p, static_cast<uint16_t>(wrappedSize));
+    std::memcpy(p + SealedTextHead::size, wrapped, wrappedSize);
+    if (textSize)
+        std::memcpy(p + SealedTextHead::size + wrappedSize, text, textSize);
+    return true;
+}
+
+PullWaitingReq::Frame Protocol::buildPullWaitingReq(
+    const std::array<uint8_t,16>& myClientIdHeader)
+{
+    PullWaitingReq::Frame msg;
+    beginFixed<PullWaitingReq>(msg, myClientIdHeader);
     return msg;
 }
 
-// helpers to read little-endian
-static uint32_t rd_u32_le(const uint8_t* p){
-    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+uint16_t Protocol::requestCodeOf(const uint8_t* frame, size_t len) {
+    if (len < RequestHeader::size) return 0;
+    return RequestHeader::get<RequestHeader::Code>(frame);
 }
 
 bool Protocol::isOk(const ServerReply& r, uint16_t expectedCode) {
-    return r.version == SERVER_VERSION_EXPECTED && r.code == expectedCode;
+    return isServerVersion(r.version) && r.code == expectedCode;
 }
 
 std::vector<ClientEntry> Protocol::parseClientsListPayload(const std::vector<uint8_t>& payload) {
     std::vector<ClientEntry> out;
-    if (payload.size() % ENTRY_TOTAL != 0) return out;
-    const size_t n = payload.size() / ENTRY_TOTAL;
-    out.reserve(n);
+    parseClientsList(payload.data(), payload.size(), out);
+    return out;
+}
+
+bool Protocol::parseClientsList(const uint8_t* payload, size_t len, std::vector<ClientEntry>& out) {
+    if (len % ClientEntryLayout::size != 0) { out.clear(); return false; }
+    const size_t n = len / ClientEntryLayout::size;
+    out.resize(n);
+    schema::Reader rd(payload, len);
+    using NameField = ClientEntryLayout::field<ClientEntryLayout::Name>;
     for (size_t i=0;i<n;++i) {
-        const uint8_t* base = payload.data() + i*ENTRY_TOTAL;
-        ClientEntry e;
-        std::copy_n(base, 16, e.id.begin());
-        const char* name = reinterpret_cast<const char*>(base + ENTRY_UUID_LEN);
-        size_t len = 0; while (len < ENTRY_NAME_LEN && name[len] != '\0') ++len;
-        e.name.assign(name, len);
-        out.push_back(std::move(e));
+        const uint8_t* base = rd.take<ClientEntryLayout>();
+        ClientEntry& e = out[i];
+        std::copy_n(ClientEntryLayout::get<ClientEntryLayout::ClientId>(base), ENTRY_UUID_LEN, e.id.begin());
+        const uint8_t* name = base + ClientEntryLayout::offset<ClientEntryLayout::Name>();
+        e.name.assign(reinterpret_cast<const char*>(name), NameField::length(name));
     }
-    return out;
+    return true;
 }
 
 std::vector<WaitingMessage> Protocol::parseWaitingMessagesPayload(const std::vector<uint8_t>& payload) {
     std::vector<WaitingMessage> out;
-    size_t pos = 0;
-    while (pos + 16 + 4 + 1 + 4 <= payload.size()) {
+    std::vector<WaitingMessageView> views;
+    if (!parseWaitingMessages(payload.data(), payload.size(), views)) return out;
+    out.reserve(views.size());
+    for (const auto& v : views) {
         WaitingMessage m{};
-        std::copy_n(payload.data()+pos, 16, m.fromId.begin()); pos += 16;
-        m.msgId = rd_u32_le(payload.data()+pos); pos += 4;
-        m.type  = payload[pos++];
-
-        uint32_t mlen = rd_u32_le(payload.data()+pos); pos += 4;
-        if (pos + mlen > payload.size()) { out.clear(); return out; }
-        m.content.assign(payload.begin()+pos, payload.begin()+pos+mlen);
-        pos += mlen;
+        m.fromId = v.fromId;
+        m.msgId = v.msgId;
+        m.type = v.type;
+        m.content.assign(v.content, v.content + v.contentSize);
         out.push_back(std::move(m));
     }
     return out;
 }
 
+bool Protocol::parseWaitingMessages(const uint8_t* payload, size_t len, std::vector<WaitingMessageView>& out) {
+    out.clear();
+    schema::Reader rd(payload, len);
+    while (rd.remaining() >= WaitingMessageHead::size) {
+        const uint8_t* head = rd.take<WaitingMessageHead>();
+        WaitingMessageView m{};
+        std::copy_n(WaitingMessageHead::get<WaitingMessageHead::FromId>(head), CLIENT_ID_LEN, m.fromId.begin());
+        m.msgId = WaitingMessageHead::get<WaitingMessageHead::MsgId>(head);
+        m.type  = WaitingMessageHead::get<WaitingMessageHead::Type>(head);
+        m.contentSize = WaitingMessageHead::get<WaitingMessageHead::ContentSize>(head);
+        m.content = rd.takeBytes(m.contentSize);
+        if (!m.content) { out.clear(); return false; }
+        out.push_back(m);
+    }
+    return true;
+}
+
+bool Protocol::parseSendBatchAck(const uint8_t* payload, size_t len, std::vector<uint32_t>& msgIds) {
+    msgIds.clear();
+    schema::Reader rd(payload, len);
+    const uint8_t* head = rd.take<BatchCount>();
+    if (!head) return false;
+    const uint32_t n = BatchCount::get<BatchCount::Count>(head);
+    if (rd.remaining() != size_t(n) * SendAckPayload::size) return false;
+    msgIds.resize(n);
+    for (uint32_t i = 0; i < n; ++i)
+        msgIds[i] = SendAckPayload::get<SendAckPayload::MsgId>(rd.take<SendAckPayload>());
+    return true;
+}
+
+bool Protocol::parsePublicKeys(const uint8_t* payload, size_t len, std::vector<PublicKeyView>& out) {
+    out.clear();
+    schema::Reader rd(payload, len);
+    const uint8_t* head = rd.take<BatchCount>();
+    if (!head) return false;
+    const uint32_t n = BatchCount::get<BatchCount::Count>(head);
+    if (n > rd.remaining() / PublicKeysEntryHead::size) return false;
+    out.resize(n);
+    for (auto& v : out) {
+        const uint8_t* e = rd.take<PublicKeysEntryHead>();
+        if (!e) return false;
+        std::copy_n(PublicKeysEntryHead::get<PublicKeysEntryHead::ClientId>(e), CLIENT_ID_LEN, v.id.begin());
+        v.keyType = PublicKeysEntryHead::get<PublicKeysEntryHead::KeyType>(e);
+        v.keyLen = PublicKeysEntryHead::get<PublicKeysEntryHead::KeyLen>(e);
+        v.key = rd.takeBytes(v.keyLen);
+        if (!v.key) return false;
+    }
+    return rd.atEnd();
+}
+
+bool Protocol::parseSealedText(const uint8_t* content, size_t len, SealedTextView& out) {
+    schema::Reader rd(content, len);
+    const uint8_t* head = rd.take<SealedTextHead>();
+    if (!head) return false;
+    out.wrappedSize = SealedTextHead::get<SealedTextHead::WrappedSize>(head);
+    out.wrapped = rd.takeBytes(out.wrappedSize);
+    if (!out.wrapped) return false;
+    out.textSize = rd.remaining();
+    out.text = rd.takeBytes(out.textSize);
+    return true;
+}
+
 bool Protocol::isSendAck(const ServerReply& r) {
     // Ack must come from the expected server version, use the SEND_MESSAGE_OK code,
     // and carry the fixed-length payload required by the spec.
-    return r.version == SERVER_VERSION_EXPECTED
+    return isServerVersion(r.version)
         && r.code    == CODE_SEND_MESSAGE_OK
         && r.payloadSize == SEND_ACK_LEN;
 }
-
-
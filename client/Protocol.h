@@ -4,6 +4,8 @@
 #include <string>
 #include <array>
 
+#include "ProtocolSchema.h"
+
 //
 // ============================================================================
 //  Protocol.h
@@ -23,6 +25,13 @@
 //
 //  This header defines both request and response codes, message formats,
 //  and helper utilities for serializing/deserializing protocol data.
+//
+//  Multiplexing: after a 609 handshake, a connection may use request
+//  version 2, whose header ends with a request id that the server echoes
+//  in a version 3 reply header. Such requests may all be in flight at
+//  once and are answered in any order (a quick send does not wait behind
+//  a large pull). Servers that do not know 609 answer it with an error,
+//  and the connection keeps the one-reply-per-request framing.
 // ============================================================================
 //
 
@@ -31,6 +40,8 @@
 // ---------------------------------------------------------------------------
 constexpr uint8_t CLIENT_VERSION = 1;          // Current client protocol version
 constexpr uint8_t SERVER_VERSION_EXPECTED = 2; // Expected server protocol version
+constexpr uint8_t CLIENT_VERSION_MUX = 2;      // request header carries a request id
+constexpr uint8_t SERVER_VERSION_MUX = 3;      // reply header echoes it
 
 // Registration
 constexpr uint16_t CODE_REGISTRATION_REQ = 600;
@@ -53,6 +64,59 @@ constexpr uint16_t CODE_SEND_MESSAGE_OK = 2103;
 constexpr uint16_t CODE_PULL_WAITING_REQ = 604;
 constexpr uint16_t CODE_PULL_WAITING_OK = 2104;
 
+// Registration with a typed (non-RSA) identity key; replies CODE_REGISTRATION_OK
+constexpr uint16_t CODE_REGISTRATION_V2_REQ = 605;
+
+// Public key of any type: replies CODE_PUBLIC_KEY_OK for an RSA client,
+// CODE_PUBLIC_KEY_V2_OK for an X25519 one
+constexpr uint16_t CODE_PUBLIC_KEY_V2_REQ = 606;
+constexpr uint16_t CODE_PUBLIC_KEY_V2_OK = 2106;
+
+// Batched send: many 603 payloads in one frame, one ack frame back
+constexpr uint16_t CODE_SEND_BATCH_REQ = 607;
+constexpr uint16_t CODE_SEND_BATCH_OK = 2107;
+
+// Lookup by username: UUID and public key in one reply
+constexpr uint16_t CODE_LOOKUP_USER_REQ = 608;
+constexpr uint16_t CODE_LOOKUP_USER_OK = 2108;
+
+// Multiplexing handshake: highest request version in, accepted one out
+constexpr uint16_t CODE_HELLO_REQ = 609;
+constexpr uint16_t CODE_HELLO_OK = 2109;
+
+// Server statistics: flags in, UTF-8 JSON out (per-opcode latency by phase,
+// bytes, errors, time per database method)
+constexpr uint16_t CODE_SERVER_STATS_REQ = 610;
+constexpr uint16_t CODE_SERVER_STATS_OK = 2110;
+constexpr uint8_t SERVER_STATS_RESET = 0x01; // start over after this snapshot
+
+// Public keys of many clients: ids in, one entry per id back (either key type)
+constexpr uint16_t CODE_PUBLIC_KEYS_REQ = 611;
+constexpr uint16_t CODE_PUBLIC_KEYS_OK = 2111;
+
+// ---------------------------------------------------------------------------
+// Identity key types. RSA accounts use the 600/602 text fields; anything
+// else registers with 605 and is fetched with 606.
+// ---------------------------------------------------------------------------
+constexpr uint8_t KEY_TYPE_RSA = 0;    // RSA-1024, Base64 DER
+constexpr uint8_t KEY_TYPE_X25519 = 1; // raw 32-byte Curve25519 key
+
+// ---------------------------------------------------------------------------
+// Message types (SendMessageHead::Type) and client capabilities
+// ---------------------------------------------------------------------------
+constexpr uint8_t MSG_TYPE_KEY_REQUEST = 1; // content: [caps] (empty from old clients)
+constexpr uint8_t MSG_TYPE_KEY = 2;         // RSA(key[16] || caps), old clients: RSA(key[16])
+constexpr uint8_t MSG_TYPE_TEXT_CBC = 3;    // AES-128-CBC, zero IV, PKCS#7
+constexpr uint8_t MSG_TYPE_TEXT_GCM = 4;    // nonce[12] || AES-128-GCM ciphertext || tag[16]
+constexpr uint8_t MSG_TYPE_KEY_X25519 = 5;  // X25519 seal of key[16] || caps, to X25519 recipients
+constexpr uint8_t MSG_TYPE_TEXT_SEALED = 6; // first contact: type 2/5 key and type 4 text in one message
+
+// Capability bits a client announces with its key request / key. A peer
+// that announced nothing is an old client and only gets type 3 text.
+constexpr uint8_t CAP_AES_GCM = 0x01;
+constexpr uint8_t CAP_SEALED_TEXT = 0x02; // opens type 6
+constexpr uint8_t CLIENT_CAPS = CAP_AES_GCM | CAP_SEALED_TEXT;
+
 // ---------------------------------------------------------------------------
 // Data size definitions
 // ---------------------------------------------------------------------------
@@ -65,8 +129,16 @@ constexpr size_t ENTRY_NAME_LEN = 255; // Username field in clients list entries
 constexpr size_t ENTRY_TOTAL = ENTRY_UUID_LEN + ENTRY_NAME_LEN;
 
 constexpr size_t RESP_PUBKEY_LEN = 400; // couldn't make it with 160 because it created bugs
+constexpr size_t X25519_PUB_LEN = 32;   // raw X25519 public key
 constexpr size_t SEND_ACK_LEN = 20;     // ACK payload size for SEND_MESSAGE_OK
 
+// Client-side limits for one 607 frame (the server accepts any size)
+constexpr size_t SEND_BATCH_MAX_ITEMS = 1024;
+constexpr size_t SEND_BATCH_MAX_BYTES = 1u << 20;
+
+// Ids per 611 frame (the server rejects more)
+constexpr size_t PUBLIC_KEYS_MAX_ITEMS = 4096;
+
 // ---------------------------------------------------------------------------
 // Serialization helpers (little-endian encoding)
 // ---------------------------------------------------------------------------
@@ -84,6 +156,172 @@ inline void append_u32_le(std::vector<uint8_t> &v, uint32_t x)
     v.push_back(uint8_t((x >> 24) & 0xFF));
 }
 
+// ---------------------------------------------------------------------------
+// Wire layouts (see ProtocolSchema.h). Every offset used by the builders
+// and parsers in Protocol.cpp comes from these.
+// ---------------------------------------------------------------------------
+
+// Request header: clientId(16) version(1) code(2 LE) payloadSize(4 LE)
+struct RequestHeader : schema::Layout<schema::Bytes<CLIENT_ID_LEN>, schema::U8, schema::U16, schema::U32>
+{
+    enum { ClientId, Version, Code, PayloadSize };
+};
+
+// Reply header: version(1) code(2 LE) payloadSize(4 LE)
+struct ReplyHeader : schema::Layout<schema::U8, schema::U16, schema::U32>
+{
+    enum { Version, Code, PayloadSize };
+};
+
+// Multiplexed request header (version 2): requestId(4 LE) after the usual fields
+struct MuxRequestHeader
+    : schema::Layout<schema::Bytes<CLIENT_ID_LEN>, schema::U8, schema::U16, schema::U32, schema::U32>
+{
+    enum { ClientId, Version, Code, PayloadSize, RequestId };
+};
+
+// Multiplexed reply header (version 3): requestId(4 LE) after the usual fields
+struct MuxReplyHeader : schema::Layout<schema::U8, schema::U16, schema::U32, schema::U32>
+{
+    enum { Version, Code, PayloadSize, RequestId };
+};
+
+// 609 / 2109 payload: version(1)
+struct HelloPayload : schema::Layout<schema::U8>
+{
+    enum { Version };
+};
+
+// 610 payload: flags(1)
+struct ServerStatsPayload : schema::Layout<schema::U8>
+{
+    enum { Flags };
+};
+
+// 600 payload: name(255) publicKey(400), both NUL padded
+struct RegistrationPayload : schema::Layout<schema::PaddedText<REG_NAME_LEN>, schema::PaddedText<REG_PUB_LEN>>
+{
+    enum { Name, PublicKey };
+};
+
+// 605 payload: name(255, NUL padded) keyType(1) publicKey(32)
+struct RegistrationV2Payload : schema::Layout<schema::PaddedText<REG_NAME_LEN>, schema::U8, schema::Bytes<X25519_PUB_LEN>>
+{
+    enum { Name, KeyType, PublicKey };
+};
+
+// 602/606 payload: target clientId(16)
+struct PublicKeyReqPayload : schema::Layout<schema::Bytes<CLIENT_ID_LEN>>
+{
+    enum { TargetId };
+};
+
+// 2102 payload: clientId(16) publicKey(400, NUL padded)
+struct PublicKeyReplyPayload : schema::Layout<schema::Bytes<CLIENT_ID_LEN>, schema::PaddedText<RESP_PUBKEY_LEN>>
+{
+    enum { ClientId, PublicKey };
+};
+
+// 2106 payload: clientId(16) keyType(1) publicKey(32)
+struct PublicKeyV2ReplyPayload : schema::Layout<schema::Bytes<CLIENT_ID_LEN>, schema::U8, schema::Bytes<X25519_PUB_LEN>>
+{
+    enum { ClientId, KeyType, PublicKey };
+};
+
+// 2101 payload entry (repeated): clientId(16) name(255, NUL padded)
+struct ClientEntryLayout : schema::Layout<schema::Bytes<ENTRY_UUID_LEN>, schema::PaddedText<ENTRY_NAME_LEN>>
+{
+    enum { ClientId, Name };
+};
+
+// 603 payload head: destId(16) type(1) contentSize(4 LE), then content
+struct SendMessageHead : schema::Layout<schema::Bytes<CLIENT_ID_LEN>, schema::U8, schema::U32>
+{
+    enum { DestId, Type, ContentSize };
+};
+
+// 2103 payload: destId(16) messageId(4 LE)
+struct SendAckPayload : schema::Layout<schema::Bytes<CLIENT_ID_LEN>, schema::U32>
+{
+    enum { DestId, MsgId };
+};
+
+// 607 payload: count(4 LE), then count x (SendMessageHead + content)
+// 2107 payload: count(4 LE), then count x SendAckPayload, in request order;
+//               msgId 0 = that item was rejected (unknown destination)
+struct BatchCount : schema::Layout<schema::U32>
+{
+    enum { Count };
+};
+
+// 608 payload: name(255, NUL padded)
+struct LookupUserPayload : schema::Layout<schema::PaddedText<REG_NAME_LEN>>
+{
+    enum { Name };
+};
+
+// 2108 payload: clientId(16) keyType(1), then the rest of the payload is
+// the key: 32 raw bytes (X25519) or the Base64 DER text, unpadded (RSA)
+struct LookupUserReplyHead : schema::Layout<schema::Bytes<CLIENT_ID_LEN>, schema::U8>
+{
+    enum { ClientId, KeyType };
+};
+
+// 611 payload: count(4 LE), then count x clientId(16)
+// 2111 payload: count(4 LE), then count x (PublicKeysEntryHead + key), in
+//               request order; the key is as in 2108, keyLen 0 = unknown id
+struct PublicKeysEntryHead : schema::Layout<schema::Bytes<CLIENT_ID_LEN>, schema::U8, schema::U16>
+{
+    enum { ClientId, KeyType, KeyLen };
+};
+
+// 2104 payload entry head (repeated): fromId(16) msgId(4 LE) type(1) contentSize(4 LE), then content
+struct WaitingMessageHead : schema::Layout<schema::Bytes<CLIENT_ID_LEN>, schema::U32, schema::U8, schema::U32>
+{
+    enum { FromId, MsgId, Type, ContentSize };
+};
+
+// Type 6 message content: wrappedSize(2 LE), then the wrapped key exactly
+// as a type 2 (RSA recipient) or 5 (X25519 recipient) message carries it,
+// then the text as a type 4 message under that key
+struct SealedTextHead : schema::Layout<schema::U16>
+{
+    enum { WrappedSize };
+};
+
+// A request whose whole frame has a compile-time size; built on the stack.
+template <uint16_t Code, typename Payload>
+struct FixedRequest
+{
+    static constexpr uint16_t code = Code;
+    static constexpr size_t size = RequestHeader::size + Payload::size;
+    using Frame = std::array<uint8_t, size>;
+};
+
+using RegistrationReq = FixedRequest<CODE_REGISTRATION_REQ, RegistrationPayload>;
+using RegistrationV2Req = FixedRequest<CODE_REGISTRATION_V2_REQ, RegistrationV2Payload>;
+using ClientsListReq = FixedRequest<CODE_CLIENTS_LIST_REQ, schema::None>;
+using PublicKeyReq = FixedRequest<CODE_PUBLIC_KEY_REQ, PublicKeyReqPayload>;
+using PublicKeyV2Req = FixedRequest<CODE_PUBLIC_KEY_V2_REQ, PublicKeyReqPayload>;
+using PullWaitingReq = FixedRequest<CODE_PULL_WAITING_REQ, schema::None>;
+using LookupUserReq = FixedRequest<CODE_LOOKUP_USER_REQ, LookupUserPayload>;
+using HelloReq = FixedRequest<CODE_HELLO_REQ, HelloPayload>;
+using ServerStatsReq = FixedRequest<CODE_SERVER_STATS_REQ, ServerStatsPayload>;
+
+static_assert(RequestHeader::size == 23, "request header is 23 bytes");
+static_assert(RequestHeader::offset<RequestHeader::Code>() == 17, "code follows id + version");
+static_assert(ReplyHeader::size == 7, "reply header is 7 bytes");
+static_assert(MuxRequestHeader::size == 27 && MuxReplyHeader::size == 11, "multiplexed headers");
+static_assert(ClientEntryLayout::size == ENTRY_TOTAL, "clients list entry size");
+static_assert(PublicKeyReplyPayload::size == CLIENT_ID_LEN + RESP_PUBKEY_LEN, "public key reply size");
+static_assert(SendAckPayload::size == SEND_ACK_LEN, "send ack size");
+static_assert(SendMessageHead::size == 21, "send message head size");
+static_assert(WaitingMessageHead::size == 25, "waiting message head size");
+static_assert(ClientsListReq::size == 23 && PullWaitingReq::size == 23, "header-only requests");
+static_assert(PublicKeyReq::size == 39, "public key request size");
+static_assert(RegistrationV2Payload::size == 288, "registration v2 payload size");
+static_assert(PublicKeyV2ReplyPayload::size == 49, "public key v2 reply size");
+
 // ---------------------------------------------------------------------------
 // Basic protocol data structures
 // ---------------------------------------------------------------------------
@@ -94,6 +332,7 @@ struct ServerReply
     uint8_t version{};            // Server protocol version
     uint16_t code{};              // Reply code (e.g., 2100 for OK)
     uint32_t payloadSize{};       // Payload length in bytes
+    uint32_t requestId{};         // Multiplexed replies only
     std::vector<uint8_t> payload; // Raw payload data (optional)
 };
 
@@ -107,6 +346,35 @@ struct ClientEntry
     std::string name; // ASCII username (padded with NULs)
 };
 
+// Non-owning view of a pending message; 'content' points into the payload
+// buffer it was parsed from and is valid as long as that buffer is.
+struct WaitingMessageView
+{
+    Uuid fromId;
+    uint32_t msgId;
+    uint8_t type;
+    const uint8_t *content;
+    uint32_t contentSize;
+};
+
+// Non-owning view of one 2111 entry; 'key' points into the payload.
+struct PublicKeyView
+{
+    Uuid id;
+    uint8_t keyType;
+    const uint8_t *key;
+    uint16_t keyLen; // 0: no such client
+};
+
+// Non-owning view of the parts of a type 6 message.
+struct SealedTextView
+{
+    const uint8_t *wrapped;
+    size_t wrappedSize;
+    const uint8_t *text; // nonce || ciphertext || tag
+    size_t textSize;
+};
+
 // Represents a single pending message from another client
 struct WaitingMessage
 {
@@ -123,24 +391,70 @@ class Protocol
 {
 public:
     // Builds a registration request message.
-    static std::vector<uint8_t> buildRegistration(
+    static RegistrationReq::Frame buildRegistration(
         const std::array<uint8_t, 16> &clientId,
         const std::string &usernameAscii,
         const std::string &publicKeyAscii);
 
+    // Builds a 605 registration for a typed raw public key (X25519).
+    static RegistrationV2Req::Frame buildRegistrationV2(
+        const std::array<uint8_t, 16> &clientId,
+        const std::string &usernameAscii,
+        uint8_t keyType,
+        const std::array<uint8_t, X25519_PUB_LEN> &publicKey);
+
     // Builds a request for the full clients list.
-    static std::vector<uint8_t> buildClientsListReq(
+    static ClientsListReq::Frame buildClientsListReq(
         const std::array<uint8_t, 16> &clientId);
 
     // Builds a request for another client’s public key.
     // Payload contains target clientId (16 bytes).
-    static std::vector<uint8_t> buildPublicKeyReq(
+    static PublicKeyReq::Frame buildPublicKeyReq(
+        const std::array<uint8_t, 16> &myClientIdHeader,
+        const std::array<uint8_t, 16> &targetClientIdPayload);
+
+    // Same as buildPublicKeyReq, as a 606 (answered for any key type).
+    static PublicKeyV2Req::Frame buildPublicKeyV2Req(
         const std::array<uint8_t, 16> &myClientIdHeader,
         const std::array<uint8_t, 16> &targetClientIdPayload);
 
+    // Builds a lookup of a user's UUID and public key by name (608).
+    static LookupUserReq::Frame buildLookupUserReq(
+        const std::array<uint8_t, 16> &myClientIdHeader,
+        const std::string &usernameAscii);
+
+    // Builds a bulk public-key request (611) for 'n' ids into 'out'
+    // (capacity reused); n <= PUBLIC_KEYS_MAX_ITEMS.
+    static void buildPublicKeysReq(
+        std::vector<uint8_t> &out,
+        const std::array<uint8_t, 16> &myClientIdHeader,
+        const Uuid *ids,
+        size_t n);
+
+    // Parses a 2111 payload into 'out' (one view per requested id).
+    // Returns false on a malformed payload.
+    static bool parsePublicKeys(const uint8_t *payload, size_t len,
+                                std::vector<PublicKeyView> &out);
+
     // Parses the 7-byte reply header from the server.
     static ServerReply parseServerReplyHeader(const uint8_t *header7);
 
+    // Builds the multiplexing handshake (609), offering CLIENT_VERSION_MUX.
+    static HelloReq::Frame buildHelloReq();
+
+    // Builds a server statistics request (610); 'flags': SERVER_STATS_*.
+    static ServerStatsReq::Frame buildServerStatsReq(
+        const std::array<uint8_t, 16> &myClientIdHeader,
+        uint8_t flags);
+
+    // Rewrites a built request 'frame' as a multiplexed one tagged
+    // 'requestId', into 'out' (capacity reused).
+    static void buildMuxFrame(std::vector<uint8_t> &out, const uint8_t *frame, size_t len,
+                              uint32_t requestId);
+
+    // Parses the 11-byte multiplexed reply header, request id included.
+    static ServerReply parseMuxReplyHeader(const uint8_t *header11);
+
     // Builds a message-sending request (text, symmetric key, etc.).
     static std::vector<uint8_t> buildSendMessageReq(
         const std::array<uint8_t, 16> &myClientIdHeader,
@@ -148,10 +462,49 @@ public:
         uint8_t messageType,
         const std::vector<uint8_t> &content);
 
+    // Same, written into 'out' (resized; its capacity is reused).
+    static void buildSendMessageReq(
+        std::vector<uint8_t> &out,
+        const std::array<uint8_t, 16> &myClientIdHeader,
+        const std::array<uint8_t, 16> &destClientId,
+        uint8_t messageType,
+        const uint8_t *content,
+        size_t contentSize);
+
+    // Batched send (607), built incrementally into 'out' (capacity reused):
+    // beginSendBatch writes the header and a zero count, each
+    // appendSendBatchItem adds one message and updates size and count.
+    static void beginSendBatch(
+        std::vector<uint8_t> &out,
+        const std::array<uint8_t, 16> &myClientIdHeader);
+    static void appendSendBatchItem(
+        std::vector<uint8_t> &out,
+        const std::array<uint8_t, 16> &destClientId,
+        uint8_t messageType,
+        const uint8_t *content,
+        size_t contentSize);
+
+    // Parses a 2107 payload into per-item message ids (0 = rejected).
+    // Returns false on a malformed payload.
+    static bool parseSendBatchAck(const uint8_t *payload, size_t len,
+                                  std::vector<uint32_t> &msgIds);
+
+    // Type 6 content from a wrapped key and a GCM-sealed text, into 'out'
+    // (resized; capacity reused). False if the wrapped key is too long.
+    static bool buildSealedText(std::vector<uint8_t> &out,
+                                const uint8_t *wrapped, size_t wrappedSize,
+                                const uint8_t *text, size_t textSize);
+
+    // Splits type 6 content; false if malformed.
+    static bool parseSealedText(const uint8_t *content, size_t len, SealedTextView &out);
+
     // Builds a request to pull waiting messages from the server.
-    static std::vector<uint8_t> buildPullWaitingReq(
+    static PullWaitingReq::Frame buildPullWaitingReq(
         const std::array<uint8_t, 16> &myClientIdHeader);
 
+    // Reads the request code back out of a built frame (0 if too short).
+    static uint16_t requestCodeOf(const uint8_t *frame, size_t len);
+
     // Parses a clients-list payload into structured entries.
     static std::vector<ClientEntry> parseClientsListPayload(
         const std::vector<uint8_t> &payload);
@@ -160,6 +513,13 @@ public:
     static std::vector<WaitingMessage> parseWaitingMessagesPayload(
         const std::vector<uint8_t> &payload);
 
+    // Allocation-free variants: fill 'out' in place (existing elements and
+    // their strings are reused). Return false on a malformed payload.
+    static bool parseClientsList(const uint8_t *payload, size_t len,
+                                 std::vector<ClientEntry> &out);
+    static bool parseWaitingMessages(const uint8_t *payload, size_t len,
+                                     std::vector<WaitingMessageView> &out);
+
     // Checks if a reply has the expected success code.
     static bool isOk(const ServerReply &r, uint16_t expectedCode);
 
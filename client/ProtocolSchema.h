@@ -0,0 +1,193 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <tuple>
+
+//
+// ============================================================================
+//  ProtocolSchema.h
+//  --------------------------------------------------------------------------
+//  Compile-time description of the binary wire layouts.
+//
+//  A Layout<Fields...> lists the fields of a header or payload in wire
+//  order. Offsets and total size are computed at compile time, so builders
+//  and parsers never repeat offset arithmetic by hand:
+//
+//      struct ReplyHeader : schema::Layout<schema::U8, schema::U16, schema::U32>
+//      { enum { Version, Code, PayloadSize }; };
+//
+//      ReplyHeader::put<ReplyHeader::Code>(buf, code);
+//      uint32_t n = ReplyHeader::get<ReplyHeader::PayloadSize>(buf);
+//
+//  The concrete layouts of this protocol live in Protocol.h.
+// ============================================================================
+//
+
+namespace schema
+{
+
+// ---------------------------------------------------------------------------
+// Field types. Each has a fixed wire 'size' and static write()/read().
+// Integers are little-endian.
+// ---------------------------------------------------------------------------
+struct U8
+{
+    static constexpr size_t size = 1;
+    static void write(uint8_t *p, uint8_t v) { p[0] = v; }
+    static uint8_t read(const uint8_t *p) { return p[0]; }
+};
+
+struct U16
+{
+    static constexpr size_t size = 2;
+    static void write(uint8_t *p, uint16_t v)
+    {
+        p[0] = uint8_t(v & 0xFF);
+        p[1] = uint8_t((v >> 8) & 0xFF);
+    }
+    static uint16_t read(const uint8_t *p) { return static_cast<uint16_t>(p[0] | (p[1] << 8)); }
+};
+
+struct U32
+{
+    static constexpr size_t size = 4;
+    static void write(uint8_t *p, uint32_t v)
+    {
+        p[0] = uint8_t(v & 0xFF);
+        p[1] = uint8_t((v >> 8) & 0xFF);
+        p[2] = uint8_t((v >> 16) & 0xFF);
+        p[3] = uint8_t((v >> 24) & 0xFF);
+    }
+    static uint32_t read(const uint8_t *p)
+    {
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+};
+
+struct U64
+{
+    static constexpr size_t size = 8;
+    static void write(uint8_t *p, uint64_t v)
+    {
+        U32::write(p, uint32_t(v));
+        U32::write(p + 4, uint32_t(v >> 32));
+    }
+    static uint64_t read(const uint8_t *p) { return U32::read(p) | (uint64_t(U32::read(p + 4)) << 32); }
+};
+
+// Raw fixed-length bytes (UUIDs). read() returns a pointer into the buffer.
+template <size_t N>
+struct Bytes
+{
+    static constexpr size_t size = N;
+    static void write(uint8_t *p, const std::array<uint8_t, N> &v) { std::memcpy(p, v.data(), N); }
+    static const uint8_t *read(const uint8_t *p) { return p; }
+};
+
+// ASCII text NUL-padded to N bytes; longer input is truncated.
+// read() stops at the first NUL.
+template <size_t N>
+struct PaddedText
+{
+    static constexpr size_t size = N;
+    static void write(uint8_t *p, const std::string &s)
+    {
+        const size_t n = std::min(s.size(), N);
+        std::memcpy(p, s.data(), n);
+        std::memset(p + n, 0, N - n);
+    }
+    static size_t length(const uint8_t *p)
+    {
+        const void *nul = std::memchr(p, 0, N);
+        return nul ? static_cast<size_t>(static_cast<const uint8_t *>(nul) - p) : N;
+    }
+    static std::string read(const uint8_t *p)
+    {
+        return std::string(reinterpret_cast<const char *>(p), length(p));
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Layout: an ordered list of fields with compile-time offsets.
+// ---------------------------------------------------------------------------
+template <typename... Fields>
+struct Layout
+{
+    static constexpr size_t count = sizeof...(Fields);
+    static constexpr size_t size = (size_t(0) + ... + Fields::size);
+
+    template <size_t I>
+    using field = std::tuple_element_t<I, std::tuple<Fields...>>;
+
+    template <size_t I>
+    static constexpr size_t offset()
+    {
+        static_assert(I < count, "field index out of range");
+        constexpr size_t sizes[] = {Fields::size...};
+        size_t o = 0;
+        for (size_t i = 0; i < I; ++i)
+            o += sizes[i];
+        return o;
+    }
+
+    template <size_t I, typename V>
+    static void put(uint8_t *base, const V &v)
+    {
+        field<I>::write(base + offset<I>(), v);
+    }
+
+    template <size_t I>
+    static auto get(const uint8_t *base)
+    {
+        return field<I>::read(base + offset<I>());
+    }
+};
+
+// Empty payload.
+struct None
+{
+    static constexpr size_t count = 0;
+    static constexpr size_t size = 0;
+};
+
+// ---------------------------------------------------------------------------
+// Bounds-checked cursor over a received payload. take<L>() returns a
+// pointer to the next L::size bytes, or nullptr (and sets failed) if the
+// payload is too short.
+// ---------------------------------------------------------------------------
+class Reader
+{
+public:
+    Reader(const uint8_t *data, size_t size) : data(data), len(size) {}
+
+    template <typename L>
+    const uint8_t *take() { return takeBytes(L::size); }
+
+    const uint8_t *takeBytes(size_t n)
+    {
+        if (failed || n > len - pos)
+        {
+            failed = true;
+            return nullptr;
+        }
+        const uint8_t *p = data + pos;
+        pos += n;
+        return p;
+    }
+
+    size_t remaining() const { return len - pos; }
+    bool atEnd() const { return pos == len; }
+    bool ok() const { return !failed; }
+
+private:
+    const uint8_t *data;
+    size_t len;
+    size_t pos = 0;
+    bool failed = false;
+};
+
+} // namespace schema
@@ -0,0 +1,70 @@
+#include "ServerCluster.h"
+
+ServerCluster::ServerCluster(const std::vector<Endpoint> &endpoints) : nodes(endpoints.size())
+{
+    for (size_t i = 0; i < endpoints.size(); ++i)
+    {
+        nodes[i].endpoint = endpoints[i];
+        nodes[i].label = endpoints[i].label();
+        ring.addNode(i, "node" + std::to_string(i)); // the line, not the address: see ServerCluster.h
+    }
+}
+
+ServerConnection *ServerCluster::connection(size_t node)
+{
+    ServerConnection *conn;
+    bool capturing;
+    {
+        std::lock_guard<std::mutex> lock(linksMutex);
+        auto [it, created] = links.try_emplace(std::this_thread::get_id());
+        Links &mine = it->second;
+        if (created)
+        {
+            mine.thread = links.size() - 1;
+            mine.conns.resize(nodes.size());
+        }
+        if (!mine.conns[node])
+        {
+            mine.conns[node] = std::make_unique<ServerConnection>(nodes[node].endpoint);
+            if (!capturePath.empty())
+                mine.conns[node]->enableCapture(capturePathFor(node, mine.thread));
+        }
+        conn = mine.conns[node].get();
+        capturing = !capturePath.empty();
+    }
+
+    // only this thread uses 'conn': (re)connect without holding the lock.
+    // Captures stay in the plain framing that replay understands.
+    if (!conn->isConnected())
+    {
+        if (!conn->connectToServer())
+            return nullptr;
+        if (!capturing && !conn->negotiateMultiplexing() && !conn->isConnected())
+            return nullptr;
+    }
+    return conn;
+}
+
+bool ServerCluster::enableCapture(const std::string &tracePath)
+{
+    std::lock_guard<std::mutex> lock(linksMutex);
+    capturePath = tracePath;
+    bool ok = true;
+    for (auto &[id, mine] : links)
+    {
+        for (size_t i = 0; i < mine.conns.size(); ++i)
+        {
+            if (mine.conns[i] && !mine.conns[i]->enableCapture(capturePathFor(i, mine.thread)))
+                ok = false;
+        }
+    }
+    return ok;
+}
+
+std::string ServerCluster::capturePathFor(size_t node, size_t thread) const
+{
+    std::string path = node == 0 ? capturePath : capturePath + "." + std::to_string(node);
+    if (thread)
+        path += ".t" + std::to_string(thread);
+    return path;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "HashRing.h"
+#include "Protocol.h"
+#include "ServerConnection.h"
+
+//
+// ============================================================================
+//  ServerCluster.h
+//  --------------------------------------------------------------------------
+//  The set of server nodes listed in server.info, one endpoint per line
+//  ("IP:PORT", "unix:/path" or "mem:name", see Transport.h).
+//
+//  Every client is registered on every node it talks to (see
+//  ClientSession::ensureJoined), but its inbox lives only on its home node,
+//  ownerOf(clientId). Requests addressed to a recipient (send, public key)
+//  go to the recipient's home node; the clients list and first
+//  registration go to the seed node (the first line), which sees every
+//  registration.
+//
+//  A node's place on the ring comes from its position in server.info,
+//  not its address: one client may reach a node as 127.0.0.1:1357 and
+//  another as 10.0.0.5:1357 or unix:/run/mu.sock, and both must agree on
+//  ownerOf. So every client lists the nodes in the same order, and a new
+//  node is added as the last line.
+//
+//  With a single line this is exactly the old one-server setup.
+//  Connections are opened on first use, one set per thread: a stream is
+//  never shared, so threads need no locking around a request and each
+//  gets the server's full per-connection throughput.
+// ============================================================================
+//
+
+class ServerCluster
+{
+public:
+    static constexpr size_t SEED = 0;
+
+    explicit ServerCluster(const std::vector<Endpoint> &endpoints);
+
+    size_t size() const { return nodes.size(); }
+    const std::string &label(size_t node) const { return nodes[node].label; }
+
+    // Home node of a client UUID.
+    size_t ownerOf(const Uuid &id) const { return ring.ownerOf(id); }
+
+    // The calling thread's link to 'node', connecting (and negotiating
+    // multiplexed framing, unless capturing) on first use; nullptr if the
+    // node is unreachable (retried on the next call). The pointer stays
+    // valid for the cluster's lifetime.
+    ServerConnection *connection(size_t node);
+
+    // Records all traffic: node 0 to 'tracePath', node i to "tracePath.i";
+    // threads after the first add ".t<k>". Applies to connections opened
+    // later as well. Call before other threads use the cluster.
+    bool enableCapture(const std::string &tracePath);
+
+    // Whether this session already registered on 'node' (see ensureJoined).
+    bool isJoined(size_t node) const { return nodes[node].joined.load(std::memory_order_acquire); }
+    void setJoined(size_t node, bool joined) { nodes[node].joined.store(joined, std::memory_order_release); }
+
+private:
+    struct Node
+    {
+        Endpoint endpoint;
+        std::string label;
+        std::atomic<bool> joined{false};
+    };
+
+    // one thread's connections, by node
+    struct Links
+    {
+        size_t thread = 0; // 0 for the first thread, for capture file names
+        std::vector<std::unique_ptr<ServerConnection>> conns;
+    };
+
+    std::string capturePathFor(size_t node, size_t thread) const;
+
+    std::vector<Node> nodes;
+    HashRing ring;
+
+    std::mutex linksMutex; // guards 'links' (not the connections in it)
+    std::map<std::thread::id, Links> links;
+    std::string capturePath;
+};
@@ -2,135 +2,93 @@
 #include <iostream>
 #include <cstdint>
 
-bool ServerConnection::initWSA()
-{
-    WSADATA wsaData;
-    int r = WSAStartup(MAKEWORD(2, 2), &wsaData);
-    if (r != 0)
-    {
-        std::cerr << "WSAStartup failed: " << r << "\n";
-        return false;
-    }
-    return true;
-}
-
-void ServerConnection::cleanupWSA()
-{
-    if (wsaInitialized)
-    {
-        WSACleanup();
-        wsaInitialized = false;
-    }
-}
+#include "Protocol.h"
 
-void ServerConnection::closeSocket()
+ServerConnection::ServerConnection(Endpoint endpoint)
+    : ep(std::move(endpoint))
 {
-    if (sock != INVALID_SOCKET)
-    {
-        closesocket(sock);
-        sock = INVALID_SOCKET;
-    }
-    connected = false;
 }
 
 ServerConnection::ServerConnection(const std::string &ip, unsigned short port)
-    : ip(ip), port(port)
+    : ep(Endpoint::tcp(ip, port))
 {
-    wsaInitialized = initWSA();
 }
 
-ServerConnection::~ServerConnection()
+bool ServerConnection::connectToServer()
 {
-    closeSocket();
-    cleanupWSA();
+    transport = Transport::connect(ep);
+    mux = false;
+    return transport != nullptr;
 }
 
-bool ServerConnection::connectToServer()
+bool ServerConnection::negotiateMultiplexing()
 {
-    if (!wsaInitialized)
-        return false;
-
-    sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-    if (sock == INVALID_SOCKET)
-    {
-        std::cerr << "socket() failed: " << WSAGetLastError() << "\n";
-        return false;
-    }
-
-    sockaddr_in addr{};
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(port);
-
-    if (inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) != 1)
-    {
-        std::cerr << "inet_pton failed for IP: " << ip << "\n";
-        closeSocket();
+    const auto req = Protocol::buildHelloReq();
+    uint8_t h[ReplyHeader::size];
+    if (!sendAll(req.data(), static_cast<int>(req.size())) || !recvExact(h, sizeof(h)))
         return false;
-    }
-
-    if (connect(sock, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == SOCKET_ERROR)
+    const ServerReply reply = Protocol::parseServerReplyHeader(h);
+    uint8_t payload[HelloPayload::size + 64];
+    if (reply.payloadSize > sizeof(payload) || !recvExact(payload, static_cast<int>(reply.payloadSize)))
     {
-        std::cerr << "connect() failed: " << WSAGetLastError() << "\n";
-        closeSocket();
+        transport.reset(); // lost track of the stream
         return false;
     }
-
-    connected = true;
-    return true;
+    mux = Protocol::isOk(reply, CODE_HELLO_OK) && reply.payloadSize == HelloPayload::size &&
+          HelloPayload::get<HelloPayload::Version>(payload) == CLIENT_VERSION_MUX;
+    return mux;
 }
 
 bool ServerConnection::sendLine(const std::string &line)
 {
-    if (!connected || sock == INVALID_SOCKET)
-        return false;
-
     std::string payload = line;
     payload += "\n";
+    return sendAll(reinterpret_cast<const uint8_t *>(payload.data()), static_cast<int>(payload.size()));
+}
 
-    const char *buf = payload.c_str();
-    int toSend = static_cast<int>(payload.size());
-    int totalSent = 0;
-
-    while (totalSent < toSend)
+bool ServerConnection::sendAll(const uint8_t *data, int len)
+{
+    if (!transport)
+        return false;
+    if (!transport->sendAll(data, static_cast<size_t>(len)))
     {
-        int sent = send(sock, buf + totalSent, toSend - totalSent, 0);
-        if (sent == SOCKET_ERROR)
-        {
-            std::cerr << "send() failed: " << WSAGetLastError() << "\n";
-            closeSocket();
-            return false;
-        }
-        totalSent += sent;
+        transport.reset(); // ServerCluster reconnects on next use
+        return false;
     }
+    if (capture)
+        capture->write(TRACE_DIR_REQUEST, data, static_cast<size_t>(len));
     return true;
 }
 
-bool ServerConnection::sendAll(const uint8_t *data, int len)
+bool ServerConnection::recvExact(uint8_t *dst, int len)
 {
-    if (!connected || sock == INVALID_SOCKET)
+    if (!transport)
         return false;
-    int sent = 0;
-    while (sent < len)
+    if (!transport->recvExact(dst, static_cast<size_t>(len)))
     {
-        int n = ::send(sock, reinterpret_cast<const char *>(data) + sent, len - sent, 0);
-        if (n <= 0)
-            return false;
-        sent += n;
+        transport.reset();
+        return false;
     }
+    if (capture)
+        capture->write(TRACE_DIR_REPLY, dst, static_cast<size_t>(len));
     return true;
 }
 
-bool ServerConnection::recvExact(uint8_t *dst, int len)
+bool ServerConnection::enableCapture(const std::string &tracePath)
 {
-    if (!connected || sock == INVALID_SOCKET)
-        return false;
-    int got = 0;
-    while (got < len)
+    auto writer = std::make_unique<WireTraceWriter>();
+    if (!writer->open(tracePath))
     {
-        int n = ::recv(sock, reinterpret_cast<char *>(dst) + got, len - got, 0);
-        if (n <= 0)
-            return false;
-        got += n;
+        std::cerr << "cannot open capture file: " << tracePath << "\n";
+        return false;
     }
+    capture = std::move(writer);
     return true;
 }
+
+void ServerConnection::disableCapture()
+{
+    if (capture)
+        capture->close();
+    capture.reset();
+}
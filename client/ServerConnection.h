@@ -2,24 +2,28 @@
 #include <string>
 #include <vector>   // for std::vector<uint8_t>
 #include <cstdint>  // for uint8_t
+#include <memory>
 
-// Include winsock headers (order matters on Windows)
-#include <winsock2.h>
-#include <ws2tcpip.h>
-
-#ifdef _MSC_VER
-#pragma comment(lib, "Ws2_32.lib")
-#endif
+#include "Transport.h"
+#include "WireTrace.h"
 
 class ServerConnection {
 public:
-    ServerConnection(const std::string& ip, unsigned short port);
-    ~ServerConnection();
+    explicit ServerConnection(Endpoint endpoint);
+    ServerConnection(const std::string& ip, unsigned short port); // TCP
 
     bool connectToServer();
     bool sendLine(const std::string& line);
-    bool isConnected() const { return connected; }
-    SOCKET getSocket() const { return sock; }
+    bool isConnected() const { return transport != nullptr; }
+    void disconnect() { transport.reset(); }
+
+    // Multiplexing handshake (609, see Protocol.h), right after connecting.
+    // True if the server takes tagged requests from now on; false if it
+    // does not (the connection stays usable, one reply per request) or
+    // the connection failed.
+    bool negotiateMultiplexing();
+    bool multiplexed() const { return mux; }
+    const Endpoint& endpoint() const { return ep; }
 
     // EXACT signatures used in main.cpp and implemented in .cpp
     bool sendAll(const uint8_t* data, int len);
@@ -28,14 +32,15 @@ public:
     }
     bool recvExact(uint8_t* dst, int len);
 
-private:
-    std::string ip;
-    unsigned short port;
-    SOCKET sock = INVALID_SOCKET;
-    bool wsaInitialized = false;
-    bool connected = false;
+    // Capture mode: every frame sent and every reply chunk received is
+    // appended to a WireTrace file (see WireTrace.h). Returns false if the
+    // file can't be created.
+    bool enableCapture(const std::string& tracePath);
+    void disableCapture();
 
-    bool initWSA();
-    void cleanupWSA();
-    void closeSocket();
+private:
+    Endpoint ep;
+    std::unique_ptr<Transport> transport; // null while disconnected
+    std::unique_ptr<WireTraceWriter> capture;
+    bool mux = false;
 };
@@ -0,0 +1,48 @@
+#pragma once
+
+//
+// ============================================================================
+//  SocketApi.h
+//  --------------------------------------------------------------------------
+//  The socket calls the client makes, under their winsock names: winsock
+//  on Windows, BSD sockets elsewhere with the few winsock names the code
+//  uses mapped onto them. Only for .cpp files that talk to sockets.
+// ============================================================================
+//
+
+#ifdef _WIN32
+
+// Include winsock headers (order matters on Windows)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <afunix.h>
+
+#ifdef _MSC_VER
+#pragma comment(lib, "Ws2_32.lib")
+#endif
+
+#else
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using SOCKET = int;
+constexpr SOCKET INVALID_SOCKET = -1;
+constexpr int SOCKET_ERROR = -1;
+constexpr int SD_BOTH = SHUT_RDWR;
+
+struct WSADATA
+{
+};
+constexpr unsigned short MAKEWORD(unsigned char lo, unsigned char hi) { return static_cast<unsigned short>(lo | hi << 8); }
+inline int WSAStartup(unsigned short, WSADATA *) { return 0; }
+inline int WSACleanup() { return 0; }
+inline int WSAGetLastError() { return errno; }
+inline int closesocket(SOCKET s) { return ::close(s); }
+
+#endif
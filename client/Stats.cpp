@@ -0,0 +1,263 @@
+#include "Stats.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <thread>
+
+const char *phaseName(Phase p)
+{
+    switch (p)
+    {
+    case Phase::Serialize:   return "serialize";
+    case Phase::Send:        return "send";
+    case Phase::WaitHeader:  return "wait-header";
+    case Phase::RecvPayload: return "recv-payload";
+    case Phase::Crypto:      return "crypto";
+    case Phase::Total:       return "total";
+    default:                 return "?";
+    }
+}
+
+// ------------------------- LatencyHistogram -------------------------
+
+static unsigned highestBit(uint64_t v)
+{
+#if defined(__GNUC__)
+    return 63u - static_cast<unsigned>(__builtin_clzll(v));
+#else
+    unsigned r = 0;
+    while (v >>= 1)
+        ++r;
+    return r;
+#endif
+}
+
+unsigned LatencyHistogram::bucketOf(uint64_t ns)
+{
+    if (ns < SUB_BUCKETS)
+        return static_cast<unsigned>(ns); // exact for tiny values
+    const unsigned shift = highestBit(ns) - SUB_BITS;
+    if (shift > MAX_SHIFT)
+        return BUCKETS - 1;
+    const unsigned sub = static_cast<unsigned>(ns >> shift) - SUB_BUCKETS;
+    return SUB_BUCKETS * (shift + 1) + sub;
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(unsigned idx)
+{
+    if (idx < SUB_BUCKETS)
+        return idx;
+    const unsigned shift = idx / SUB_BUCKETS - 1;
+    const uint64_t sub = idx % SUB_BUCKETS;
+    return ((sub + SUB_BUCKETS + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t ns)
+{
+    buckets[bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    sumNs.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t prev = maxNs.load(std::memory_order_relaxed);
+    while (ns > prev && !maxNs.compare_exchange_weak(prev, ns, std::memory_order_relaxed))
+    {
+    }
+}
+
+void LatencyHistogram::reset()
+{
+    for (auto &b : buckets)
+        b.store(0, std::memory_order_relaxed);
+    total.store(0, std::memory_order_relaxed);
+    sumNs.store(0, std::memory_order_relaxed);
+    maxNs.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::percentile(double p) const
+{
+    const uint64_t n = count();
+    if (n == 0)
+        return 0;
+    uint64_t rank = static_cast<uint64_t>(p / 100.0 * double(n) + 0.5);
+    if (rank == 0)
+        rank = 1;
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < BUCKETS; ++i)
+    {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank)
+            return std::min(bucketUpperBound(i), max());
+    }
+    return max();
+}
+
+// ------------------------- ClientStats -------------------------
+
+struct ClientStats::Dumper
+{
+    std::string path;
+    unsigned intervalSec = 0;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool stop = false;
+    std::thread worker;
+};
+
+ClientStats &ClientStats::instance()
+{
+    static ClientStats stats;
+    return stats;
+}
+
+ClientStats::~ClientStats()
+{
+    stopPeriodicDump();
+}
+
+unsigned ClientStats::slotOf(uint16_t code)
+{
+    if (code < CODE_BASE || code >= CODE_BASE + MAX_CODES)
+        return MAX_CODES - 1;
+    return code - CODE_BASE;
+}
+
+void ClientStats::record(uint16_t requestCode, Phase phase, uint64_t ns)
+{
+    codes[slotOf(requestCode)].phases[static_cast<size_t>(phase)].record(ns);
+}
+
+void ClientStats::addBytesOut(uint16_t requestCode, uint64_t n)
+{
+    codes[slotOf(requestCode)].bytesOut.fetch_add(n, std::memory_order_relaxed);
+}
+
+void ClientStats::addBytesIn(uint16_t requestCode, uint64_t n)
+{
+    codes[slotOf(requestCode)].bytesIn.fetch_add(n, std::memory_order_relaxed);
+}
+
+void ClientStats::countTransportError(uint16_t requestCode)
+{
+    codes[slotOf(requestCode)].transportErrors.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ClientStats::countServerError(uint16_t requestCode)
+{
+    codes[slotOf(requestCode)].serverErrors.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ClientStats::print(std::ostream &out) const
+{
+    auto us = [](uint64_t ns) { return double(ns) / 1000.0; };
+
+    out << std::left << std::setw(6) << "code" << std::setw(14) << "phase"
+        << std::right << std::setw(9) << "count" << std::setw(11) << "p50(us)"
+        << std::setw(11) << "p90(us)" << std::setw(11) << "p99(us)"
+        << std::setw(11) << "max(us)" << std::setw(11) << "mean(us)" << "\n";
+
+    bool any = false;
+    for (unsigned slot = 0; slot < MAX_CODES; ++slot)
+    {
+        const PerCode &pc = codes[slot];
+        const uint64_t out_ = pc.bytesOut.load(std::memory_order_relaxed);
+        const uint64_t in_ = pc.bytesIn.load(std::memory_order_relaxed);
+        const uint64_t terr = pc.transportErrors.load(std::memory_order_relaxed);
+        const uint64_t serr = pc.serverErrors.load(std::memory_order_relaxed);
+
+        bool hasData = out_ || in_ || terr || serr;
+        for (const auto &h : pc.phases)
+            hasData = hasData || h.count();
+        if (!hasData)
+            continue;
+        any = true;
+
+        const std::string label = (slot == MAX_CODES - 1) ? "other" : std::to_string(CODE_BASE + slot);
+        out << std::fixed << std::setprecision(1);
+        for (size_t p = 0; p < pc.phases.size(); ++p)
+        {
+            const LatencyHistogram &h = pc.phases[p];
+            if (!h.count())
+                continue;
+            out << std::left << std::setw(6) << label << std::setw(14) << phaseName(static_cast<Phase>(p))
+                << std::right << std::setw(9) << h.count()
+                << std::setw(11) << us(h.percentile(50)) << std::setw(11) << us(h.percentile(90))
+                << std::setw(11) << us(h.percentile(99)) << std::setw(11) << us(h.max())
+                << std::setw(11) << us(h.sum() / h.count()) << "\n";
+        }
+        out << std::left << std::setw(6) << label << "bytes out=" << out_ << " in=" << in_
+            << "  errors transport=" << terr << " server=" << serr << "\n";
+        out << std::defaultfloat << std::right;
+    }
+    if (!any)
+        out << "(no requests recorded yet)\n";
+}
+
+bool ClientStats::dumpToFile(const std::string &path) const
+{
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream f(tmp, std::ios::trunc);
+        if (!f)
+            return false;
+        std::time_t now = std::time(nullptr);
+        f << "# client stats at " << static_cast<long long>(now) << "\n";
+        print(f);
+        if (!f)
+            return false;
+    }
+    std::remove(path.c_str()); // rename() does not overwrite on Windows
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+void ClientStats::startPeriodicDump(const std::string &path, unsigned intervalSec)
+{
+    stopPeriodicDump();
+    if (intervalSec == 0)
+        return;
+
+    dumper = new Dumper();
+    dumper->path = path;
+    dumper->intervalSec = intervalSec;
+    Dumper *d = dumper;
+    d->worker = std::thread([this, d] {
+        std::unique_lock<std::mutex> lk(d->mtx);
+        while (!d->stop)
+        {
+            if (d->cv.wait_for(lk, std::chrono::seconds(d->intervalSec), [d] { return d->stop; }))
+                break;
+            dumpToFile(d->path);
+        }
+        dumpToFile(d->path); // final snapshot on shutdown
+    });
+}
+
+void ClientStats::stopPeriodicDump()
+{
+    if (!dumper)
+        return;
+    {
+        std::lock_guard<std::mutex> lk(dumper->mtx);
+        dumper->stop = true;
+    }
+    dumper->cv.notify_all();
+    if (dumper->worker.joinable())
+        dumper->worker.join();
+    delete dumper;
+    dumper = nullptr;
+}
+
+void ClientStats::reset()
+{
+    for (auto &pc : codes)
+    {
+        for (auto &h : pc.phases)
+            h.reset();
+        pc.bytesOut.store(0, std::memory_order_relaxed);
+        pc.bytesIn.store(0, std::memory_order_relaxed);
+        pc.transportErrors.store(0, std::memory_order_relaxed);
+        pc.serverErrors.store(0, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,141 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+//
+// ============================================================================
+//  Stats.h
+//  --------------------------------------------------------------------------
+//  Lightweight client instrumentation: per-request-code latency histograms
+//  (split by phase), byte counters and error counters.
+//
+//  All counters are relaxed atomics so recording costs a clock read plus a
+//  couple of increments and can stay enabled in production builds.
+// ============================================================================
+//
+
+// Phases of one request/response exchange.
+enum class Phase : uint8_t
+{
+    Serialize = 0, // Protocol::build*
+    Send,          // ServerConnection::sendAll
+    WaitHeader,    // until the 7-byte reply header is in
+    RecvPayload,   // reply payload body
+    Crypto,        // AES/RSA work attributed to this request
+    Total,         // whole sendAndRecv exchange
+    Count
+};
+
+const char *phaseName(Phase p);
+
+// ---------------------------------------------------------------------------
+// Log-linear ("HDR-style") histogram of nanosecond values.
+// Each power of two is split into SUB_BUCKETS linear sub-buckets, giving a
+// relative error of at most 1/SUB_BUCKETS across the whole range.
+// ---------------------------------------------------------------------------
+class LatencyHistogram
+{
+public:
+    static constexpr unsigned SUB_BITS = 3;
+    static constexpr unsigned SUB_BUCKETS = 1u << SUB_BITS;
+    static constexpr unsigned MAX_SHIFT = 40; // values above ~2^44 ns are clamped
+    static constexpr unsigned BUCKETS = SUB_BUCKETS * (MAX_SHIFT + 2);
+
+    void record(uint64_t ns);
+    void reset();
+
+    uint64_t count() const { return total.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return sumNs.load(std::memory_order_relaxed); }
+    uint64_t max() const { return maxNs.load(std::memory_order_relaxed); }
+
+    // Value (upper bound of its bucket) at percentile p in [0,100].
+    uint64_t percentile(double p) const;
+
+private:
+    static unsigned bucketOf(uint64_t ns);
+    static uint64_t bucketUpperBound(unsigned idx);
+
+    std::array<std::atomic<uint64_t>, BUCKETS> buckets{};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> sumNs{0};
+    std::atomic<uint64_t> maxNs{0};
+};
+
+// ---------------------------------------------------------------------------
+// Process-wide client statistics, keyed by request code (600, 601, ...).
+// ---------------------------------------------------------------------------
+class ClientStats
+{
+public:
+    static ClientStats &instance();
+
+    void record(uint16_t requestCode, Phase phase, uint64_t ns);
+    void addBytesOut(uint16_t requestCode, uint64_t n);
+    void addBytesIn(uint16_t requestCode, uint64_t n);
+
+    // Transport failure (send/recv failed) for a request.
+    void countTransportError(uint16_t requestCode);
+    // Server replied, but not with the expected code (e.g. 9000).
+    void countServerError(uint16_t requestCode);
+
+    // Human-readable table of everything recorded so far.
+    void print(std::ostream &out) const;
+
+    // Writes print() output (with a timestamp) to a file, replacing it.
+    bool dumpToFile(const std::string &path) const;
+
+    // Starts a background thread rewriting 'path' every intervalSec seconds.
+    // Calling it again replaces the previous dump target.
+    void startPeriodicDump(const std::string &path, unsigned intervalSec);
+    void stopPeriodicDump();
+
+    void reset();
+
+private:
+    ClientStats() = default;
+    ~ClientStats();
+
+    // Request codes are 600..(600+MAX_CODES-1); anything else shares the last slot.
+    static constexpr uint16_t CODE_BASE = 600;
+    static constexpr unsigned MAX_CODES = 16;
+    static unsigned slotOf(uint16_t code);
+
+    struct PerCode
+    {
+        std::array<LatencyHistogram, static_cast<size_t>(Phase::Count)> phases;
+        std::atomic<uint64_t> bytesOut{0};
+        std::atomic<uint64_t> bytesIn{0};
+        std::atomic<uint64_t> transportErrors{0};
+        std::atomic<uint64_t> serverErrors{0};
+    };
+    std::array<PerCode, MAX_CODES> codes;
+
+    struct Dumper;
+    Dumper *dumper = nullptr;
+};
+
+// ---------------------------------------------------------------------------
+// Runs fn() and records its duration under (code, phase). Returns fn()'s value.
+// ---------------------------------------------------------------------------
+template <typename Fn>
+auto timedPhase(uint16_t requestCode, Phase phase, Fn &&fn) -> decltype(fn())
+{
+    struct Guard
+    {
+        uint16_t code;
+        Phase phase;
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        ~Guard()
+        {
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now() - t0)
+                          .count();
+            ClientStats::instance().record(code, phase, static_cast<uint64_t>(ns));
+        }
+    } guard{requestCode, phase};
+    return fn();
+}
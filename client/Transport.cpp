@@ -0,0 +1,252 @@
+#include "Transport.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+
+#include "Protocol.h"
+#include "SocketApi.h"
+
+// ------------------------- Endpoint -------------------------
+
+std::string Endpoint::label() const
+{
+    switch (kind)
+    {
+    case Kind::Unix:
+        return "unix:" + path;
+    case Kind::Memory:
+        return "mem:" + path;
+    default:
+        return host + ":" + std::to_string(port);
+    }
+}
+
+Endpoint Endpoint::tcp(const std::string &host, unsigned short port)
+{
+    Endpoint ep;
+    ep.host = host;
+    ep.port = port;
+    return ep;
+}
+
+Endpoint Endpoint::parse(const std::string &text)
+{
+    Endpoint ep;
+    for (auto [prefix, kind] : {std::make_pair("unix:", Kind::Unix), std::make_pair("mem:", Kind::Memory)})
+    {
+        const size_t n = std::strlen(prefix);
+        if (text.compare(0, n, prefix) == 0)
+        {
+            ep.kind = kind;
+            ep.path = text.substr(n);
+            if (ep.path.empty())
+                throw std::runtime_error("missing path in '" + text + "'");
+            return ep;
+        }
+    }
+
+    const size_t pos = text.rfind(':');
+    if (pos == std::string::npos)
+        throw std::runtime_error("expected IP:PORT, unix:/path or mem:name, got '" + text + "'");
+    int port = 0;
+    try
+    {
+        port = std::stoi(text.substr(pos + 1));
+    }
+    catch (const std::exception &)
+    {
+    }
+    if (port <= 0 || port > 65535)
+        throw std::runtime_error("bad port in '" + text + "'");
+    return tcp(text.substr(0, pos), static_cast<unsigned short>(port));
+}
+
+// ------------------------- sockets -------------------------
+
+// TCP or AF_UNIX stream socket; only the connect step differs.
+class SocketTransport : public Transport
+{
+public:
+    ~SocketTransport() override
+    {
+        if (sock != INVALID_SOCKET)
+            closesocket(sock);
+        if (wsaInitialized)
+            WSACleanup();
+    }
+
+    bool open(const Endpoint &ep);
+    bool sendAll(const uint8_t *data, size_t len) override;
+    bool recvExact(uint8_t *dst, size_t len) override;
+
+private:
+    SOCKET sock = INVALID_SOCKET;
+    bool wsaInitialized = false;
+};
+
+bool SocketTransport::open(const Endpoint &ep)
+{
+    WSADATA wsaData;
+    int r = WSAStartup(MAKEWORD(2, 2), &wsaData);
+    if (r != 0)
+    {
+        std::cerr << "WSAStartup failed: " << r << "\n";
+        return false;
+    }
+    wsaInitialized = true;
+
+    sockaddr_storage addr{};
+    int addrLen = 0;
+    if (ep.kind == Endpoint::Kind::Unix)
+    {
+        auto *un = reinterpret_cast<sockaddr_un *>(&addr);
+        if (ep.path.size() >= sizeof(un->sun_path))
+        {
+            std::cerr << "unix socket path too long: " << ep.path << "\n";
+            return false;
+        }
+        un->sun_family = AF_UNIX;
+        std::memcpy(un->sun_path, ep.path.c_str(), ep.path.size() + 1);
+        addrLen = sizeof(sockaddr_un);
+        sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    }
+    else
+    {
+        auto *in = reinterpret_cast<sockaddr_in *>(&addr);
+        in->sin_family = AF_INET;
+        in->sin_port = htons(ep.port);
+        if (inet_pton(AF_INET, ep.host.c_str(), &in->sin_addr) != 1)
+        {
+            std::cerr << "inet_pton failed for IP: " << ep.host << "\n";
+            return false;
+        }
+        addrLen = sizeof(sockaddr_in);
+        sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    }
+    if (sock == INVALID_SOCKET)
+    {
+        std::cerr << "socket() failed: " << WSAGetLastError() << "\n";
+        return false;
+    }
+
+    if (::connect(sock, reinterpret_cast<sockaddr *>(&addr), addrLen) == SOCKET_ERROR)
+    {
+        std::cerr << "connect() failed: " << WSAGetLastError() << "\n";
+        return false;
+    }
+    if (ep.kind == Endpoint::Kind::Tcp)
+    {
+        // frames go out whole; pipelined ones (Async.h) must not wait for
+        // the ACK of the previous one
+        const int one = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char *>(&one), sizeof(one));
+    }
+    return true;
+}
+
+bool SocketTransport::sendAll(const uint8_t *data, size_t len)
+{
+    size_t sent = 0;
+    while (sent < len)
+    {
+        const int chunk = static_cast<int>(std::min<size_t>(len - sent, INT_MAX));
+        int n = ::send(sock, reinterpret_cast<const char *>(data) + sent, chunk, 0);
+        if (n <= 0)
+            return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool SocketTransport::recvExact(uint8_t *dst, size_t len)
+{
+    size_t got = 0;
+    while (got < len)
+    {
+        const int chunk = static_cast<int>(std::min<size_t>(len - got, INT_MAX));
+        int n = ::recv(sock, reinterpret_cast<char *>(dst) + got, chunk, 0);
+        if (n <= 0)
+            return false;
+        got += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// ------------------------- in-process -------------------------
+
+static std::map<std::string, MemoryTransport::Handler> &memoryServers()
+{
+    static std::map<std::string, MemoryTransport::Handler> servers;
+    return servers;
+}
+
+void MemoryTransport::listen(const std::string &name, Handler handler)
+{
+    memoryServers()[name] = std::move(handler);
+}
+
+void MemoryTransport::unlisten(const std::string &name)
+{
+    memoryServers().erase(name);
+}
+
+bool MemoryTransport::sendAll(const uint8_t *data, size_t len)
+{
+    pending.insert(pending.end(), data, data + len);
+
+    // hand every complete frame to the server; a multiplexed one (version
+    // byte CLIENT_VERSION_MUX) has the longer header
+    size_t at = 0;
+    while (pending.size() - at >= RequestHeader::size)
+    {
+        const uint8_t *head = pending.data() + at;
+        const bool mux = RequestHeader::get<RequestHeader::Version>(head) == CLIENT_VERSION_MUX;
+        const size_t headSize = mux ? MuxRequestHeader::size : RequestHeader::size;
+        if (pending.size() - at < headSize)
+            break;
+        const size_t frame = headSize + RequestHeader::get<RequestHeader::PayloadSize>(head);
+        if (pending.size() - at < frame)
+            break;
+        handler(pending.data() + at, frame, replies);
+        at += frame;
+    }
+    pending.erase(pending.begin(), pending.begin() + at);
+    return true;
+}
+
+bool MemoryTransport::recvExact(uint8_t *dst, size_t len)
+{
+    if (replies.size() - replyPos < len)
+        return false; // the server has nothing more to say: like a closed socket
+    std::memcpy(dst, replies.data() + replyPos, len);
+    replyPos += len;
+    if (replyPos == replies.size())
+    {
+        replies.clear();
+        replyPos = 0;
+    }
+    return true;
+}
+
+// ------------------------- factory -------------------------
+
+std::unique_ptr<Transport> Transport::connect(const Endpoint &ep)
+{
+    if (ep.kind == Endpoint::Kind::Memory)
+    {
+        auto it = memoryServers().find(ep.path);
+        if (it == memoryServers().end())
+        {
+            std::cerr << "no in-process server " << ep.label() << "\n";
+            return nullptr;
+        }
+        return std::make_unique<MemoryTransport>(it->second);
+    }
+    auto sock = std::make_unique<SocketTransport>();
+    if (!sock->open(ep))
+        return nullptr;
+    return sock;
+}
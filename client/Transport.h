@@ -0,0 +1,83 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+//
+// ============================================================================
+//  Transport.h
+//  --------------------------------------------------------------------------
+//  The byte stream under a ServerConnection. A server.info entry picks it:
+//
+//      127.0.0.1:1357     TCP
+//      unix:/run/mu.sock  Unix domain socket, for a server on the same host
+//                         (skips the TCP loopback stack; AF_UNIX is also
+//                         available on Windows 10 and later)
+//      mem:name           in-process server registered with
+//                         MemoryTransport::listen(), for benchmarks that
+//                         want protocol and crypto costs without any
+//                         kernel networking
+// ============================================================================
+//
+
+struct Endpoint
+{
+    enum class Kind { Tcp, Unix, Memory };
+
+    Kind kind = Kind::Tcp;
+    std::string host;        // Tcp
+    unsigned short port = 0; // Tcp
+    std::string path;        // Unix: socket path, Memory: server name
+
+    // "ip:port", "unix:/path" or "mem:name" (also the node's ring label).
+    std::string label() const;
+
+    // Parses one server.info entry. Throws std::runtime_error if malformed.
+    static Endpoint parse(const std::string &text);
+
+    static Endpoint tcp(const std::string &host, unsigned short port);
+};
+
+class Transport
+{
+public:
+    virtual ~Transport() = default;
+
+    // Exactly 'len' bytes out / in. False once the stream failed or was
+    // closed by the peer.
+    virtual bool sendAll(const uint8_t *data, size_t len) = 0;
+    virtual bool recvExact(uint8_t *dst, size_t len) = 0;
+
+    // Connected transport for 'ep'; nullptr (reason on stderr) on failure.
+    static std::unique_ptr<Transport> connect(const Endpoint &ep);
+};
+
+// In-process "server": every complete request frame written to the
+// transport is handed to a handler on the calling thread, and whatever
+// it appends to 'reply' is what recvExact() returns next. Buffers keep
+// their capacity, so a warmed-up round trip does not allocate.
+class MemoryTransport : public Transport
+{
+public:
+    // frame = request header + payload; append the reply frame to 'reply'
+    using Handler = std::function<void(const uint8_t *frame, size_t len, std::vector<uint8_t> &reply)>;
+
+    // Makes "mem:<name>" connectable. Not thread-safe: register servers
+    // before connecting to them.
+    static void listen(const std::string &name, Handler handler);
+    static void unlisten(const std::string &name);
+
+    explicit MemoryTransport(Handler handler) : handler(std::move(handler)) {}
+
+    bool sendAll(const uint8_t *data, size_t len) override;
+    bool recvExact(uint8_t *dst, size_t len) override;
+
+private:
+    Handler handler;
+    std::vector<uint8_t> pending; // request bytes not yet a full frame
+    std::vector<uint8_t> replies; // reply bytes not yet received
+    size_t replyPos = 0;
+};
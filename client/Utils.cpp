@@ -1,17 +1,11 @@
 #include "Utils.h"
+#include "Codec.h"
 #include <iostream>
 #include <iomanip>
 #include <algorithm>
 
 std::string toHex32(const std::array<uint8_t,16>& id) {
-    static const char* H = "0123456789abcdef";
-    std::string s;
-    s.reserve(32);
-    for (uint8_t b : id) {
-        s.push_back(H[(b >> 4) & 0xF]);
-        s.push_back(H[b & 0xF]);
-    }
-    return s;
+    return Codec::hexEncode(id.data(), id.size());
 }
 
 void dumpHexPrefix(const std::vector<uint8_t>& v, size_t n) {
@@ -27,3 +21,27 @@ void dumpHexPrefix(const std::vector<uint8_t>& v, size_t n) {
     std::cout << std::dec;
     std::cout.copyfmt(old_state);
 }
+
+std::string jsonEscape(const std::string& s) {
+    static const char* H = "0123456789abcdef";
+    std::string out;
+    out.reserve(s.size() + 8);
+    for (unsigned char c : s) {
+        switch (c) {
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (c < 0x20) {
+                out += "\\u00";
+                out.push_back(H[c >> 4]);
+                out.push_back(H[c & 0xF]);
+            } else {
+                out.push_back(static_cast<char>(c));
+            }
+        }
+    }
+    return out;
+}
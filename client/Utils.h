@@ -7,3 +7,6 @@
 
 std::string toHex32(const std::array<uint8_t,16>& id);
 void dumpHexPrefix(const std::vector<uint8_t>& v, size_t n = 16);
+
+// Escapes s for use inside a JSON string literal (quotes not included).
+std::string jsonEscape(const std::string& s);
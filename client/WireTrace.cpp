@@ -0,0 +1,80 @@
+#include "WireTrace.h"
+#include <chrono>
+#include <cstring>
+
+static uint64_t monotonicNs()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::steady_clock::now().time_since_epoch())
+                                     .count());
+}
+
+static void putLe(uint8_t *p, uint64_t v, int n)
+{
+    for (int i = 0; i < n; ++i)
+        p[i] = uint8_t((v >> (8 * i)) & 0xFF);
+}
+
+static uint64_t getLe(const uint8_t *p, int n)
+{
+    uint64_t v = 0;
+    for (int i = 0; i < n; ++i)
+        v |= uint64_t(p[i]) << (8 * i);
+    return v;
+}
+
+bool WireTraceWriter::open(const std::string &path)
+{
+    std::lock_guard<std::mutex> lk(mtx);
+    out.open(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+    out.write(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    startNs = monotonicNs();
+    return static_cast<bool>(out);
+}
+
+void WireTraceWriter::close()
+{
+    std::lock_guard<std::mutex> lk(mtx);
+    if (out.is_open())
+        out.close();
+}
+
+void WireTraceWriter::write(char direction, const uint8_t *data, size_t len)
+{
+    std::lock_guard<std::mutex> lk(mtx);
+    if (!out.is_open())
+        return;
+    uint8_t hdr[1 + 8 + 4];
+    hdr[0] = static_cast<uint8_t>(direction);
+    putLe(hdr + 1, monotonicNs() - startNs, 8);
+    putLe(hdr + 9, len, 4);
+    out.write(reinterpret_cast<const char *>(hdr), sizeof(hdr));
+    out.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(len));
+}
+
+bool WireTraceReader::open(const std::string &path)
+{
+    in.open(path, std::ios::binary);
+    if (!in)
+        return false;
+    char magic[sizeof(TRACE_MAGIC)];
+    if (!in.read(magic, sizeof(magic)))
+        return false;
+    return std::memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0;
+}
+
+bool WireTraceReader::next(WireRecord &rec)
+{
+    uint8_t hdr[1 + 8 + 4];
+    if (!in.read(reinterpret_cast<char *>(hdr), sizeof(hdr)))
+        return false;
+    rec.direction = static_cast<char>(hdr[0]);
+    rec.timestampNs = getLe(hdr + 1, 8);
+    const uint32_t len = static_cast<uint32_t>(getLe(hdr + 9, 4));
+    rec.data.resize(len);
+    if (len && !in.read(reinterpret_cast<char *>(rec.data.data()), len))
+        return false;
+    return true;
+}
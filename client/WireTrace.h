@@ -0,0 +1,67 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//
+// ============================================================================
+//  WireTrace.h
+//  --------------------------------------------------------------------------
+//  Compact binary trace of the frames exchanged with the server, written by
+//  ServerConnection in capture mode and read back by the replay tool.
+//
+//  File layout:
+//      magic "MUTRACE1" (8 bytes)
+//      records, each:
+//          direction  (1 byte: 'Q' = client->server, 'R' = server->client)
+//          timestamp  (8 bytes LE, ns since capture start)
+//          length     (4 bytes LE)
+//          bytes      (length bytes, exactly as sent/received)
+//
+//  A 'Q' record is one sendAll() call (a whole request frame); the 'R'
+//  records following it are the reply bytes in the order they were read.
+// ============================================================================
+//
+
+constexpr char TRACE_MAGIC[8] = {'M', 'U', 'T', 'R', 'A', 'C', 'E', '1'};
+constexpr char TRACE_DIR_REQUEST = 'Q';
+constexpr char TRACE_DIR_REPLY = 'R';
+
+struct WireRecord
+{
+    char direction{};          // TRACE_DIR_REQUEST / TRACE_DIR_REPLY
+    uint64_t timestampNs{};    // since capture start
+    std::vector<uint8_t> data; // raw frame bytes
+};
+
+class WireTraceWriter
+{
+public:
+    // Creates/truncates the trace file. Returns false if it can't be opened.
+    bool open(const std::string &path);
+    bool isOpen() const { return out.is_open(); }
+    void close();
+
+    // Appends one record stamped with the time since open().
+    void write(char direction, const uint8_t *data, size_t len);
+
+private:
+    std::ofstream out;
+    std::mutex mtx;
+    uint64_t startNs = 0;
+};
+
+class WireTraceReader
+{
+public:
+    // Opens a trace and validates the magic. Returns false on failure.
+    bool open(const std::string &path);
+
+    // Reads the next record; false at end of file or on a truncated record.
+    bool next(WireRecord &rec);
+
+private:
+    std::ifstream in;
+};
@@ -0,0 +1,1170 @@
+//
+// ============================================================================
+//  bench.cpp
+//  --------------------------------------------------------------------------
+//  Microbenchmarks for the client hot paths (protocol build/parse, AES/RSA,
+//  hex/Base64 conversion). Built as a separate target: `make bench`.
+//
+//  Usage:
+//      bench.exe [--filter <substr>] [--quick] [--csv <out.csv>]
+//      bench.exe --compare <base.csv> <new.csv>
+//
+//  Every case reports ns/op, bytes/s and heap allocations per op. The CSV
+//  output has one row per (benchmark, param) so two builds can be diffed
+//  with --compare.
+//
+//  Cases registered with runZeroAllocCase must not allocate once warmed up
+//  (runAllocBudgetCase: not more than a fixed count per op); if one does,
+//  it is reported and bench exits with status 1.
+// ============================================================================
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SocketApi.h"
+
+#include "Protocol.h"
+#include "BufferPool.h"
+#include "Encryption.h"
+#include "Codec.h"
+#include "PeerRegistry.h"
+#include "ServerCluster.h"
+#include "Async.h"
+#include "ClientSession.h"
+#include "FileConfig.h"
+#include "Utils.h"
+
+// ------------------------- Allocation counting -------------------------
+
+static std::atomic<uint64_t> g_allocCount{0};
+
+void *operator new(std::size_t n)
+{
+    g_allocCount.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(n ? n : 1))
+        return p;
+    throw std::bad_alloc();
+}
+void *operator new[](std::size_t n) { return operator new(n); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+// ------------------------- Harness -------------------------
+
+struct BenchResult
+{
+    std::string name;
+    std::string param;
+    uint64_t iterations = 0;
+    double nsPerOp = 0;
+    double bytesPerSec = 0;
+    double allocsPerOp = 0;
+};
+
+struct BenchOptions
+{
+    std::string filter;
+    bool quick = false;
+    std::string csvPath;
+};
+
+static BenchOptions g_opts;
+static std::vector<BenchResult> g_results;
+
+// Keeps the optimizer from discarding a computed value.
+template <typename T>
+static void doNotOptimize(const T &v)
+{
+    asm volatile("" : : "g"(&v) : "memory");
+}
+
+// True if the case passes --filter (used to skip expensive fixtures too).
+static bool wanted(const std::string &name)
+{
+    return g_opts.filter.empty() || name.find(g_opts.filter) != std::string::npos;
+}
+
+// Runs fn repeatedly until ~minTime has elapsed and records the result.
+// bytesPerOp is the number of payload bytes one call processes (0 = n/a).
+static void runCase(const std::string &name, const std::string &param,
+                    uint64_t bytesPerOp, const std::function<void()> &fn)
+{
+    if (!wanted(name))
+        return;
+
+    using clock = std::chrono::steady_clock;
+    const auto minTime = std::chrono::milliseconds(g_opts.quick ? 20 : 200);
+
+    fn(); // warm-up
+
+    uint64_t iters = 1;
+    for (;;)
+    {
+        const uint64_t allocs0 = g_allocCount.load(std::memory_order_relaxed);
+        const auto t0 = clock::now();
+        for (uint64_t i = 0; i < iters; ++i)
+            fn();
+        const auto elapsed = clock::now() - t0;
+        const uint64_t allocs = g_allocCount.load(std::memory_order_relaxed) - allocs0;
+
+        if (elapsed >= minTime || iters >= (1ull << 30))
+        {
+            const double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+            BenchResult r;
+            r.name = name;
+            r.param = param;
+            r.iterations = iters;
+            r.nsPerOp = ns / double(iters);
+            r.bytesPerSec = bytesPerOp ? double(bytesPerOp) * 1e9 / r.nsPerOp : 0.0;
+            r.allocsPerOp = double(allocs) / double(iters);
+            std::printf("%-40s %-10s %12.1f ns/op %10.2f MB/s %8.2f allocs/op\n",
+                        name.c_str(), param.c_str(), r.nsPerOp,
+                        r.bytesPerSec / 1e6, r.allocsPerOp);
+            std::fflush(stdout);
+            g_results.push_back(std::move(r));
+            return;
+        }
+        // grow towards the target duration (at most x10 per round)
+        const double ns = std::max(1.0, std::chrono::duration<double, std::nano>(elapsed).count());
+        const double want = std::chrono::duration<double, std::nano>(minTime).count() * 1.2;
+        iters = std::max<uint64_t>(iters + 1, std::min<uint64_t>(iters * 10, uint64_t(iters * want / ns)));
+    }
+}
+
+// Same as runCase, but once warmed up an op may allocate at most
+// 'maxAllocsPerOp' times.
+static int g_allocFailures = 0;
+
+static void runAllocBudgetCase(const std::string &name, const std::string &param, uint64_t bytesPerOp,
+                               double maxAllocsPerOp, const std::function<void()> &fn)
+{
+    const size_t before = g_results.size();
+    runCase(name, param, bytesPerOp, fn);
+    if (g_results.size() == before || g_results.back().allocsPerOp <= maxAllocsPerOp)
+        return;
+    if (maxAllocsPerOp == 0.0)
+        std::printf("  !! %s %s allocates in steady state\n", name.c_str(), param.c_str());
+    else
+        std::printf("  !! %s %s allocates more than %.0f times per op\n", name.c_str(), param.c_str(),
+                    maxAllocsPerOp);
+    ++g_allocFailures;
+}
+
+// Same as runCase, but the steady state must be allocation-free.
+static void runZeroAllocCase(const std::string &name, const std::string &param,
+                             uint64_t bytesPerOp, const std::function<void()> &fn)
+{
+    runAllocBudgetCase(name, param, bytesPerOp, 0.0, fn);
+}
+
+static std::string sizeLabel(size_t n)
+{
+    if (n >= (1u << 20) && n % (1u << 20) == 0)
+        return std::to_string(n >> 20) + "M";
+    if (n >= 1024 && n % 1024 == 0)
+        return std::to_string(n >> 10) + "K";
+    return std::to_string(n);
+}
+
+static void writeCsv(const std::string &path)
+{
+    std::ofstream out(path, std::ios::trunc);
+    if (!out)
+    {
+        std::cerr << "cannot write " << path << "\n";
+        return;
+    }
+    out << "benchmark,param,iterations,ns_per_op,bytes_per_sec,allocs_per_op\n";
+    for (const auto &r : g_results)
+    {
+        out << r.name << ',' << r.param << ',' << r.iterations << ','
+            << r.nsPerOp << ',' << r.bytesPerSec << ',' << r.allocsPerOp << '\n';
+    }
+}
+
+// Prints ns/op of two CSV files side by side (new vs base).
+static int compareCsv(const std::string &basePath, const std::string &newPath)
+{
+    auto load = [](const std::string &path, std::map<std::string, BenchResult> &out) {
+        std::ifstream in(path);
+        if (!in)
+            return false;
+        std::string line;
+        std::getline(in, line); // header
+        while (std::getline(in, line))
+        {
+            std::istringstream ss(line);
+            BenchResult r;
+            std::string it, ns, bps, al;
+            std::getline(ss, r.name, ',');
+            std::getline(ss, r.param, ',');
+            std::getline(ss, it, ',');
+            std::getline(ss, ns, ',');
+            std::getline(ss, bps, ',');
+            std::getline(ss, al, ',');
+            r.nsPerOp = std::atof(ns.c_str());
+            r.allocsPerOp = std::atof(al.c_str());
+            out[r.name + " " + r.param] = r;
+        }
+        return true;
+    };
+    std::map<std::string, BenchResult> base, cur;
+    if (!load(basePath, base) || !load(newPath, cur))
+    {
+        std::cerr << "cannot read CSV input\n";
+        return 1;
+    }
+    std::printf("%-52s %12s %12s %8s %10s\n", "case", "base ns/op", "new ns/op", "speedup", "allocs");
+    for (const auto &kv : cur)
+    {
+        auto it = base.find(kv.first);
+        if (it == base.end())
+            continue;
+        std::printf("%-52s %12.1f %12.1f %7.2fx %4.1f->%-4.1f\n", kv.first.c_str(),
+                    it->second.nsPerOp, kv.second.nsPerOp,
+                    it->second.nsPerOp / std::max(1e-9, kv.second.nsPerOp),
+                    it->second.allocsPerOp, kv.second.allocsPerOp);
+    }
+    return 0;
+}
+
+// ------------------------- Fixtures -------------------------
+
+static std::mt19937 g_rng(12345);
+
+static std::vector<uint8_t> randomBytes(size_t n)
+{
+    std::vector<uint8_t> v(n);
+    for (auto &b : v)
+        b = static_cast<uint8_t>(g_rng());
+    return v;
+}
+
+static Uuid randomUuid()
+{
+    Uuid id{};
+    for (auto &b : id)
+        b = static_cast<uint8_t>(g_rng());
+    return id;
+}
+
+// clients-list payload with n entries (server format)
+static std::vector<uint8_t> makeClientsListPayload(size_t n)
+{
+    std::vector<uint8_t> p(n * ENTRY_TOTAL, 0);
+    for (size_t i = 0; i < n; ++i)
+    {
+        uint8_t *base = p.data() + i * ENTRY_TOTAL;
+        Uuid id = randomUuid();
+        std::copy(id.begin(), id.end(), base);
+        std::string name = "user" + std::to_string(i);
+        std::copy(name.begin(), name.end(), base + ENTRY_UUID_LEN);
+    }
+    return p;
+}
+
+// waiting-messages payload with n messages of msgLen bytes each (server format)
+static std::vector<uint8_t> makeWaitingPayload(size_t n, size_t msgLen)
+{
+    std::vector<uint8_t> p;
+    p.reserve(n * (16 + 4 + 1 + 4 + msgLen));
+    for (size_t i = 0; i < n; ++i)
+    {
+        Uuid from = randomUuid();
+        p.insert(p.end(), from.begin(), from.end());
+        append_u32_le(p, static_cast<uint32_t>(i + 1));
+        p.push_back(3);
+        append_u32_le(p, static_cast<uint32_t>(msgLen));
+        auto body = randomBytes(msgLen);
+        p.insert(p.end(), body.begin(), body.end());
+    }
+    return p;
+}
+
+// ------------------------- Cases -------------------------
+
+static void benchProtocol()
+{
+    const Uuid me = randomUuid();
+    const Uuid dest = randomUuid();
+
+    runCase("protocol.buildClientsListReq", "-", 0, [&] {
+        auto m = Protocol::buildClientsListReq(me);
+        doNotOptimize(m);
+    });
+    runCase("protocol.buildPublicKeyReq", "-", 0, [&] {
+        auto m = Protocol::buildPublicKeyReq(me, dest);
+        doNotOptimize(m);
+    });
+    runCase("protocol.buildPullWaitingReq", "-", 0, [&] {
+        auto m = Protocol::buildPullWaitingReq(me);
+        doNotOptimize(m);
+    });
+
+    const size_t maxMsg = g_opts.quick ? (64u << 10) : (16u << 20);
+    for (size_t n = 16; n <= maxMsg; n *= 16)
+    {
+        auto content = randomBytes(n);
+        runCase("protocol.buildSendMessageReq", sizeLabel(n), n, [&] {
+            auto m = Protocol::buildSendMessageReq(me, dest, 3, content);
+            doNotOptimize(m);
+        });
+        std::vector<uint8_t> out;
+        runZeroAllocCase("protocol.buildSendMessageReq.into", sizeLabel(n), n, [&] {
+            Protocol::buildSendMessageReq(out, me, dest, 3, content.data(), content.size());
+            doNotOptimize(out);
+        });
+    }
+
+    const size_t maxEntries = g_opts.quick ? 1000 : 100000;
+    for (size_t n = 1; n <= maxEntries; n *= 10)
+    {
+        auto payload = makeClientsListPayload(n);
+        runCase("protocol.parseClientsListPayload", std::to_string(n), payload.size(), [&] {
+            auto v = Protocol::parseClientsListPayload(payload);
+            doNotOptimize(v);
+        });
+        std::vector<ClientEntry> entries;
+        runZeroAllocCase("protocol.parseClientsList.reuse", std::to_string(n), payload.size(), [&] {
+            Protocol::parseClientsList(payload.data(), payload.size(), entries);
+            doNotOptimize(entries);
+        });
+    }
+
+    for (size_t n = 1; n <= maxEntries; n *= 10)
+    {
+        auto payload = makeWaitingPayload(n, 64);
+        runCase("protocol.parseWaitingMessagesPayload", std::to_string(n) + "x64", payload.size(), [&] {
+            auto v = Protocol::parseWaitingMessagesPayload(payload);
+            doNotOptimize(v);
+        });
+        std::vector<WaitingMessageView> views;
+        runZeroAllocCase("protocol.parseWaitingMessages.view", std::to_string(n) + "x64", payload.size(), [&] {
+            Protocol::parseWaitingMessages(payload.data(), payload.size(), views);
+            doNotOptimize(views);
+        });
+    }
+
+    // 607: one frame carrying n 64-byte messages, vs n separate 603 frames
+    {
+        const std::vector<uint8_t> content(64, 0x5A);
+        std::vector<uint8_t> out;
+        for (size_t n = 1; n <= SEND_BATCH_MAX_ITEMS; n *= 32)
+        {
+            runZeroAllocCase("protocol.buildSendBatch.into", std::to_string(n) + "x64", n * content.size(), [&] {
+                Protocol::beginSendBatch(out, me);
+                for (size_t i = 0; i < n; ++i)
+                    Protocol::appendSendBatchItem(out, dest, 3, content.data(), content.size());
+                doNotOptimize(out);
+            });
+        }
+    }
+
+    uint8_t hdr[7] = {2, 0x34, 0x08, 0x10, 0, 0, 0};
+    runCase("protocol.parseServerReplyHeader", "-", 7, [&] {
+        auto r = Protocol::parseServerReplyHeader(hdr);
+        doNotOptimize(r);
+    });
+}
+
+static void benchEncryption()
+{
+    const auto key = Encryption::GenerateAesKey();
+    const size_t maxMsg = g_opts.quick ? (64u << 10) : (16u << 20);
+    for (size_t n = 16; n <= maxMsg; n *= 16)
+    {
+        auto plain = randomBytes(n);
+        runCase("encryption.aesCbcEncrypt", sizeLabel(n), n, [&] {
+            auto c = Encryption::AesCbcEncryptZeroIV(key, plain);
+            doNotOptimize(c);
+        });
+        auto cipher = Encryption::AesCbcEncryptZeroIV(key, plain);
+        runCase("encryption.aesCbcDecrypt", sizeLabel(n), n, [&] {
+            bool ok = false;
+            auto p = Encryption::AesCbcDecryptZeroIV(key, cipher, ok);
+            doNotOptimize(p);
+        });
+        std::vector<uint8_t> out;
+        runZeroAllocCase("encryption.aesCbcEncrypt.into", sizeLabel(n), n, [&] {
+            Encryption::AesCbcEncryptZeroIV(key, plain.data(), plain.size(), out);
+            doNotOptimize(out);
+        });
+        runZeroAllocCase("encryption.aesCbcDecrypt.into", sizeLabel(n), n, [&] {
+            bool ok = Encryption::AesCbcDecryptZeroIV(key, cipher.data(), cipher.size(), out);
+            doNotOptimize(ok);
+        });
+
+        // AES-GCM (random nonce + tag) on the same sizes, for comparison with CBC
+        runZeroAllocCase("encryption.aesGcmSeal", sizeLabel(n), n, [&] {
+            Encryption::AesGcmSeal(key, plain.data(), plain.size(), out);
+            doNotOptimize(out);
+        });
+        std::vector<uint8_t> sealed;
+        Encryption::AesGcmSeal(key, plain.data(), plain.size(), sealed);
+        runZeroAllocCase("encryption.aesGcmOpen", sizeLabel(n), n, [&] {
+            bool ok = Encryption::AesGcmOpen(key, sealed.data(), sealed.size(), out);
+            doNotOptimize(ok);
+        });
+    }
+
+    runCase("encryption.generateAesKey", "-", 16, [&] {
+        auto k = Encryption::GenerateAesKey();
+        doNotOptimize(k);
+    });
+
+    runCase("encryption.rsaKeygen1024", "-", 0, [&] {
+        auto kp = Encryption::GenerateRsaKeypair1024();
+        doNotOptimize(kp);
+    });
+
+    // RSA fan-out: wrap one AES key for K distinct peers (152 to K users)
+    const size_t maxKeys = g_opts.quick ? 4 : 64;
+    std::vector<Encryption::RsaKeyPair> pairs;
+    for (size_t k = 1; k <= maxKeys && (wanted("encryption.rsaEncryptFanout") || wanted("encryption.rsaDecrypt")); k *= 4)
+    {
+        while (pairs.size() < k)
+            pairs.push_back(Encryption::GenerateRsaKeypair1024());
+        std::vector<uint8_t> keyRaw(key.begin(), key.end());
+        runCase("encryption.rsaEncryptFanout", std::to_string(k) + "keys", 16 * k, [&] {
+            for (size_t i = 0; i < k; ++i)
+            {
+                auto c = Encryption::RsaEncryptOaepWithBase64Pub(pairs[i].publicKeyBase64, keyRaw);
+                doNotOptimize(c);
+            }
+        });
+    }
+    if (!pairs.empty())
+    {
+        std::vector<uint8_t> keyRaw(key.begin(), key.end());
+        auto c = Encryption::RsaEncryptOaepWithBase64Pub(pairs[0].publicKeyBase64, keyRaw);
+        runCase("encryption.rsaDecrypt", "-", 16, [&] {
+            bool ok = false;
+            auto p = Encryption::RsaDecryptOaepWithBase64Priv(pairs[0].privateKeyBase64, c, ok);
+            doNotOptimize(p);
+        });
+    }
+
+    // X25519 counterparts: keygen, and sealing key||caps (17 bytes) as 152 does
+    runCase("encryption.x25519Keygen", "-", 0, [&] {
+        auto kp = Encryption::GenerateX25519Keypair();
+        doNotOptimize(kp);
+    });
+    std::vector<Encryption::X25519KeyPair> xpairs;
+    std::vector<uint8_t> keyCaps(key.begin(), key.end());
+    keyCaps.push_back(CLIENT_CAPS);
+    std::vector<uint8_t> sealed;
+    for (size_t k = 1; k <= maxKeys && (wanted("encryption.x25519SealFanout") || wanted("encryption.x25519Open")); k *= 4)
+    {
+        while (xpairs.size() < k)
+            xpairs.push_back(Encryption::GenerateX25519Keypair());
+        runCase("encryption.x25519SealFanout", std::to_string(k) + "keys", 16 * k, [&] {
+            for (size_t i = 0; i < k; ++i)
+            {
+                bool ok = Encryption::X25519Seal(xpairs[i].publicKey, keyCaps.data(), keyCaps.size(), sealed);
+                doNotOptimize(ok);
+            }
+        });
+    }
+    if (!xpairs.empty())
+    {
+        Encryption::X25519Seal(xpairs[0].publicKey, keyCaps.data(), keyCaps.size(), sealed);
+        std::vector<uint8_t> opened;
+        runCase("encryption.x25519Open", "-", 16, [&] {
+            bool ok = Encryption::X25519Open(xpairs[0].privateKey, sealed.data(), sealed.size(), opened);
+            doNotOptimize(ok);
+        });
+    }
+}
+
+static void benchCodec()
+{
+    const Uuid id = randomUuid();
+    runCase("utils.toHex32", "-", 16, [&] {
+        auto s = toHex32(id);
+        doNotOptimize(s);
+    });
+    runCase("fileconfig.bytes16ToHex", "-", 16, [&] {
+        auto s = FileConfig::bytes16ToHex(id);
+        doNotOptimize(s);
+    });
+    const std::string hex = toHex32(id);
+    runCase("fileconfig.hexToBytes16", "-", 32, [&] {
+        auto b = FileConfig::hexToBytes16(hex);
+        doNotOptimize(b);
+    });
+
+    // directory scale: render every entry id as hex (e.g. "unknown sender" output)
+    const size_t maxEntries = g_opts.quick ? 1000 : 100000;
+    for (size_t n = 1; n <= maxEntries; n *= 10)
+    {
+        std::vector<Uuid> ids(n);
+        for (auto &u : ids)
+            u = randomUuid();
+        runCase("utils.toHex32.directory", std::to_string(n), 16 * n, [&] {
+            for (const auto &u : ids)
+            {
+                auto s = toHex32(u);
+                doNotOptimize(s);
+            }
+        });
+    }
+}
+
+// One 150 + one 140 round as ClientSession performs it, minus the socket:
+// encrypt text, build the send frame, parse an inbox of 'n' messages and
+// decrypt each into the caller's reused strings. All buffers come from a
+// BufferPool, so after warm-up nothing may allocate.
+static void benchSteadyState()
+{
+    const Uuid me = randomUuid();
+    const Uuid dest = randomUuid();
+    const auto key = Encryption::GenerateAesKey();
+    const std::string text(200, 'x');
+
+    for (size_t n : {1, 16, 256})
+    {
+        // inbox of n type-3 messages encrypted under 'key'
+        std::vector<uint8_t> inbox;
+        for (size_t i = 0; i < n; ++i)
+        {
+            std::vector<uint8_t> body(text.begin(), text.end());
+            auto c = Encryption::AesCbcEncryptZeroIV(key, body);
+            Uuid from = randomUuid();
+            inbox.insert(inbox.end(), from.begin(), from.end());
+            append_u32_le(inbox, static_cast<uint32_t>(i + 1));
+            inbox.push_back(3);
+            append_u32_le(inbox, static_cast<uint32_t>(c.size()));
+            inbox.insert(inbox.end(), c.begin(), c.end());
+        }
+
+        BufferPool pool;
+        std::vector<WaitingMessageView> views;
+        std::vector<std::string> texts;
+        runZeroAllocCase("session.sendPullCycle", std::to_string(n) + "msgs", text.size() + inbox.size(), [&] {
+            {
+                BufferPool::Scope scope(pool);
+                auto &cipher = pool.acquire();
+                Encryption::AesCbcEncryptZeroIV(key, reinterpret_cast<const uint8_t *>(text.data()),
+                                                text.size(), cipher);
+                auto &req = pool.acquire();
+                Protocol::buildSendMessageReq(req, me, dest, 3, cipher.data(), cipher.size());
+                doNotOptimize(req);
+            }
+            {
+                BufferPool::Scope scope(pool);
+                auto &plain = pool.acquire();
+                Protocol::parseWaitingMessages(inbox.data(), inbox.size(), views);
+                texts.resize(views.size());
+                for (size_t i = 0; i < views.size(); ++i)
+                {
+                    if (Encryption::AesCbcDecryptZeroIV(key, views[i].content, views[i].contentSize, plain))
+                        texts[i].assign(reinterpret_cast<const char *>(plain.data()), plain.size());
+                }
+                doNotOptimize(texts);
+            }
+        });
+    }
+}
+
+// Hex and Base64 kernels at every ISA this CPU supports. Params are
+// "<isa>/<size>" so --compare lines up the same kernel across builds.
+static void benchCodecIsa()
+{
+    const Codec::Isa best = Codec::bestIsa();
+    const Codec::Isa isas[] = {Codec::Isa::Scalar, Codec::Isa::Sse4, Codec::Isa::Avx2};
+    const size_t maxLen = g_opts.quick ? (4u << 10) : (64u << 10);
+
+    // 162 bytes = DER of a 1024-bit public key (216 Base64 chars),
+    // 635 bytes = DER of the private key
+    std::vector<size_t> sizes = {16, 162, 635};
+    for (size_t n = 4096; n <= maxLen; n *= 16)
+        sizes.push_back(n);
+
+    for (Codec::Isa isa : isas)
+    {
+        if (static_cast<int>(isa) > static_cast<int>(best))
+            break;
+        Codec::setIsa(isa);
+        const std::string tag = Codec::isaName(isa);
+        for (size_t n : sizes)
+        {
+            const auto bytes = randomBytes(n);
+            const std::string hex = Codec::hexEncode(bytes.data(), n);
+            const std::string b64 = Codec::base64Encode(bytes.data(), n);
+            std::string text(2 * n, '\0');
+            std::vector<uint8_t> out(n);
+
+            runZeroAllocCase("codec.hexEncode", tag + "/" + sizeLabel(n), n, [&] {
+                Codec::hexEncode(bytes.data(), n, &text[0]);
+                doNotOptimize(text);
+            });
+            runZeroAllocCase("codec.hexDecode", tag + "/" + sizeLabel(n), n, [&] {
+                bool ok = Codec::hexDecode(hex.data(), n, out.data());
+                doNotOptimize(ok);
+            });
+            runZeroAllocCase("codec.base64Encode", tag + "/" + sizeLabel(n), n, [&] {
+                Codec::base64Encode(bytes.data(), n, &text[0]);
+                doNotOptimize(text);
+            });
+            runZeroAllocCase("codec.base64Decode", tag + "/" + sizeLabel(n), n, [&] {
+                bool ok = Codec::base64Decode(b64, out);
+                doNotOptimize(ok);
+            });
+        }
+
+        // inbox scale: render the sender of every message from unknown peers
+        const size_t maxEntries = g_opts.quick ? 1000 : 100000;
+        auto payload = makeWaitingPayload(maxEntries, 64);
+        std::vector<WaitingMessageView> views;
+        Protocol::parseWaitingMessages(payload.data(), payload.size(), views);
+        char name[32];
+        runZeroAllocCase("codec.hexEncode.inbox", tag + "/" + std::to_string(maxEntries), 16 * maxEntries, [&] {
+            for (const auto &v : views)
+            {
+                Codec::hexEncode(v.fromId.data(), v.fromId.size(), name);
+                doNotOptimize(name);
+            }
+        });
+    }
+    Codec::setIsa(best);
+}
+
+// Peer registry at directory scale: name and sender (UUID) lookups, plus
+// heap bytes per peer with an RSA key stored for every entry.
+static void benchPeers()
+{
+    const size_t maxPeers = g_opts.quick ? 10000 : 1000000;
+    const std::string pubB64 = Codec::base64Encode(randomBytes(162).data(), 162);
+
+    for (size_t n : {size_t(1000), maxPeers})
+    {
+        if (!wanted("peers."))
+            return;
+        PeerRegistry reg;
+        std::vector<Uuid> ids(n);
+        std::vector<std::string> names(n);
+        reg.reserve(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            ids[i] = randomUuid();
+            names[i] = "user" + std::to_string(i);
+            PeerInfo &p = reg.upsert(names[i], ids[i]);
+            reg.setPublicKey(p, KEY_TYPE_RSA, reinterpret_cast<const uint8_t *>(pubB64.data()), pubB64.size());
+        }
+        std::printf("%-40s %-10zu %12.1f bytes/peer\n", "peers.memory", n, double(reg.memoryBytes()) / n);
+
+        // 256 lookups per op, spread over the whole registry
+        std::vector<size_t> picks(256);
+        for (size_t i = 0; i < picks.size(); ++i)
+            picks[i] = (i * 2654435761u) % n;
+
+        runZeroAllocCase("peers.findById", std::to_string(n), 0, [&] {
+            for (size_t i : picks)
+                doNotOptimize(reg.findById(ids[i]));
+        });
+        runZeroAllocCase("peers.find", std::to_string(n), 0, [&] {
+            for (size_t i : picks)
+                doNotOptimize(reg.find(names[i]));
+        });
+        if (n <= 10000)
+        {
+            // what sender resolution cost before the UUID index
+            runZeroAllocCase("peers.findById.linearScan", std::to_string(n), 0, [&] {
+                for (size_t i : picks)
+                    doNotOptimize(std::find_if(reg.begin(), reg.end(),
+                                               [&](const PeerInfo &p) { return p.id == ids[i]; }));
+            });
+        }
+    }
+}
+
+// Server side of the transport cases: a 2103 ack for every 603, the
+// canned 'inbox' for a 604.
+static void cannedReply(const std::vector<uint8_t> &inbox, const uint8_t *frame, size_t len,
+                        std::vector<uint8_t> &reply)
+{
+    const size_t at = reply.size();
+    uint8_t *h;
+    if (RequestHeader::get<RequestHeader::Code>(frame) == CODE_PULL_WAITING_REQ)
+    {
+        reply.resize(at + ReplyHeader::size + inbox.size());
+        h = reply.data() + at;
+        ReplyHeader::put<ReplyHeader::Code>(h, CODE_PULL_WAITING_OK);
+        ReplyHeader::put<ReplyHeader::PayloadSize>(h, static_cast<uint32_t>(inbox.size()));
+        std::copy(inbox.begin(), inbox.end(), h + ReplyHeader::size);
+    }
+    else
+    {
+        reply.resize(at + ReplyHeader::size + SendAckPayload::size);
+        h = reply.data() + at;
+        ReplyHeader::put<ReplyHeader::Code>(h, CODE_SEND_MESSAGE_OK);
+        ReplyHeader::put<ReplyHeader::PayloadSize>(h, static_cast<uint32_t>(SendAckPayload::size));
+        uint8_t *ack = h + ReplyHeader::size;
+        if (len >= RequestHeader::size + CLIENT_ID_LEN)
+            std::copy_n(frame + RequestHeader::size, CLIENT_ID_LEN, ack);
+        SendAckPayload::put<SendAckPayload::MsgId>(ack, 1u);
+    }
+    ReplyHeader::put<ReplyHeader::Version>(h, SERVER_VERSION_EXPECTED);
+}
+
+// One-connection server on a real socket (TCP loopback or AF_UNIX) that
+// answers through the same handler as the in-process transport, so the
+// transport cases differ only in the path the bytes take.
+class SocketServer
+{
+public:
+    ~SocketServer()
+    {
+        if (listener != INVALID_SOCKET)
+            closesocket(listener);
+        if (worker.joinable())
+            worker.join();
+        if (ep.kind == Endpoint::Kind::Unix)
+            std::remove(ep.path.c_str());
+    }
+
+    bool start(bool unixSocket, MemoryTransport::Handler handler)
+    {
+        WSADATA wsaData;
+        if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+            return false;
+        sockaddr_storage addr{};
+        int addrLen;
+        if (unixSocket)
+        {
+            auto *un = reinterpret_cast<sockaddr_un *>(&addr);
+            un->sun_family = AF_UNIX;
+            const std::string path = "bench-transport.sock";
+            std::remove(path.c_str());
+            std::memcpy(un->sun_path, path.c_str(), path.size() + 1);
+            addrLen = sizeof(sockaddr_un);
+            ep = Endpoint::parse("unix:" + path);
+            listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        }
+        else
+        {
+            auto *in = reinterpret_cast<sockaddr_in *>(&addr);
+            in->sin_family = AF_INET;
+            inet_pton(AF_INET, "127.0.0.1", &in->sin_addr);
+            addrLen = sizeof(sockaddr_in);
+            listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        }
+        if (listener == INVALID_SOCKET ||
+            bind(listener, reinterpret_cast<sockaddr *>(&addr), addrLen) == SOCKET_ERROR ||
+            listen(listener, 1) == SOCKET_ERROR)
+            return false;
+        if (!unixSocket)
+        {
+            socklen_t n = sizeof(addr);
+            getsockname(listener, reinterpret_cast<sockaddr *>(&addr), &n);
+            ep = Endpoint::tcp("127.0.0.1", ntohs(reinterpret_cast<sockaddr_in *>(&addr)->sin_port));
+        }
+        worker = std::thread([this, handler] { serve(handler); });
+        return true;
+    }
+
+    const Endpoint &endpoint() const { return ep; }
+
+private:
+    static bool readAll(SOCKET s, uint8_t *p, size_t n)
+    {
+        for (size_t got = 0; got < n;)
+        {
+            int r = recv(s, reinterpret_cast<char *>(p) + got, static_cast<int>(n - got), 0);
+            if (r <= 0)
+                return false;
+            got += static_cast<size_t>(r);
+        }
+        return true;
+    }
+
+    // serves one client until it disconnects
+    void serve(const MemoryTransport::Handler &handler)
+    {
+        SOCKET c = accept(listener, nullptr, nullptr);
+        if (c == INVALID_SOCKET)
+            return;
+        if (ep.kind == Endpoint::Kind::Tcp)
+        {
+            const int one = 1; // like the real server: pipelined replies go out at once
+            setsockopt(c, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char *>(&one), sizeof(one));
+        }
+        std::vector<uint8_t> frame, reply;
+        for (;;)
+        {
+            frame.resize(RequestHeader::size);
+            if (!readAll(c, frame.data(), RequestHeader::size))
+                break;
+            const uint32_t n = RequestHeader::get<RequestHeader::PayloadSize>(frame.data());
+            frame.resize(RequestHeader::size + n);
+            if (!readAll(c, frame.data() + RequestHeader::size, n))
+                break;
+            reply.clear();
+            handler(frame.data(), frame.size(), reply);
+            if (send(c, reinterpret_cast<const char *>(reply.data()), static_cast<int>(reply.size()), 0) <= 0)
+                break;
+        }
+        closesocket(c);
+    }
+
+    SOCKET listener = INVALID_SOCKET;
+    Endpoint ep;
+    std::thread worker;
+};
+
+// One 603 exchange on the loop of node 0.
+static Task<bool> sendTask(EventLoop &loop, const std::vector<uint8_t> &req, std::vector<uint8_t> &payload)
+{
+    ServerReply hdr{};
+    co_return co_await loop.exchange(0, req.data(), req.size(), hdr, payload);
+}
+
+// 'tasks.capacity()' sends one after another, or all in flight at once.
+static Task<bool> sendMany(EventLoop &loop, const std::vector<uint8_t> &req, bool pipelined,
+                           std::vector<Task<bool>> &tasks, std::vector<std::vector<uint8_t>> &payloads)
+{
+    bool ok = true;
+    tasks.clear();
+    for (size_t k = 0; k < payloads.size(); ++k)
+    {
+        tasks.push_back(sendTask(loop, req, payloads[k]));
+        if (pipelined)
+            tasks.back().start();
+        else
+            ok &= co_await tasks.back();
+    }
+    for (auto &t : tasks)
+        ok &= co_await t;
+    co_return ok;
+}
+
+// One 603 send and one 604 pull of 16 messages (parsed and decrypted) over
+// each transport, then 16 sends through the EventLoop, awaited one by one
+// vs. pipelined. "mem" has no kernel in the path, so it is the protocol
+// and crypto cost alone; "unix" vs "tcp" is what a same-host deployment
+// saves by listing unix:/path in server.info.
+static void benchTransport()
+{
+    if (!wanted("transport."))
+        return;
+    const Uuid me = randomUuid();
+    const Uuid dest = randomUuid();
+    const auto key = Encryption::GenerateAesKey();
+    const std::string text(200, 'x');
+
+    std::vector<uint8_t> inbox;
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        auto c = Encryption::AesCbcEncryptZeroIV(key, std::vector<uint8_t>(text.begin(), text.end()));
+        inbox.insert(inbox.end(), dest.begin(), dest.end());
+        append_u32_le(inbox, i + 1);
+        inbox.push_back(MSG_TYPE_TEXT_CBC);
+        append_u32_le(inbox, static_cast<uint32_t>(c.size()));
+        inbox.insert(inbox.end(), c.begin(), c.end());
+    }
+    auto handler = [&inbox](const uint8_t *frame, size_t len, std::vector<uint8_t> &reply) {
+        cannedReply(inbox, frame, len, reply);
+    };
+    MemoryTransport::listen("bench", handler);
+
+    for (const char *kind : {"mem", "unix", "tcp"})
+    {
+        SocketServer server;
+        Endpoint ep = Endpoint::parse("mem:bench");
+        if (std::strcmp(kind, "mem") != 0)
+        {
+            if (!server.start(std::strcmp(kind, "unix") == 0, handler))
+            {
+                std::printf("  (transport %s unavailable)\n", kind);
+                continue;
+            }
+            ep = server.endpoint();
+        }
+        ServerCluster cluster({ep});
+        ServerConnection *conn = cluster.connection(0);
+        if (!conn)
+            continue;
+
+        BufferPool pool;
+        std::vector<WaitingMessageView> views;
+        std::vector<std::string> texts;
+        auto exchange = [&](const uint8_t *req, size_t len, std::vector<uint8_t> &payload) {
+            uint8_t h[ReplyHeader::size];
+            if (!conn->sendAll(req, static_cast<int>(len)) || !conn->recvExact(h, sizeof(h)))
+                return false;
+            payload.resize(Protocol::parseServerReplyHeader(h).payloadSize);
+            return payload.empty() || conn->recvExact(payload.data(), static_cast<int>(payload.size()));
+        };
+        runZeroAllocCase("transport.send", kind, text.size(), [&] {
+            BufferPool::Scope scope(pool);
+            auto &cipher = pool.acquire();
+            Encryption::AesCbcEncryptZeroIV(key, reinterpret_cast<const uint8_t *>(text.data()), text.size(), cipher);
+            auto &req = pool.acquire();
+            Protocol::buildSendMessageReq(req, me, dest, MSG_TYPE_TEXT_CBC, cipher.data(), cipher.size());
+            auto &payload = pool.acquire();
+            bool ok = exchange(req.data(), req.size(), payload);
+            doNotOptimize(ok);
+        });
+        const auto pullReq = Protocol::buildPullWaitingReq(me);
+        runZeroAllocCase("transport.pull16", kind, inbox.size(), [&] {
+            BufferPool::Scope scope(pool);
+            auto &payload = pool.acquire();
+            auto &plain = pool.acquire();
+            exchange(pullReq.data(), pullReq.size(), payload);
+            Protocol::parseWaitingMessages(payload.data(), payload.size(), views);
+            texts.resize(views.size());
+            for (size_t i = 0; i < views.size(); ++i)
+            {
+                if (Encryption::AesCbcDecryptZeroIV(key, views[i].content, views[i].contentSize, plain))
+                    texts[i].assign(reinterpret_cast<const char *>(plain.data()), plain.size());
+            }
+            doNotOptimize(texts);
+        });
+
+        EventLoop loop(cluster);
+        std::vector<uint8_t> sendReq;
+        Protocol::buildSendMessageReq(sendReq, me, dest, MSG_TYPE_TEXT_CBC,
+                                      reinterpret_cast<const uint8_t *>(text.data()), text.size());
+        std::vector<std::vector<uint8_t>> payloads(16);
+        std::vector<Task<bool>> tasks;
+        tasks.reserve(payloads.size());
+        for (bool pipelined : {false, true})
+        {
+            runZeroAllocCase(pipelined ? "transport.async16.pipelined" : "transport.async16.sequential", kind,
+                             16 * text.size(), [&] {
+                                 bool ok = loop.run(sendMany(loop, sendReq, pipelined, tasks, payloads));
+                                 doNotOptimize(ok);
+                             });
+        }
+    }
+    MemoryTransport::unlisten("bench");
+}
+
+// Server side of the session cases, one node speaking the real protocol:
+// the 609 handshake and multiplexed frames after it, the one peer in the
+// 601 list, a message id for every 607 item, and 'inbox' for a 604
+// (except the first, which gets 'keyInbox': the peer's key for it).
+struct SessionServer
+{
+    Uuid peerId{};
+    std::string peerName;
+    std::vector<uint8_t> keyInbox;
+    std::vector<uint8_t> inbox;
+    bool keySent = false;
+    uint32_t nextMsgId = 1;
+
+    void answer(const uint8_t *frame, size_t len, std::vector<uint8_t> &reply)
+    {
+        const bool mux = RequestHeader::get<RequestHeader::Version>(frame) == CLIENT_VERSION_MUX;
+        const size_t headerSize = mux ? MuxRequestHeader::size : RequestHeader::size;
+        const uint8_t *payload = frame + headerSize;
+        const size_t payloadSize = len - headerSize;
+
+        const size_t at = reply.size();
+        const size_t replyHeaderSize = mux ? MuxReplyHeader::size : ReplyHeader::size;
+        reply.resize(at + replyHeaderSize);
+        uint16_t code;
+        switch (RequestHeader::get<RequestHeader::Code>(frame))
+        {
+        case CODE_HELLO_REQ:
+            code = CODE_HELLO_OK;
+            reply.push_back(CLIENT_VERSION_MUX);
+            break;
+        case CODE_CLIENTS_LIST_REQ:
+            code = CODE_CLIENTS_LIST_OK;
+            reply.resize(reply.size() + ClientEntryLayout::size);
+            ClientEntryLayout::put<ClientEntryLayout::ClientId>(reply.data() + reply.size() - ClientEntryLayout::size,
+                                                                peerId);
+            ClientEntryLayout::put<ClientEntryLayout::Name>(reply.data() + reply.size() - ClientEntryLayout::size,
+                                                            peerName);
+            break;
+        case CODE_PULL_WAITING_REQ:
+        {
+            code = CODE_PULL_WAITING_OK;
+            const auto &messages = keySent ? inbox : keyInbox;
+            reply.insert(reply.end(), messages.begin(), messages.end());
+            keySent = true;
+            break;
+        }
+        case CODE_SEND_BATCH_REQ:
+        {
+            code = CODE_SEND_BATCH_OK;
+            const uint32_t n = payloadSize >= BatchCount::size ? BatchCount::get<BatchCount::Count>(payload) : 0;
+            append_u32_le(reply, n);
+            for (uint32_t i = 0; i < n; ++i)
+            {
+                reply.resize(reply.size() + SendAckPayload::size);
+                SendAckPayload::put<SendAckPayload::MsgId>(reply.data() + reply.size() - SendAckPayload::size,
+                                                           nextMsgId++);
+            }
+            break;
+        }
+        default:
+            code = CODE_ERROR;
+            break;
+        }
+
+        uint8_t *h = reply.data() + at;
+        const auto size = static_cast<uint32_t>(reply.size() - at - replyHeaderSize);
+        if (mux)
+        {
+            MuxReplyHeader::put<MuxReplyHeader::Version>(h, SERVER_VERSION_MUX);
+            MuxReplyHeader::put<MuxReplyHeader::Code>(h, code);
+            MuxReplyHeader::put<MuxReplyHeader::PayloadSize>(h, size);
+            MuxReplyHeader::put<MuxReplyHeader::RequestId>(h, MuxRequestHeader::get<MuxRequestHeader::RequestId>(frame));
+        }
+        else
+        {
+            ReplyHeader::put<ReplyHeader::Version>(h, SERVER_VERSION_EXPECTED);
+            ReplyHeader::put<ReplyHeader::Code>(h, code);
+            ReplyHeader::put<ReplyHeader::PayloadSize>(h, size);
+        }
+    }
+};
+
+static void appendWaiting(std::vector<uint8_t> &inbox, const Uuid &from, uint32_t msgId, uint8_t type,
+                          const std::vector<uint8_t> &content)
+{
+    inbox.insert(inbox.end(), from.begin(), from.end());
+    append_u32_le(inbox, msgId);
+    inbox.push_back(type);
+    append_u32_le(inbox, static_cast<uint32_t>(content.size()));
+    inbox.insert(inbox.end(), content.begin(), content.end());
+}
+
+// ClientSession itself over "mem:": sendText (seal, outbox, 607 batch)
+// and pullMessages of 16 texts (604, parse, decrypt, history). The pull
+// must not allocate once warmed up. A send may allocate up to
+// SESSION_SEND_ALLOCS times (5 with libstdc++): the copy of its text, the
+// entry it reports on, and a file stream for each outbox access (append,
+// claim, settle), as the outbox file is the queue. The session keeps its
+// files next to the executable, so the case is skipped where a real
+// my.info lives.
+static constexpr double SESSION_SEND_ALLOCS = 8;
+
+static void benchSession()
+{
+    if (!wanted("session.client"))
+        return;
+    if (FileConfig::myInfoExists())
+    {
+        std::printf("  (session.client skipped: my.info exists next to bench)\n");
+        return;
+    }
+
+    const auto me = Encryption::GenerateX25519Keypair();
+    const Uuid myId = randomUuid();
+    std::string privLine = "x25519:";
+    privLine.resize(privLine.size() + Codec::base64EncodedLength(me.privateKey.size()));
+    Codec::base64Encode(me.privateKey.data(), me.privateKey.size(), privLine.data() + 7);
+    FileConfig::writeMyInfo("bench-me", myId, privLine);
+
+    SessionServer server;
+    server.peerId = randomUuid();
+    server.peerName = "bench-peer";
+    const auto key = Encryption::GenerateAesKey();
+    std::vector<uint8_t> keyRaw(key.begin(), key.end());
+    keyRaw.push_back(CAP_AES_GCM);
+    std::vector<uint8_t> wrapped;
+    Encryption::X25519Seal(me.publicKey, keyRaw.data(), keyRaw.size(), wrapped);
+    appendWaiting(server.keyInbox, server.peerId, 1, MSG_TYPE_KEY_X25519, wrapped);
+
+    const std::string text(200, 'x');
+    std::vector<uint8_t> sealed;
+    Encryption::AesGcmSeal(key, reinterpret_cast<const uint8_t *>(text.data()), text.size(), sealed);
+    for (uint32_t i = 0; i < 16; ++i)
+        appendWaiting(server.inbox, server.peerId, i + 2, MSG_TYPE_TEXT_GCM, sealed);
+    MemoryTransport::listen("session", [&server](const uint8_t *frame, size_t len, std::vector<uint8_t> &reply) {
+        server.answer(frame, len, reply);
+    });
+
+    {
+        ServerCluster cluster({Endpoint::parse("mem:session")});
+        ClientSession session(cluster);
+        std::vector<ReceivedMessage> received;
+        // the key (and the peer's name, 601) arrive with the first pull
+        if (!session.pullMessages(received).ok || !session.sendText(server.peerName, text).ok)
+            std::printf("  !! session.client: setup failed\n");
+        else
+        {
+            runAllocBudgetCase("session.client.send", "mem", text.size(), SESSION_SEND_ALLOCS, [&] {
+                OpResult r = session.sendText(server.peerName, text);
+                doNotOptimize(r);
+            });
+            runZeroAllocCase("session.client.pull16", "mem", server.inbox.size(), [&] {
+                OpResult r = session.pullMessages(received);
+                doNotOptimize(received);
+                doNotOptimize(r);
+            });
+            // both measured the path that works, not an error path
+            if (session.outboxSize() != 0 || received.size() != 16 || received.back().text != text)
+                std::printf("  !! session.client: messages were not delivered\n");
+        }
+    }
+    MemoryTransport::unlisten("session");
+
+    std::error_code ec;
+    for (const char *f : {"my.info", "outbox.dat", "outbox.dat.lock", "outbox.dat.node0.lock", "outbox.dat.tmp",
+                          "history.idx", "history.dat"})
+        std::filesystem::remove(std::filesystem::path(FileConfig::outboxPath()).parent_path() / f, ec);
+}
+
+// ------------------------- Main -------------------------
+
+int main(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string a = argv[i];
+        if (a == "--filter" && i + 1 < argc)
+            g_opts.filter = argv[++i];
+        else if (a == "--quick")
+            g_opts.quick = true;
+        else if (a == "--csv" && i + 1 < argc)
+            g_opts.csvPath = argv[++i];
+        else if (a == "--compare" && i + 2 < argc)
+            return compareCsv(argv[i + 1], argv[i + 2]);
+        else
+        {
+            std::cerr << "usage: bench [--filter <substr>] [--quick] [--csv <out.csv>]\n"
+                         "       bench --compare <base.csv> <new.csv>\n";
+            return 2;
+        }
+    }
+
+    benchProtocol();
+    benchEncryption();
+    benchCodec();
+    benchCodecIsa();
+    benchSteadyState();
+    benchPeers();
+    benchTransport();
+    benchSession();
+
+    if (!g_opts.csvPath.empty())
+        writeCsv(g_opts.csvPath);
+    if (g_allocFailures)
+    {
+        std::printf("%d case(s) over their allocation budget\n", g_allocFailures);
+        return 1;
+    }
+    return 0;
+}
@@ -1,34 +1,24 @@
 
+#include <charconv>
+#include <cstring>
+#include <ctime>
 #include <iostream>
+#include <fstream>
 #include <string>
 #include <vector>
-#include <array>
-#include <cstdint>
-#include <unordered_map>
-#include <algorithm>
 
-#include "ServerConnection.h"
+#include "ServerCluster.h"
 #include "FileConfig.h"
 #include "Protocol.h"
-#include "Encryption.h"
-#include "Message.h"
-#include "Utils.h"
-
-// Every other user will be saved in RAM with his:
-// UUID, public-key, symetric key
-struct PeerInfo
-{
-    Uuid id{};
-    std::string publicKeyBase64;
-    std::array<uint8_t, 16> symmetricKey{};
-    bool hasSymmetricKey = false;
-};
-
-//maping of username and PeerInfo
-static std::unordered_map<std::string, PeerInfo> g_peers;
+#include "ClientSession.h"
+#include "Batch.h"
+#include "Daemon.h"
+#include "Stats.h"
 
 // ------------------------- UI -------------------------
 
+static const size_t HISTORY_PAGE = 20; // messages per 141 screen
+
 static void showMenu()
 {
     std::cout << "\n-----------------------------------------\n";
@@ -37,123 +27,23 @@ static void showMenu()
                  "120) Request for clients list\n"
                  "130) Request for public key\n"
                  "140) Request for waiting messages\n"
+                 "141) Show message history\n"
                  "150) Send a text message\n"
                  "151) Send a request for symmetric key\n"
                  "152) Send your symmetric key\n"
+                 "160) Show client statistics\n"
                  "0)   Exit client\n";
 }
 
-// ------------------------- Helpers -------------------------
-
-// handles a complete request–response exchange with a server using a binary protocol
-// conn- the socket
-// req- raw bytes of the request to send
-// hdr- output parameter (header)
-// payload- output parameter (body)
-// returns true if operation succeeded or false if not
-static bool sendAndRecv(ServerConnection &conn,
-                        const std::vector<uint8_t> &req,
-                        ServerReply &hdr,
-                        std::vector<uint8_t> &payload)
-{
-    if (!conn.sendAll(req))
-        return false;
-
-    uint8_t h[7];
-    if (!conn.recvExact(h, 7))
-        return false;
-    hdr = Protocol::parseServerReplyHeader(h);
-
-    payload.clear();
-    if (hdr.payloadSize)
-    {
-        payload.resize(hdr.payloadSize);
-        if (!conn.recvExact(payload.data(), static_cast<int>(payload.size())))
-            return false;
-    }
-    return true;
-}
-
-// Try to find a username by its 16-byte client id from our cache
-static bool tryFindNameById(const Uuid &id, std::string &outName)
+// prompts for a destination username; false if input ended or was empty
+static bool promptUsername(std::string &toName)
 {
-    for (const auto &kv : g_peers)
-    {
-        if (kv.second.id == id)
-        {
-            outName = kv.first;
-            return true;
-        }
-    }
-    return false;
-}
-
-//This function requests and updates the local list of registered clients (users) from the server.
-// It ensures the global g_peers map (which holds known users, their IDs, and possibly public/symmetric keys) is synchronized with the latest data from the server.
-// Asks the server for the list of registered users
-// Receives and verifies the reply
-//parse the list of users (userrname,UUID)
-// update local cache g_peers with that info
-// returns true if successful
-static bool refreshClientsList(ServerConnection &conn, const Uuid &myId)
-{
-    auto req = Protocol::buildClientsListReq(myId);
-
-    ServerReply reply{};
-    std::vector<uint8_t> payload;
-    if (!sendAndRecv(conn, req, reply, payload) ||
-        !Protocol::isOk(reply, CODE_CLIENTS_LIST_OK))
-    {
-        return false;
-    }
-
-    auto entries = Protocol::parseClientsListPayload(payload);
-    for (const auto &e : entries)
-    {
-        auto it = g_peers.find(e.name);
-        if (it == g_peers.end())
-        {
-            PeerInfo pi;
-            pi.id = e.id;
-            g_peers.emplace(e.name, std::move(pi));
-        }
-        else
-        {
-            it->second.id = e.id; // update id; keep existing pub/symmetric keys
-        }
-    }
-    return true;
+    std::cout << "Enter destination username: ";
+    return std::getline(std::cin, toName) && !toName.empty();
 }
 
-// ------------------------- Main -------------------------
-
-int main()
+static void runMenu(ClientSession &session)
 {
-    // 1) read server address
-    std::string serverIp;
-    unsigned short serverPort = 0;
-    try
-    {
-        auto srv = FileConfig::readServerInfo();
-        serverIp = srv.first;
-        serverPort = srv.second;
-    }
-    catch (const std::exception &ex)
-    {
-        std::cerr << "Failed to read server.info: " << ex.what() << "\n";
-        return 1;
-    }
-
-    // 2) connect
-    ServerConnection conn(serverIp, serverPort);
-    if (!conn.connectToServer())
-    {
-        std::cerr << "Unable to connect to " << serverIp << ":" << serverPort << "\n";
-        return 1;
-    }
-    std::cout << "Connected to " << serverIp << ":" << serverPort << "\n";
-
-    // 3) menu loop
     for (;;)
     {
         showMenu();
@@ -192,318 +82,130 @@ int main()
                           << " chars; it will be truncated on registration.\n";
             }
 
-            // Prepare registration
-            Uuid zero{};
-            zero.fill(0);
-
-            auto kp = Encryption::GenerateRsaKeypair1024(); // produce private key and public key
-            //build request protocol
-            auto req = Protocol::buildRegistration(zero, username, kp.publicKeyBase64);
-
-            ServerReply reply{};
-            std::vector<uint8_t> payload;
-            //sending the message to the server
-            if (!sendAndRecv(conn, req, reply, payload))
+            auto res = session.registerUser(username);
+            if (!res.ok)
             {
-                std::cerr << "server responded with an error\n";
+                std::cerr << res.error << "\n";
                 continue;
             }
-
-            //check the reposinse from the server
-            if (Protocol::isOk(reply, CODE_REGISTRATION_OK) && payload.size() == CLIENT_ID_LEN)
-            {
-                Uuid myId{};
-                //fetching id
-                std::copy_n(payload.data(), CLIENT_ID_LEN, myId.data());
-                try
-                {
-                    //save in my.info
-                    FileConfig::writeMyInfo(username, myId, kp.privateKeyBase64);
-                    std::cout << "Registration successful. my.info created.\n";
-                }
-                catch (const std::exception &ex)
-                {
-                    std::cerr << "Registration succeeded but saving key failed: " << ex.what() << "\n";
-                }
-            }
-            else
-            {
-                std::cerr << "Server responded with error or unexpected payload.\n";
-            }
+            std::cout << "Registration successful. my.info created.\n";
         }
 
         // 120) Request for clients list
         else if (choice == "120")
         {
-            std::array<uint8_t, 16> myId{};
-            //fetching my UUID
-            try
-            {
-                auto me = FileConfig::readFullMyInfo();
-                myId = std::get<1>(me);
-            }
-            catch (...)
-            {
-                std::cerr << "Not registered. Please run 110 first.\n";
-                continue;
-            }
-
-            //prepare request for server
-            auto req = Protocol::buildClientsListReq(myId);
-
-            ServerReply reply{};
-            std::vector<uint8_t> payload;
-            //sending
-            if (!sendAndRecv(conn, req, reply, payload) ||
-                !Protocol::isOk(reply, CODE_CLIENTS_LIST_OK))
+            std::vector<std::string> names;
+            auto res = session.refreshClients(&names);
+            if (!res.ok)
             {
-                std::cerr << "server responded with an error\n";
+                std::cerr << res.error << "\n";
                 continue;
             }
 
-            auto entries = Protocol::parseClientsListPayload(payload);
-            g_peers.clear();
-
-            if (entries.empty())
+            if (names.empty())
             {
                 std::cout << "No other clients registered.\n";
             }
             else
             {
                 std::cout << "Registered clients:\n";
-                for (const auto &e : entries)
-                {
-                    PeerInfo pi;
-                    pi.id = e.id;
-                    g_peers[e.name] = pi;
-                    std::cout << " - " << e.name << "\n";
-                }
+                for (const auto &n : names)
+                    std::cout << " - " << n << "\n";
             }
         }
 
         // 130) Request for public key
         else if (choice == "130")
         {
-            std::array<uint8_t, 16> myId{};
-            try
-            {
-                auto me = FileConfig::readFullMyInfo();
-                myId = std::get<1>(me);
-            }
-            catch (...)
-            {
-                std::cerr << "Not registered. Please run 110 first.\n";
-                continue;
-            }
-
-            std::cout << "Enter destination username: ";
             std::string toName;
-            if (!std::getline(std::cin, toName) || toName.empty())
+            if (!promptUsername(toName))
                 continue;
 
-            auto it = g_peers.find(toName);
-            if (it == g_peers.end())
+            auto res = session.fetchPublicKey(toName);
+            if (!res.ok)
             {
-                std::cerr << "Unknown user. Run 120 to refresh the clients list.\n";
+                std::cerr << res.error << "\n";
                 continue;
             }
-            auto targetId = it->second.id;
-
-            auto req = Protocol::buildPublicKeyReq(myId, targetId);
-
-            ServerReply reply{};
-            std::vector<uint8_t> payload;
-            if (!sendAndRecv(conn, req, reply, payload))
-            {
-                std::cerr << "server responded with an error\n";
-                continue;
-            }
-
-            if (!Protocol::isOk(reply, CODE_PUBLIC_KEY_OK) ||
-                payload.size() != (CLIENT_ID_LEN + RESP_PUBKEY_LEN))
-            {
-
-                std::cerr << "server responded with an error\n";
-                continue;
-            }
-
-            // payload: [16B clientId][400B base64-ascii + NUL padding]
-            std::string b64(reinterpret_cast<const char *>(payload.data() + 16),
-                            RESP_PUBKEY_LEN);
-            auto nullPos = b64.find('\0');
-            if (nullPos != std::string::npos)
-                b64.erase(nullPos);
-
-            it->second.publicKeyBase64 = b64;
             std::cout << "Public key cached for " << toName << ".\n";
         }
 
         // 140) Request for waiting messages (pull inbox)
         else if (choice == "140")
         {
-            std::array<uint8_t, 16> myId{};
-            std::string myName;
-            std::string myPrivB64;
-            // reading my info
-            try
-            {
-                auto me = FileConfig::readFullMyInfo();
-                myName = std::get<0>(me);
-                myId = std::get<1>(me);
-                myPrivB64 = std::get<2>(me);
-            }
-            catch (...)
+            std::vector<ReceivedMessage> messages;
+            auto res = session.pullMessages(messages);
+            if (!res.ok)
             {
-                std::cerr << "Not registered. Please run 110 first.\n";
+                std::cerr << res.error << "\n";
                 continue;
             }
 
-            auto req = Protocol::buildPullWaitingReq(myId);
-
-            ServerReply rep{};
-            std::vector<uint8_t> payload;
-            //sending to server
-            if (!sendAndRecv(conn, req, rep, payload) ||
-                !Protocol::isOk(rep, CODE_PULL_WAITING_OK))
+            for (const auto &m : messages)
             {
-
-                std::cerr << "server responded with an error\n";
-                continue;
+                std::cout << "From: " << m.fromName;
+                if (!m.nameResolved)
+                    std::cout << "  [warning: username was not found]";
+                std::cout << "\nContent:\n";
+                (m.failed && m.type == 2 ? std::cerr : std::cout) << m.text << "\n";
+                std::cout << "------<EOM>-------\n\n";
             }
+        }
 
-            auto messages = Protocol::parseWaitingMessagesPayload(payload);
-            for (const auto &wm : messages)
+        // 141) Page backwards through the stored conversation with one user
+        else if (choice == "141")
+        {
+            std::string toName;
+            if (!promptUsername(toName))
+                continue;
+            std::vector<HistoryMessage> page;
+            uint32_t before = 0;
+            for (;;)
             {
-                std::string fromName;
-                // see if you can find the username by the id
-                bool haveName = tryFindNameById(wm.fromId, fromName);
-                if (!haveName)
-                {
-                    // Auto-refresh the clients list once
-                    // if it cant find the username it apply the request for users list (option 120)
-                    if (!refreshClientsList(conn, myId) || !tryFindNameById(wm.fromId, fromName))
-                    {
-                        fromName = toHex32(wm.fromId);
-                        std::cout << "From: " << fromName << "  [warning: username was not found]\nContent:\n";
-                    }
-                    else
-                    {
-                        std::cout << "From: " << fromName << "\nContent:\n";
-                    }
-                }
-                else
-                {
-                    std::cout << "From: " << fromName << "\nContent:\n";
-                }
-
-                // Analyzing the messages
-                if (wm.type == 1)
-                {
-                    std::cout << "Request for symmetric key\n";
-                }
-                // symetric key was sent
-                else if (wm.type == 2)
+                auto res = session.historyPage(toName, before, HISTORY_PAGE, page);
+                if (!res.ok)
                 {
-                    bool ok = false;
-                    // decrypt it with the private key
-                    auto recovered = Encryption::RsaDecryptOaepWithBase64Priv(myPrivB64, wm.content, ok);
-                    if (!ok || recovered.size() < 16)
-                    {
-                        std::cerr << "Failed to decrypt symmetric key.\n";
-                    }
-                    else
-                    {
-                        auto &peer = g_peers[fromName]; // creates if not exists
-                        std::copy_n(recovered.begin(), 16, peer.symmetricKey.begin());
-                        peer.hasSymmetricKey = true;
-                        std::cout << "Symmetric key stored for " << fromName << ".\n";
-                    }
+                    std::cerr << res.error << "\n";
+                    break;
                 }
-                // text message was sent
-                else if (wm.type == 3)
+                if (page.empty())
                 {
-                    auto it = g_peers.find(fromName);
-                    if (it == g_peers.end() || !it->second.hasSymmetricKey)
-                    {
-                        std::cout << "can't decrypt message\n";
-                    }
-                    else
-                    {
-                        bool ok = false;
-                        //decrypt with symetric key
-                        auto plain = Encryption::AesCbcDecryptZeroIV(it->second.symmetricKey, wm.content, ok);
-                        if (ok)
-                        {
-                            std::string text(plain.begin(), plain.end());
-                            std::cout << text << "\n";
-                        }
-                        else
-                        {
-                            std::cout << "can't decrypt message\n";
-                        }
-                    }
+                    std::cout << "No " << (before ? "older " : "") << "messages with " << toName << ".\n";
+                    break;
                 }
-                else
+                for (const auto &m : page)
                 {
-                    std::cout << "(unknown type)\n";
+                    const std::time_t t = m.time;
+                    char when[32];
+                    std::strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", std::localtime(&t));
+                    std::cout << "[" << when << "] " << (m.failed ? "(!) " : "") << m.text << "\n";
                 }
-                std::cout << "------<EOM>-------\n\n";
+                if (page.size() < HISTORY_PAGE)
+                    break;
+                std::cout << "-- Enter for older messages, q to stop: ";
+                std::string more;
+                if (!std::getline(std::cin, more) || more == "q")
+                    break;
+                before = page.front().ref;
             }
         }
 
         // 150) Send a text message
         else if (choice == "150")
         {
-            std::array<uint8_t, 16> myId{};
-            std::string myName;
-            try
-            {
-                auto me = FileConfig::readFullMyInfo();
-                myName = std::get<0>(me);
-                myId = std::get<1>(me);
-            }
-            catch (...)
-            {
-                std::cerr << "Not registered. Please run 110 first.\n";
-                continue;
-            }
-
-            std::cout << "Enter destination username: ";
             std::string toName;
-            if (!std::getline(std::cin, toName) || toName.empty())
-                continue;
-
-            auto it = g_peers.find(toName);
-            if (it == g_peers.end())
-            {
-                std::cerr << "User not found. Please run option 120 to refresh list.\n";
+            if (!promptUsername(toName))
                 continue;
-            }
-            auto targetId = it->second.id;
-
-            if (!it->second.hasSymmetricKey)
-            {
-                std::cerr << "No symmetric key with " << toName << ". Use 151/152 first.\n";
-                continue;
-            }
 
             std::cout << "Enter message text: ";
             std::string text;
             if (!std::getline(std::cin, text))
                 continue;
 
-            std::vector<uint8_t> plain(text.begin(), text.end());
-            auto cipher = Encryption::AesCbcEncryptZeroIV(it->second.symmetricKey, plain);
-
-            auto req = Protocol::buildSendMessageReq(myId, targetId, 3 /*text*/, cipher);
-
-            ServerReply rep{};
-            std::vector<uint8_t> payload;
-            if (!sendAndRecv(conn, req, rep, payload) ||
-                !Protocol::isSendAck(rep))
+            auto res = session.sendText(toName, text);
+            if (!res.ok)
             {
-
-                std::cerr << "server responded with an error\n";
+                std::cerr << res.error << "\n";
                 continue;
             }
             std::cout << "Message sent to " << toName << ".\n";
@@ -512,44 +214,14 @@ int main()
         // 151) Send a request for symmetric key
         else if (choice == "151")
         {
-            std::array<uint8_t, 16> myId{};
-            std::string myName;
-            try
-            {
-                auto me = FileConfig::readFullMyInfo();
-                myName = std::get<0>(me);
-                myId = std::get<1>(me);
-            }
-            catch (...)
-            {
-                std::cerr << "Not registered. Please run 110 first.\n";
-                continue;
-            }
-
-            std::cout << "Enter destination username: ";
             std::string toName;
-            if (!std::getline(std::cin, toName) || toName.empty())
+            if (!promptUsername(toName))
                 continue;
 
-            auto it = g_peers.find(toName);
-            if (it == g_peers.end())
+            auto res = session.requestSymmetricKey(toName);
+            if (!res.ok)
             {
-                std::cerr << "Unknown user. Run 120 to refresh the clients list.\n";
-                continue;
-            }
-            auto toId = it->second.id;
-
-            std::vector<uint8_t> empty;
-            auto req = Protocol::buildSendMessageReq(myId, toId, 1, empty);
-
-            ServerReply rep{};
-            std::vector<uint8_t> payload;
-            if (!sendAndRecv(conn, req, rep, payload) ||
-                !Protocol::isSendAck(rep))
-
-            {
-
-                std::cerr << "server responded with an error\n";
+                std::cerr << res.error << "\n";
                 continue;
             }
             std::cout << "Symmetric key request sent to " << toName << ".\n";
@@ -558,72 +230,186 @@ int main()
         // 152) Send your symmetric key
         else if (choice == "152")
         {
-            std::array<uint8_t, 16> myId{};
-            std::string myName;
-            try
-            {
-                auto me = FileConfig::readFullMyInfo();
-                myName = std::get<0>(me);
-                myId = std::get<1>(me);
-            }
-            catch (...)
-            {
-                std::cerr << "Not registered. Please run 110 first.\n";
-                continue;
-            }
-
-            std::cout << "Enter destination username: ";
             std::string toName;
-            if (!std::getline(std::cin, toName) || toName.empty())
+            if (!promptUsername(toName))
                 continue;
 
-            auto it = g_peers.find(toName);
-            if (it == g_peers.end())
+            auto res = session.sendSymmetricKey(toName);
+            if (!res.ok)
             {
-                std::cerr << "Unknown user. Run 120 to refresh the clients list.\n";
+                std::cerr << res.error << "\n";
                 continue;
             }
-            auto toId = it->second.id;
+            std::cout << "Symmetric key sent to " << toName << ".\n";
+        }
+
+        // 160) Show client statistics
+        else if (choice == "160")
+        {
+            ClientStats::instance().print(std::cout);
+        }
+
+        else
+        {
+            std::cout << "Unknown option.\n";
+        }
+    }
+}
 
-            if (it->second.publicKeyBase64.empty())
+// ------------------------- Main -------------------------
+
+// A whole decimal number from 'min' to 'max'; false for anything else.
+static bool parseUnsigned(const char *text, unsigned min, unsigned max, unsigned &out)
+{
+    const char *last = text + std::strlen(text);
+    unsigned n = 0;
+    const auto [end, ec] = std::from_chars(text, last, n);
+    if (ec != std::errc() || end != last || end == text || n < min || n > max)
+        return false;
+    out = n;
+    return true;
+}
+
+// Command line:
+//   --stats-dump <file>       periodically write client statistics to <file>
+//   --stats-interval <sec>    dump period (default 60)
+//   --capture <file>          record all frames to a wire trace (see replay.exe);
+//                             with several servers, node i>0 writes <file>.i
+//   --batch <file|->          run commands from a file (or stdin) without the menu (see Batch.h)
+//   --daemon <socket path>    serve local processes over a Unix socket (see Daemon.h)
+//   --daemon-threads <n>      connections served at once (1-256, default 1)
+//   --key-type <x25519|rsa>   identity key for a new registration (default x25519;
+//                             rsa for accounts that clients without X25519 must reach)
+int main(int argc, char *argv[])
+{
+    std::string statsDumpPath;
+    unsigned statsInterval = 60;
+    std::string capturePath;
+    std::string batchPath;
+    std::string daemonPath;
+    unsigned daemonThreads = 1;
+    uint8_t keyType = KEY_TYPE_X25519;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string a = argv[i];
+        if (a == "--stats-dump" && i + 1 < argc)
+            statsDumpPath = argv[++i];
+        else if (a == "--stats-interval" && i + 1 < argc)
+        {
+            if (!parseUnsigned(argv[++i], 1, 86400, statsInterval))
             {
-                std::cerr << "No public key for " << toName << ". Run 130 first.\n";
-                continue;
+                std::cerr << "Bad --stats-interval (seconds, 1-86400): " << argv[i] << "\n";
+                return 1;
             }
-
-            // ensure we have a symmetric key for this peer (generate once)
-            if (!it->second.hasSymmetricKey)
+        }
+        else if (a == "--capture" && i + 1 < argc)
+            capturePath = argv[++i];
+        else if (a == "--batch" && i + 1 < argc)
+            batchPath = argv[++i];
+        else if (a == "--daemon" && i + 1 < argc)
+            daemonPath = argv[++i];
+        else if (a == "--daemon-threads" && i + 1 < argc)
+        {
+            if (!parseUnsigned(argv[++i], 1, 256, daemonThreads))
             {
-                it->second.symmetricKey = Encryption::GenerateAesKey();
-                it->second.hasSymmetricKey = true;
+                std::cerr << "Bad --daemon-threads (1-256): " << argv[i] << "\n";
+                return 1;
             }
+        }
+        else if (a == "--key-type" && i + 1 < argc)
+        {
+            std::string t = argv[++i];
+            if (t == "x25519")
+                keyType = KEY_TYPE_X25519;
+            else if (t == "rsa")
+                keyType = KEY_TYPE_RSA;
+            else
+            {
+                std::cerr << "Unknown key type: " << t << "\n";
+                return 1;
+            }
+        }
+        else
+        {
+            std::cerr << "Unknown argument: " << a << "\n";
+            return 1;
+        }
+    }
+    if (!statsDumpPath.empty())
+        ClientStats::instance().startPeriodicDump(statsDumpPath, statsInterval);
 
-            // encrypt the 16B AES key with peer's RSA public key (base64)
-            std::vector<uint8_t> keyRaw(it->second.symmetricKey.begin(), it->second.symmetricKey.end());
-            auto keyEnc = Encryption::RsaEncryptOaepWithBase64Pub(it->second.publicKeyBase64, keyRaw);
+    // 1) read server addresses (one node per line)
+    std::vector<Endpoint> nodes;
+    try
+    {
+        nodes = FileConfig::readServerNodes();
+    }
+    catch (const std::exception &ex)
+    {
+        std::cerr << "Failed to read server.info: " << ex.what() << "\n";
+        return 1;
+    }
 
-            dumpHexPrefix(keyEnc, 16);
-            std::cout << "\n";
+    // 2) connect to the seed node; the others are connected on first use
+    ServerCluster cluster(nodes);
+    if (!cluster.connection(ServerCluster::SEED))
+    {
+        std::cerr << "Unable to connect to " << cluster.label(ServerCluster::SEED) << "\n";
+        return 1;
+    }
+    if (!capturePath.empty() && !cluster.enableCapture(capturePath))
+        return 1;
 
-            auto req = Protocol::buildSendMessageReq(myId, toId, 2 , keyEnc);
+    ClientSession session(cluster);
+    session.setRegistrationKeyType(keyType);
+    int rc = 0;
 
-            ServerReply rep{};
-            std::vector<uint8_t> payload;
-            if (!sendAndRecv(conn, req, rep, payload) ||
-                !Protocol::isSendAck(rep))
+    // 3a) daemon mode: the session serves other processes
+    if (!daemonPath.empty())
+    {
+        rc = runDaemon(session, daemonPath, daemonThreads);
+    }
+    // 3b) batch mode: no banner, one JSON result line per command
+    else if (!batchPath.empty())
+    {
+        std::ios::sync_with_stdio(false);
+        if (batchPath == "-")
+        {
+            rc = runBatch(session, std::cin, std::cout) ? 2 : 0;
+        }
+        else
+        {
+            std::ifstream in(batchPath);
+            if (!in)
             {
-
-                std::cerr << "server responded with an error\n";
-                continue;
+                std::cerr << "Cannot open batch file: " << batchPath << "\n";
+                return 1;
             }
-            std::cout << "Symmetric key sent to " << toName << ".\n";
+            rc = runBatch(session, in, std::cout) ? 2 : 0;
         }
-
-        else
+    }
+    // 3c) menu loop
+    else
+    {
+        std::cout << "Connected to " << cluster.label(ServerCluster::SEED);
+        if (cluster.size() > 1)
+            std::cout << " (" << cluster.size() << " server nodes)";
+        std::cout << "\n";
+        if (!capturePath.empty())
+            std::cout << "Capturing wire trace to " << capturePath << "\n";
+
+        // deliver messages left queued by an earlier run
+        if (session.outboxSize() != 0)
         {
-            std::cout << "Unknown option.\n";
+            size_t sent = 0;
+            auto res = session.flushOutbox(&sent);
+            std::cout << "Outbox: delivered " << sent << " queued message(s).\n";
+            if (!res.ok)
+                std::cerr << res.error << "\n";
         }
+        runMenu(session);
     }
 
-    return 0;
+    ClientStats::instance().stopPeriodicDump();
+    return rc;
 }
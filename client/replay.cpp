@@ -0,0 +1,216 @@
+//
+// ============================================================================
+//  replay.cpp
+//  --------------------------------------------------------------------------
+//  Replays a wire trace captured with `client.exe --capture <file>` against
+//  a server and compares the replies with the recorded ones.
+//  Built as a separate target: `make replay`.
+//
+//  Usage:
+//      replay.exe <trace> [--speed <N> | --max] [--server <endpoint>]
+//
+//      --speed N   replay at N x the original pacing (default 1 = original)
+//      --max       send each request as soon as the previous reply is in
+//      --server    target server, "ip:port" or "unix:/path" (default: first
+//                  entry of server.info next to the exe)
+//
+//  Reported: per-exchange response-time drift (replayed - recorded) and
+//  reply mismatches (code and payload). Payload mismatches are expected for
+//  server-assigned values (UUIDs, message ids); code mismatches are not.
+// ============================================================================
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ServerConnection.h"
+#include "FileConfig.h"
+#include "Protocol.h"
+#include "WireTrace.h"
+
+// One request frame and the reply bytes recorded right after it.
+struct Exchange
+{
+    uint64_t sentAtNs = 0;     // 'Q' timestamp
+    uint64_t recordedRtNs = 0; // last 'R' timestamp - 'Q' timestamp
+    std::vector<uint8_t> request;
+    std::vector<uint8_t> reply; // header + payload, concatenated
+};
+
+static bool loadExchanges(const std::string &path, std::vector<Exchange> &out)
+{
+    WireTraceReader reader;
+    if (!reader.open(path))
+        return false;
+    WireRecord rec;
+    while (reader.next(rec))
+    {
+        if (rec.direction == TRACE_DIR_REQUEST)
+        {
+            Exchange ex;
+            ex.sentAtNs = rec.timestampNs;
+            ex.request = std::move(rec.data);
+            out.push_back(std::move(ex));
+        }
+        else if (rec.direction == TRACE_DIR_REPLY && !out.empty())
+        {
+            Exchange &ex = out.back();
+            ex.reply.insert(ex.reply.end(), rec.data.begin(), rec.data.end());
+            ex.recordedRtNs = rec.timestampNs - ex.sentAtNs;
+        }
+    }
+    return true;
+}
+
+static uint16_t requestCode(const std::vector<uint8_t> &req)
+{
+    return Protocol::requestCodeOf(req.data(), req.size());
+}
+
+static double pct(std::vector<double> v, double p)
+{
+    if (v.empty())
+        return 0;
+    std::sort(v.begin(), v.end());
+    size_t idx = static_cast<size_t>(p / 100.0 * double(v.size() - 1) + 0.5);
+    return v[std::min(idx, v.size() - 1)];
+}
+
+int main(int argc, char *argv[])
+{
+    std::string tracePath;
+    double speed = 1.0;
+    bool asFastAsPossible = false;
+    std::string server;
+    bool badArgs = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string a = argv[i];
+        if (a == "--speed" && i + 1 < argc)
+            speed = std::stod(argv[++i]);
+        else if (a == "--max")
+            asFastAsPossible = true;
+        else if (a == "--server" && i + 1 < argc)
+            server = argv[++i];
+        else if (tracePath.empty() && a.rfind("--", 0) != 0)
+            tracePath = a;
+        else
+            badArgs = true;
+    }
+    if (badArgs || tracePath.empty() || speed <= 0)
+    {
+        std::cerr << "usage: replay <trace> [--speed <N> | --max] [--server <endpoint>]\n";
+        return 2;
+    }
+
+    Endpoint endpoint;
+    try
+    {
+        endpoint = server.empty() ? FileConfig::readServerNodes().front() : Endpoint::parse(server);
+    }
+    catch (const std::exception &ex)
+    {
+        std::cerr << "Bad server address: " << ex.what() << "\n";
+        return 1;
+    }
+
+    std::vector<Exchange> exchanges;
+    if (!loadExchanges(tracePath, exchanges))
+    {
+        std::cerr << "Cannot read trace: " << tracePath << "\n";
+        return 1;
+    }
+    if (exchanges.empty())
+    {
+        std::cout << "Trace contains no requests.\n";
+        return 0;
+    }
+
+    ServerConnection conn(endpoint);
+    if (!conn.connectToServer())
+    {
+        std::cerr << "Unable to connect to " << endpoint.label() << "\n";
+        return 1;
+    }
+
+    using clock = std::chrono::steady_clock;
+    const auto start = clock::now();
+    const uint64_t t0 = exchanges.front().sentAtNs;
+
+    std::vector<double> driftUs, replayRtUs, lateUs;
+    size_t codeMismatch = 0, payloadMismatch = 0, failed = 0;
+
+    for (size_t i = 0; i < exchanges.size(); ++i)
+    {
+        const Exchange &ex = exchanges[i];
+        if (!asFastAsPossible)
+        {
+            auto due = start + std::chrono::nanoseconds(static_cast<int64_t>(double(ex.sentAtNs - t0) / speed));
+            auto now = clock::now();
+            if (due > now)
+                std::this_thread::sleep_until(due);
+            else
+                lateUs.push_back(std::chrono::duration<double, std::micro>(now - due).count());
+        }
+
+        const auto tSend = clock::now();
+        uint8_t h[7];
+        std::vector<uint8_t> payload;
+        bool ok = conn.sendAll(ex.request) && conn.recvExact(h, 7);
+        ServerReply hdr{};
+        if (ok)
+        {
+            hdr = Protocol::parseServerReplyHeader(h);
+            payload.resize(hdr.payloadSize);
+            ok = hdr.payloadSize == 0 || conn.recvExact(payload.data(), static_cast<int>(payload.size()));
+        }
+        if (!ok)
+        {
+            ++failed;
+            std::cerr << "exchange " << i << " (code " << requestCode(ex.request) << "): connection failed\n";
+            break;
+        }
+        const double rtUs = std::chrono::duration<double, std::micro>(clock::now() - tSend).count();
+        replayRtUs.push_back(rtUs);
+        driftUs.push_back(rtUs - double(ex.recordedRtNs) / 1000.0);
+
+        std::vector<uint8_t> got(h, h + 7);
+        got.insert(got.end(), payload.begin(), payload.end());
+        if (ex.reply.size() < 7 || got[1] != ex.reply[1] || got[2] != ex.reply[2])
+        {
+            ++codeMismatch;
+            uint16_t want = ex.reply.size() >= 3 ? static_cast<uint16_t>(ex.reply[1] | (ex.reply[2] << 8)) : 0;
+            std::cout << "exchange " << i << " (code " << requestCode(ex.request) << "): reply code "
+                      << hdr.code << ", recorded " << want << "\n";
+        }
+        else if (got != ex.reply)
+        {
+            ++payloadMismatch;
+        }
+    }
+
+    const double wallMs = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+    const double recordedMs = double(exchanges.back().sentAtNs - t0) / 1e6;
+
+    std::printf("exchanges        %zu replayed, %zu failed\n", replayRtUs.size(), failed);
+    char mode[32];
+    if (asFastAsPossible)
+        std::snprintf(mode, sizeof(mode), "max");
+    else
+        std::snprintf(mode, sizeof(mode), "%gx", speed);
+    std::printf("wall time        %.1f ms (recorded span %.1f ms, mode %s)\n", wallMs, recordedMs, mode);
+    std::printf("response time    p50 %.1f us  p99 %.1f us  max %.1f us\n",
+                pct(replayRtUs, 50), pct(replayRtUs, 99), pct(replayRtUs, 100));
+    std::printf("drift vs trace   p50 %+.1f us  p99 %+.1f us  max %+.1f us\n",
+                pct(driftUs, 50), pct(driftUs, 99), pct(driftUs, 100));
+    if (!asFastAsPossible)
+        std::printf("send lateness    %zu requests behind schedule, p99 %.1f us\n", lateUs.size(), pct(lateUs, 99));
+    std::printf("mismatches       code %zu, payload %zu\n", codeMismatch, payloadMismatch);
+    return (failed || codeMismatch) ? 1 : 0;
+}
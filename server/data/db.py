@@ -1,9 +1,12 @@
 # data/db.py
 from __future__ import annotations
 import sqlite3
+import threading
+import time
 from pathlib import Path
-from typing import Optional
+from typing import Callable, Optional
 from datetime import datetime, timezone
+from stats import timed_db_methods
 
 _DB_FILE = "defensive.db"
 
@@ -13,7 +16,8 @@ CREATE TABLE IF NOT EXISTS Clients (
     username   TEXT NOT NULL UNIQUE,
     publicKey  TEXT,
     lastSeen   TEXT,
-    uniqueId   BLOB UNIQUE
+    uniqueId   BLOB UNIQUE,
+    keyType    INTEGER NOT NULL DEFAULT 0
 );
 """
 
@@ -25,20 +29,57 @@ CREATE TABLE IF NOT EXISTS Messages (
     type        TEXT NOT NULL,
     content     TEXT NOT NULL,
     createdAt   TEXT NOT NULL,
+    expiresAt   INTEGER,
     FOREIGN KEY (toClient)   REFERENCES Clients(ID),
     FOREIGN KEY (fromClient) REFERENCES Clients(ID)
 );
 """
 
+# the reaper finds expired rows without scanning the table
+_CREATE_EXPIRY_INDEX = """
+CREATE INDEX IF NOT EXISTS MessagesByExpiry ON Messages (expiresAt) WHERE expiresAt IS NOT NULL;
+"""
+
+_AUTO_VACUUM_INCREMENTAL = 2
+# Every connection thread (and each mux worker) has its own connection:
+# WAL lets readers run beside the one writer, and a writer waits up to
+# this many seconds for the lock instead of failing "database is locked".
+_BUSY_TIMEOUT = 10.0
+# enable_incremental_vacuum() reports every this many seconds, checking the
+# clock every _PROGRESS_STEPS SQLite VM instructions
+_PROGRESS_EVERY = 5.0
+_PROGRESS_STEPS = 100000
+
+# bound variables per statement on older SQLite builds
+_MAX_IN_PARAMS = 999
+
+# lifetime given to messages stored before expiry existed
+_LEGACY_MESSAGE_TTL = 30 * 24 * 3600
+
+# Bumped by every write to Clients: replies built from the table (see
+# protocol/server_protocol.py) are stale once it has moved.
+_clients_lock = threading.Lock()
+_clients_version = 0
+
+def clients_version() -> int:
+    return _clients_version
+
+def _clients_changed() -> None:
+    global _clients_version
+    with _clients_lock:
+        _clients_version += 1
+
+@timed_db_methods
 class Database:
-    """Single entry point for DB access."""
+    """Single entry point for DB access (every query method is timed, see stats.py)."""
     def __init__(self, base_dir: Optional[Path] = None, db_filename: str = _DB_FILE):
         base = base_dir or Path(__file__).resolve().parent.parent  # server_py/
         self.db_path = (base / db_filename) if not Path(db_filename).is_absolute() else Path(db_filename)
         self._conn: Optional[sqlite3.Connection] = None
 
     def connect(self) -> None:
-        self._conn = sqlite3.connect(self.db_path, check_same_thread=False)
+        self._conn = sqlite3.connect(self.db_path, timeout=_BUSY_TIMEOUT, check_same_thread=False)
+        self._conn.execute("PRAGMA journal_mode = WAL;")  # persistent; a no-op after the first time
         self._conn.execute("PRAGMA foreign_keys = ON;")
         self._ensure_schema()
 
@@ -57,8 +98,48 @@ class Database:
         cols = {row[1] for row in cur.fetchall()}
         if "uniqueId" not in cols:
             cur.execute("ALTER TABLE Clients ADD COLUMN uniqueId BLOB UNIQUE")
+        # 'keyType': 0 = RSA (Base64 DER in publicKey), 1 = X25519 (Base64 raw key)
+        if "keyType" not in cols:
+            cur.execute("ALTER TABLE Clients ADD COLUMN keyType INTEGER NOT NULL DEFAULT 0")
+        # 'expiresAt': unix seconds after which the reaper drops the row (NULL = never)
+        cur.execute("PRAGMA table_info(Messages)")
+        if "expiresAt" not in {row[1] for row in cur.fetchall()}:
+            cur.execute("ALTER TABLE Messages ADD COLUMN expiresAt INTEGER")
+            # rows from before the column get the default lifetime from now
+            cur.execute("UPDATE Messages SET expiresAt = ?", (int(time.time()) + _LEGACY_MESSAGE_TTL,))
+        cur.execute(_CREATE_EXPIRY_INDEX)
         self._conn.commit()
 
+    def incremental_vacuum_enabled(self) -> bool:
+        assert self._conn is not None
+        return self._conn.execute("PRAGMA auto_vacuum").fetchone()[0] == _AUTO_VACUUM_INCREMENTAL
+
+    def enable_incremental_vacuum(self, progress: Optional[Callable[[float], None]] = None) -> None:
+        """Lets incremental_vacuum() give freed pages back to the file system.
+
+        SQLite only honours the setting after a full VACUUM, so an older
+        database file is rebuilt once. The rebuild holds the write lock
+        throughout: call it before serving clients. 'progress' gets the
+        seconds spent so far, about every _PROGRESS_EVERY seconds.
+        """
+        assert self._conn is not None
+        if self.incremental_vacuum_enabled():
+            return
+        started = last = time.monotonic()
+        def tick():
+            nonlocal last
+            now = time.monotonic()
+            if progress and now - last >= _PROGRESS_EVERY:
+                last = now
+                progress(now - started)
+            return 0  # go on
+        self._conn.set_progress_handler(tick, _PROGRESS_STEPS)
+        try:
+            self._conn.execute("PRAGMA auto_vacuum = INCREMENTAL")
+            self._conn.execute("VACUUM")
+        finally:
+            self._conn.set_progress_handler(None, 0)
+
     # ----- Client ops -----
     def username_exists(self, username: str) -> bool:
         assert self._conn is not None
@@ -66,17 +147,26 @@ class Database:
         cur.execute("SELECT 1 FROM Clients WHERE username = ?", (username,))
         return cur.fetchone() is not None
 
-    def insert_client_with_uuid(self, username: str, public_key: str, unique_id_bytes: bytes) -> int:
+    def insert_client_with_uuid(self, username: str, public_key: str, unique_id_bytes: bytes,
+                                key_type: int = 0) -> int:
         assert self._conn is not None
         now = datetime.now(timezone.utc).isoformat()
         cur = self._conn.cursor()
         cur.execute(
-            "INSERT INTO Clients (username, publicKey, lastSeen, uniqueId) VALUES (?,?,?,?)",
-            (username, public_key, now, unique_id_bytes)
+            "INSERT INTO Clients (username, publicKey, lastSeen, uniqueId, keyType) VALUES (?,?,?,?,?)",
+            (username, public_key, now, unique_id_bytes, key_type)
         )
         self._conn.commit()
+        _clients_changed()
         return cur.lastrowid
 
+    def get_username_by_uuid(self, unique_id_bytes: bytes) -> Optional[str]:
+        assert self._conn is not None
+        cur = self._conn.cursor()
+        cur.execute("SELECT username FROM Clients WHERE uniqueId = ?", (unique_id_bytes,))
+        row = cur.fetchone()
+        return row[0] if row else None
+
     def get_client_id_by_uuid(self, unique_id_bytes: bytes) -> Optional[int]:
         assert self._conn is not None
         cur = self._conn.cursor()
@@ -134,25 +224,88 @@ class Database:
         row = cur.fetchone()
         return row[0] if row and row[0] is not None else None
 
+    def get_public_key_and_type_by_uuid(self, unique_id_bytes: bytes) -> Optional[tuple]:
+        """Return (publicKey, keyType) or None."""
+        assert self._conn is not None
+        cur = self._conn.cursor()
+        cur.execute("SELECT publicKey, keyType FROM Clients WHERE uniqueId = ?", (unique_id_bytes,))
+        row = cur.fetchone()
+        return (row[0], int(row[1])) if row and row[0] is not None else None
+
+    def get_public_keys_by_uuids(self, unique_ids: list) -> dict:
+        """Map uniqueId -> (publicKey, keyType) for those of 'unique_ids' that exist.
+
+        One IN (...) query per _MAX_IN_PARAMS ids (SQLite's parameter limit).
+        """
+        assert self._conn is not None
+        cur = self._conn.cursor()
+        found = {}
+        for i in range(0, len(unique_ids), _MAX_IN_PARAMS):
+            chunk = unique_ids[i:i + _MAX_IN_PARAMS]
+            qmarks = ",".join("?" for _ in chunk)
+            cur.execute(
+                f"SELECT uniqueId, publicKey, keyType FROM Clients WHERE uniqueId IN ({qmarks})"
+                " AND publicKey IS NOT NULL",
+                chunk
+            )
+            for uid, pk, key_type in cur.fetchall():
+                found[bytes(uid)] = (pk, int(key_type))
+        return found
+
+    def get_client_by_username(self, username: str) -> Optional[tuple]:
+        """Return (uniqueId_bytes, publicKey, keyType) or None.
+
+        Served from the index SQLite keeps for the UNIQUE 'username' column.
+        """
+        assert self._conn is not None
+        cur = self._conn.cursor()
+        cur.execute("SELECT uniqueId, publicKey, keyType FROM Clients WHERE username = ?", (username,))
+        row = cur.fetchone()
+        if not row or row[0] is None or row[1] is None:
+            return None
+        return (bytes(row[0]), row[1], int(row[2]))
+
     def save_message(self, to_client_rowid: int, from_client_rowid: int,
-                     msg_type: int, content: bytes) -> int:
+                     msg_type: int, content: bytes, expires_at: Optional[int] = None) -> int:
         assert self._conn is not None
         created_at = datetime.now(timezone.utc).isoformat()
         cur = self._conn.cursor()
         cur.execute(
-            "INSERT INTO Messages (toClient, fromClient, type, content, createdAt) VALUES (?,?,?,?,?)",
-            (to_client_rowid, from_client_rowid, str(msg_type), sqlite3.Binary(content), created_at)
+            "INSERT INTO Messages (toClient, fromClient, type, content, createdAt, expiresAt) VALUES (?,?,?,?,?,?)",
+            (to_client_rowid, from_client_rowid, str(msg_type), sqlite3.Binary(content), created_at, expires_at)
         )
         self._conn.commit()
         return cur.lastrowid
 
+    def save_messages(self, from_client_rowid: int, items) -> list:
+        """Store (to_client_rowid, msg_type, content, expires_at) items in one transaction.
+
+        Returns the new message IDs in item order.
+        """
+        assert self._conn is not None
+        created_at = datetime.now(timezone.utc).isoformat()
+        cur = self._conn.cursor()
+        ids = []
+        for to_rowid, msg_type, content, expires_at in items:
+            cur.execute(
+                "INSERT INTO Messages (toClient, fromClient, type, content, createdAt, expiresAt) VALUES (?,?,?,?,?,?)",
+                (to_rowid, from_client_rowid, str(msg_type), sqlite3.Binary(content), created_at, expires_at)
+            )
+            ids.append(cur.lastrowid)
+        self._conn.commit()
+        return ids
+
     def get_waiting_messages_for(self, to_client_rowid: int):
-        """Return list of rows for a recipient, then delete them."""
+        """Return list of unexpired rows for a recipient, then delete them.
+
+        Expired rows the reaper has not reached yet are left to it.
+        """
         assert self._conn is not None
         cur = self._conn.cursor()
         cur.execute(
-            "SELECT ID, fromClient, type, content FROM Messages WHERE toClient = ? ORDER BY ID ASC",
-            (to_client_rowid,)
+            "SELECT ID, fromClient, type, content FROM Messages"
+            " WHERE toClient = ? AND (expiresAt IS NULL OR expiresAt > ?) ORDER BY ID ASC",
+            (to_client_rowid, int(time.time()))
         )
         rows = cur.fetchall()
         # delete after fetch
@@ -163,6 +316,28 @@ class Database:
             self._conn.commit()
         return rows
 
+    # ----- Expiry -----
+    def delete_expired_messages(self, now: int, limit: int) -> int:
+        """Delete up to 'limit' messages expired at 'now'; returns how many.
+
+        One short transaction per call, so live writers wait at most that long.
+        """
+        assert self._conn is not None
+        cur = self._conn.execute(
+            "DELETE FROM Messages WHERE ID IN"
+            " (SELECT ID FROM Messages WHERE expiresAt <= ? LIMIT ?)",
+            (now, limit)
+        )
+        self._conn.commit()
+        return cur.rowcount
+
+    def incremental_vacuum(self, pages: int) -> int:
+        """Return up to 'pages' free pages to the file system; returns the free pages left."""
+        assert self._conn is not None
+        # frees one page per step: executescript steps it to the end, execute would not
+        self._conn.executescript(f"PRAGMA incremental_vacuum({int(pages)});")
+        return self._conn.execute("PRAGMA freelist_count").fetchone()[0]
+
     # Context manager
     def __enter__(self) -> "Database":
         self.connect()
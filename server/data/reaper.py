@@ -0,0 +1,74 @@
+# data/reaper.py
+from __future__ import annotations
+import threading
+import time
+from data.db import Database
+
+# Work is cut into short transactions with pauses in between, so requests
+# never wait long for the database write lock.
+REAP_INTERVAL = 60.0   # seconds between sweeps
+REAP_BATCH = 500       # rows deleted per transaction
+VACUUM_PAGES = 256     # free pages returned to the file system per step
+PAUSE = 0.05           # seconds between batches / steps
+
+class MessageReaper(threading.Thread):
+    """Deletes expired messages and shrinks the database file, in the background."""
+    def __init__(self, interval: float = REAP_INTERVAL):
+        super().__init__(daemon=True)
+        self.interval = interval
+        self.stopped = threading.Event()
+
+    def run(self):
+        with Database() as db:
+            while not self.stopped.is_set():
+                try:
+                    self.sweep(db)
+                except Exception as e:
+                    print(f"[!] Reaper: {e}", flush=True)
+                self.stopped.wait(self.interval)
+
+    def sweep(self, db: Database) -> int:
+        """One pass: expired rows out, then their pages back. Returns rows deleted."""
+        now = int(time.time())
+        deleted = 0
+        while not self.stopped.is_set():
+            n = db.delete_expired_messages(now, REAP_BATCH)
+            deleted += n
+            if n < REAP_BATCH:
+                break
+            time.sleep(PAUSE)
+        if db.incremental_vacuum_enabled():
+            # a step that frees nothing (pages still in use by a reader) ends it
+            free = None
+            while not self.stopped.is_set():
+                left = db.incremental_vacuum(VACUUM_PAGES)
+                if left == 0 or left == free:
+                    break
+                free = left
+                time.sleep(PAUSE)
+        if deleted:
+            print(f"[reaper] {deleted} expired message(s) deleted", flush=True)
+        return deleted
+
+    def stop(self):
+        self.stopped.set()
+
+def enable_vacuum(db: Database) -> None:
+    """The one-time rebuild of a file from before incremental vacuum.
+
+    It holds the write lock until done, so main() runs it before any
+    listener starts, logging as it goes.
+    """
+    if db.incremental_vacuum_enabled():
+        return
+    print("[reaper] Rebuilding the database for incremental vacuum (one-time, "
+          "not serving until done)...", flush=True)
+    started = time.monotonic()
+    try:
+        db.enable_incremental_vacuum(
+            lambda spent: print(f"[reaper] Still rebuilding ({spent:.0f}s)...", flush=True))
+    except Exception as e:
+        # e.g. another process holds the file; freed pages then stay in it
+        print(f"[!] Reaper: rebuild failed ({e}); will retry at the next start", flush=True)
+        return
+    print(f"[reaper] Rebuild done in {time.monotonic() - started:.1f}s", flush=True)
@@ -4,20 +4,56 @@ from pathlib import Path
 DEFAULT_PORT = 1357
 FILENAME = "myport.info"
 
+UNIX_PREFIX = "unix:"
+LIMIT_PREFIX = "limit:"
+SEED_PREFIX = "seed:"
+
 class PortConfig:
-    """Reads TCP port from a file next to the entry script. Falls back to DEFAULT_PORT."""
+    """Reads TCP port from a file next to the entry script. Falls back to DEFAULT_PORT.
+
+    An optional further line "unix:/path" also serves clients on that Unix
+    domain socket (same-host clients list the same line in server.info).
+    Lines "limit:<class>=<rate>/<burst>" or "limit:<class>=off" change the
+    request rate limits (see network/rate_limit.py). On every node but the
+    seed, "seed:IP:PORT" names the seed, which confirms joins.
+    """
     def __init__(self, base_dir: Path | None = None):
         # Default: folder of the running script
         self.base_dir = base_dir or Path(__file__).resolve().parent
         self.path = self.base_dir / FILENAME
 
+    def _lines(self) -> list:
+        return [l.strip() for l in self.path.read_text(encoding="utf-8").splitlines() if l.strip()]
+
     def get_port(self) -> int:
         if not self.path.exists():
             print(f"[warn] '{FILENAME}' not found in {self.base_dir}. Using default {DEFAULT_PORT}.")
             return DEFAULT_PORT
         try:
-            text = self.path.read_text(encoding="utf-8").strip()
+            text = next(l for l in self._lines() if not l.startswith((UNIX_PREFIX, LIMIT_PREFIX, SEED_PREFIX)))
             return int(text)
         except Exception as e:
             print(f"[warn] Failed reading '{self.path}': {e}. Using default {DEFAULT_PORT}.")
             return DEFAULT_PORT
+
+    def get_unix_path(self) -> str | None:
+        if not self.path.exists():
+            return None
+        for line in self._lines():
+            if line.startswith(UNIX_PREFIX):
+                return line[len(UNIX_PREFIX):]
+        return None
+
+    def get_limits(self) -> list:
+        if not self.path.exists():
+            return []
+        return [l[len(LIMIT_PREFIX):] for l in self._lines() if l.startswith(LIMIT_PREFIX)]
+
+    def get_seed(self) -> tuple | None:
+        if not self.path.exists():
+            return None
+        for line in self._lines():
+            if line.startswith(SEED_PREFIX):
+                host, _, port = line[len(SEED_PREFIX):].rpartition(":")
+                return host, int(port)
+        return None
@@ -1,9 +1,25 @@
 from file_config import PortConfig
-from network.server_socket import PortServer
+from data.db import Database
+from data.reaper import MessageReaper, enable_vacuum
+from network.rate_limit import RateLimiter
+from network.server_socket import PortServer, UnixServer
+from protocol.server_protocol import SEED
 
 def main():
-    port = PortConfig().get_port()
-    server = PortServer(port=port)
+    config = PortConfig()
+    with Database() as db:  # connecting creates / migrates the schema
+        enable_vacuum(db)     # one-time rebuild of an older file, before serving
+    MessageReaper().start()
+    SEED.address = config.get_seed()  # None: this node is the seed
+    limiter = RateLimiter(config.get_limits())  # one budget per client across both listeners
+    unix_path = config.get_unix_path()
+    if unix_path:
+        try:
+            UnixServer(unix_path, limiter=limiter).start()
+        except (OSError, RuntimeError) as e:
+            print(f"[!] Cannot listen on unix:{unix_path}: {e}", flush=True)
+            raise SystemExit(1)
+    server = PortServer(port=config.get_port(), limiter=limiter)
     server.run()
 
 if __name__ == "__main__":
@@ -0,0 +1,173 @@
+# network/rate_limit.py
+"""Token buckets per client UUID and per connection, one per opcode class.
+
+Only registered UUIDs get buckets of their own (any header can claim any
+UUID); a request under an unknown one is limited by its connection alone.
+The client buckets are an LRU of at most CLIENT_BUCKETS_MAX, and a bucket
+that has refilled is dropped, as a new one would be the same.
+
+A request over its budget first waits: the connection's thread sleeps
+until the tokens are there, so nothing more is read from that socket
+(backpressure). Only a request that would have to wait longer than
+MAX_DELAY is answered CODE_ERROR, without running its handler.
+
+Rates come from myport.info lines like "limit:pull=20/40" (20 requests a
+second, bursts of 40) or "limit:pull=off"; see file_config.py.
+"""
+from __future__ import annotations
+import threading
+import time
+from collections import OrderedDict
+from typing import Callable, Optional
+from protocol.server_protocol import (
+    CODE_REGISTRATION_REQ, CODE_CLIENTS_LIST_REQ, CODE_PUBLIC_KEY_REQ,
+    CODE_SEND_MESSAGE_REQ, CODE_PULL_WAITING_REQ,
+    CODE_REGISTRATION_V2_REQ, CODE_PUBLIC_KEY_V2_REQ, CODE_SEND_BATCH_REQ,
+    CODE_LOOKUP_USER_REQ, CODE_PUBLIC_KEYS_REQ, CODE_SERVER_STATS_REQ, NIL_UUID
+)
+
+# opcode -> class; codes not listed (hello) are never limited
+CLASS_OF = {
+    CODE_CLIENTS_LIST_REQ: "pull",  # full scans / inbox reads
+    CODE_PULL_WAITING_REQ: "pull",
+    CODE_SEND_MESSAGE_REQ: "send",
+    CODE_SEND_BATCH_REQ: "send",
+    CODE_PUBLIC_KEY_REQ: "lookup",
+    CODE_PUBLIC_KEY_V2_REQ: "lookup",
+    CODE_LOOKUP_USER_REQ: "lookup",
+    CODE_PUBLIC_KEYS_REQ: "lookup",
+    CODE_REGISTRATION_REQ: "register",
+    CODE_REGISTRATION_V2_REQ: "register",
+    CODE_SERVER_STATS_REQ: "stats",  # a full snapshot under the stats lock
+}
+
+# class -> (requests per second, burst); None = unlimited
+DEFAULT_LIMITS = {
+    "pull": (20.0, 40),
+    "send": (200.0, 400),
+    "lookup": (100.0, 200),
+    "register": (2.0, 5),
+    "stats": (2.0, 10),
+}
+
+MAX_DELAY = 1.0  # seconds a request may be held back before it is refused
+CLIENT_BUCKETS_MAX = 65536  # (client, class) buckets kept; least recently used go first
+VERIFIED_MAX = 64           # registered UUIDs one connection remembers
+
+class TokenBucket:
+    def __init__(self, rate: float, burst: int):
+        self.rate = rate
+        self.burst = float(burst)
+        self.tokens = float(burst)
+        self.last = time.monotonic()
+
+    def delay(self, now: float) -> float:
+        """Seconds until one token is available (0 if it is now)."""
+        self.tokens = min(self.burst, self.tokens + (now - self.last) * self.rate)
+        self.last = now
+        return 0.0 if self.tokens >= 1.0 else (1.0 - self.tokens) / self.rate
+
+    def take(self) -> None:
+        """Spends a token, going into debt when the caller chose to wait for it."""
+        self.tokens -= 1.0
+
+    def refilled(self, now: float) -> bool:
+        """True once the bucket is as full as a new one."""
+        return self.tokens + (now - self.last) * self.rate >= self.burst
+
+class RateLimiter:
+    """Buckets shared by all connections of a client UUID.
+
+    'overrides': "name=rate/burst" / "name=off" strings over DEFAULT_LIMITS.
+    """
+    def __init__(self, overrides: list = ()):
+        self.limits = dict(DEFAULT_LIMITS)
+        for text in overrides:
+            name, limit = parse_limit(text)
+            self.limits[name] = limit
+        self.lock = threading.Lock()
+        self.by_client = OrderedDict()  # (client_id, class) -> TokenBucket, LRU first
+
+    def connection(self) -> "ConnectionLimiter":
+        return ConnectionLimiter(self)
+
+    def client_bucket(self, client_id: bytes, cls: str, limit: tuple, now: float) -> TokenBucket:
+        """The client's bucket for 'cls'; caller holds the lock."""
+        while self.by_client:
+            key, oldest = next(iter(self.by_client.items()))
+            if len(self.by_client) < CLIENT_BUCKETS_MAX and not oldest.refilled(now):
+                break
+            del self.by_client[key]
+        key = (client_id, cls)
+        bucket = self.by_client.get(key)
+        if bucket is None:
+            bucket = self.by_client[key] = TokenBucket(*limit)
+        else:
+            self.by_client.move_to_end(key)
+        return bucket
+
+class ConnectionLimiter:
+    """The buckets one connection answers to; used from its reading thread only."""
+    def __init__(self, shared: RateLimiter):
+        self.shared = shared
+        self.own = {}
+        self.verified = set()  # client ids found registered
+
+    def admit(self, client_id: bytes, code: int, is_client: Callable[[bytes], bool]) -> Optional[float]:
+        """Seconds to hold the request back (0.0: at once), or None to refuse it.
+
+        Both the connection's bucket and, for a registered client (asked
+        of 'is_client' once per connection), the client's must allow it;
+        a request that is admitted spends a token from each.
+        """
+        cls = CLASS_OF.get(code)
+        limit = self.shared.limits.get(cls) if cls else None
+        if limit is None:
+            return 0.0
+        now = time.monotonic()
+        own = self.own.get(cls)
+        if own is None:
+            own = self.own[cls] = TokenBucket(*limit)
+        # new clients send the nil UUID, and made-up ones cost nothing to
+        # cycle through: the connection alone limits them
+        if not self._registered(client_id, is_client):
+            return self._spend(now, own)
+        with self.shared.lock:
+            shared = self.shared.client_bucket(client_id, cls, limit, now)
+            return self._spend(now, own, shared)
+
+    def _registered(self, client_id: bytes, is_client: Callable[[bytes], bool]) -> bool:
+        if client_id == NIL_UUID:
+            return False
+        if client_id in self.verified:
+            return True
+        if not is_client(client_id):
+            return False
+        if len(self.verified) >= VERIFIED_MAX:
+            self.verified.clear()
+        self.verified.add(client_id)
+        return True
+
+    @staticmethod
+    def _spend(now: float, *buckets: TokenBucket) -> Optional[float]:
+        wait = max(b.delay(now) for b in buckets)
+        if wait > MAX_DELAY:
+            return None
+        for b in buckets:
+            b.take()
+        return wait
+
+def parse_limit(text: str) -> tuple:
+    """'name=rate/burst' or 'name=off' -> (name, (rate, burst) or None)."""
+    name, _, value = text.partition("=")
+    name, value = name.strip(), value.strip()
+    if name not in DEFAULT_LIMITS:
+        raise ValueError(f"unknown limit class '{name}'")
+    if value == "off":
+        return name, None
+    rate, _, burst = value.partition("/")
+    rate = float(rate)
+    burst = int(burst) if burst else max(1, int(rate))
+    if rate <= 0 or burst < 1:
+        raise ValueError(f"bad limit '{text}'")
+    return name, (rate, burst)
@@ -1,21 +1,72 @@
 # network/server_socket.py
+import os
 import socket
+import stat
 import threading
+import time
+from concurrent.futures import ThreadPoolExecutor
 from data.db import Database
+from network.rate_limit import RateLimiter
+from stats import STATS
 from protocol.server_protocol import (
-    read_client_request, build_server_response,
+    read_client_request, build_server_response, CLIENT_HEADER_SIZE, REQUEST_ID_SIZE,
     CODE_REGISTRATION_REQ, CODE_CLIENTS_LIST_REQ, CODE_PUBLIC_KEY_REQ,
     CODE_SEND_MESSAGE_REQ, CODE_PULL_WAITING_REQ,
-    CODE_ERROR,
+    CODE_REGISTRATION_V2_REQ, CODE_PUBLIC_KEY_V2_REQ, CODE_SEND_BATCH_REQ,
+    CODE_LOOKUP_USER_REQ, CODE_HELLO_REQ, CODE_SERVER_STATS_REQ,
+    CODE_PUBLIC_KEYS_REQ, CODE_ERROR,
     handle_registration, handle_clients_list, handle_public_key_request,
-    handle_send_message, handle_pull_waiting
+    handle_send_message, handle_pull_waiting,
+    handle_registration_v2, handle_public_key_request_v2, handle_send_batch,
+    handle_lookup_user, handle_public_keys, handle_hello, handle_server_stats
 )
 
+# Multiplexed requests of one connection run on up to this many threads.
+MUX_WORKERS = 4
+# Tagged requests of one connection queued or running; at the limit the
+# connection is not read until one finishes.
+MUX_INFLIGHT = 64
+
+def dispatch(db: Database, req, local: bool = False):
+    """Runs req's handler; 'local': it came in on the Unix listener."""
+    if req.code == CODE_REGISTRATION_REQ:
+        return handle_registration(db, req.payload, req.client_id)
+    elif req.code == CODE_CLIENTS_LIST_REQ:
+        return handle_clients_list(db, req.client_id)
+    elif req.code == CODE_PUBLIC_KEY_REQ:
+        return handle_public_key_request(db, req.payload)
+    elif req.code == CODE_SEND_MESSAGE_REQ:
+        return handle_send_message(db, req.client_id, req.payload)
+    elif req.code == CODE_PULL_WAITING_REQ:
+        return handle_pull_waiting(db, req.client_id)
+    elif req.code == CODE_REGISTRATION_V2_REQ:
+        return handle_registration_v2(db, req.payload, req.client_id)
+    elif req.code == CODE_PUBLIC_KEY_V2_REQ:
+        return handle_public_key_request_v2(db, req.payload)
+    elif req.code == CODE_SEND_BATCH_REQ:
+        return handle_send_batch(db, req.client_id, req.payload)
+    elif req.code == CODE_LOOKUP_USER_REQ:
+        return handle_lookup_user(db, req.payload)
+    elif req.code == CODE_PUBLIC_KEYS_REQ:
+        return handle_public_keys(db, req.payload)
+    elif req.code == CODE_HELLO_REQ:
+        return handle_hello(req.payload)
+    elif req.code == CODE_SERVER_STATS_REQ:
+        return handle_server_stats(req.payload, may_reset=local)
+    return type("R", (), {"version":2,"code":CODE_ERROR,"payload":b""})()
+
 class ClientHandler(threading.Thread):
-    def __init__(self, conn: socket.socket, addr):
+    def __init__(self, conn: socket.socket, addr, limiter: RateLimiter):
         super().__init__(daemon=True)
         self.conn = conn
         self.addr = addr
+        self.limits = limiter.connection()
+        self.inflight = threading.BoundedSemaphore(MUX_INFLIGHT)
+        self.send_lock = threading.Lock()  # whole frames, from any worker
+        self.pool = None                   # started by the first tagged request
+        self.local = threading.local()
+        self.worker_dbs = []               # pool threads' connections, closed by run()
+        self.dbs_lock = threading.Lock()   # worker_dbs
 
     def run(self):
         print(f"[+] Client connected: {self.addr}", flush=True)
@@ -28,38 +79,147 @@ class ClientHandler(threading.Thread):
                         print(f"[-] Client disconnected: {self.addr}", flush=True)
                         break
 
-                    if req.code == CODE_REGISTRATION_REQ:
-                        resp = handle_registration(db, req.payload)
-                    elif req.code == CODE_CLIENTS_LIST_REQ:
-                        resp = handle_clients_list(db, req.client_id)
-                    elif req.code == CODE_PUBLIC_KEY_REQ:
-                        resp = handle_public_key_request(db, req.payload)
-                    elif req.code == CODE_SEND_MESSAGE_REQ:
-                        resp = handle_send_message(db, req.client_id, req.payload)
-                    elif req.code == CODE_PULL_WAITING_REQ:
-                        resp = handle_pull_waiting(db, req.client_id)
-                    else:
-                        resp = type("R", (), {"version":2,"code":CODE_ERROR,"payload":b""})()
-                    self.conn.sendall(build_server_response(resp.code, resp.payload))
+                    if not self.throttle(db, req):
+                        continue
+                    if req.request_id is not None:
+                        # answered when done; a quick request overtakes a slow one
+                        if self.pool is None:
+                            self.pool = ThreadPoolExecutor(max_workers=MUX_WORKERS)
+                        self.inflight.acquire()
+                        self.pool.submit(self.answer_tagged, req)
+                        continue
+                    self.respond(db, req)
 
             except Exception as e:
                 print(f"[!] Error with {self.addr}: {e}", flush=True)
+            finally:
+                if self.pool is not None:
+                    self.pool.shutdown(wait=True)
+                with self.dbs_lock:
+                    for worker_db in self.worker_dbs:
+                        worker_db.close()
+
+    def throttle(self, db: Database, req) -> bool:
+        """Holds the request back while the client is over its rate, reading
+        nothing else meanwhile. False if it was refused (already answered)."""
+        wait = self.limits.admit(req.client_id, req.code,
+                                 lambda uid: db.get_username_by_uuid(uid) is not None)
+        if wait is None:
+            STATS.record_throttle(req.code, 0, rejected=True)
+            self.send(build_server_response(CODE_ERROR, b"", req.request_id))
+            return False
+        if wait > 0:
+            time.sleep(wait)
+            STATS.record_throttle(req.code, int(wait * 1e9), rejected=False)
+        return True
+
+    def send(self, frame: bytes):
+        with self.send_lock:
+            self.conn.sendall(frame)
+
+    def worker_db(self) -> Database:
+        """The calling pool thread's own database connection."""
+        db = getattr(self.local, "db", None)
+        if db is None:
+            db = Database()
+            db.connect()
+            self.local.db = db
+            with self.dbs_lock:
+                self.worker_dbs.append(db)
+        return db
+
+    def respond(self, db: Database, req):
+        """Runs the request's handler and sends the reply, timing both (see stats.py)."""
+        STATS.take_db_ns()  # drop database time from outside any request
+        t0 = time.perf_counter_ns()
+        resp = dispatch(db, req, self.conn.family == socket.AF_UNIX)
+        frame = build_server_response(resp.code, resp.payload, req.request_id)
+        t1 = time.perf_counter_ns()
+        db_ns = STATS.take_db_ns()
+        self.send(frame)
+        t2 = time.perf_counter_ns()
+        header = CLIENT_HEADER_SIZE + (REQUEST_ID_SIZE if req.request_id is not None else 0)
+        STATS.record_request(req.code, t1 - t0, db_ns, t2 - t1,
+                             header + len(req.payload), len(frame), resp.code == CODE_ERROR)
+
+    def answer_tagged(self, req):
+        try:
+            self.respond(self.worker_db(), req)
+        except OSError:
+            pass  # the client went away; run() notices
+        except Exception as e:
+            print(f"[!] Error with {self.addr}: {e}", flush=True)
+            try:
+                self.send(build_server_response(CODE_ERROR, b"", req.request_id))
+            except OSError:
+                pass
+        finally:
+            self.inflight.release()
 
 class PortServer:
-    def __init__(self, host: str = "0.0.0.0", port: int = 1357, backlog: int = 50):
+    def __init__(self, host: str = "0.0.0.0", port: int = 1357, backlog: int = 50,
+                 limiter: RateLimiter = None):
         self.host, self.port, self.backlog = host, port, backlog
+        self.limiter = limiter or RateLimiter()
         self.sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
         self.sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
         self.sock.bind((self.host, self.port))
         self.sock.listen(self.backlog)
+        self.label = f"{self.host}:{self.port}"
+
+    def serve(self):
+        while True:
+            conn, addr = self.sock.accept()
+            if conn.family == socket.AF_INET:
+                # replies to pipelined requests must not wait for the ACK of the previous one
+                conn.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            ClientHandler(conn, addr or self.label, self.limiter).start()
 
     def run(self):
-        print(f"Server listening on {self.host}:{self.port}", flush=True)
+        print(f"Server listening on {self.label}", flush=True)
         try:
-            while True:
-                conn, addr = self.sock.accept()
-                ClientHandler(conn, addr).start()
+            self.serve()
         except KeyboardInterrupt:
             print("\nShutting down server...", flush=True)
         finally:
             self.sock.close()
+
+class UnixServer(PortServer):
+    """Same request loop on a Unix domain socket, for clients on this host.
+
+    The socket is made mode 0660: only this user and its group connect
+    (and only they may reset the stats, see handle_server_stats). A file
+    already at 'path' is replaced only if it is a socket nobody answers
+    on; anything else stops the server.
+    """
+    def __init__(self, path: str, backlog: int = 50, limiter: RateLimiter = None):
+        self.path, self.backlog = path, backlog
+        self.limiter = limiter or RateLimiter()
+        self._remove_stale(path)
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.bind(path)
+        os.chmod(path, 0o660)
+        self.sock.listen(backlog)
+        self.label = f"unix:{path}"
+
+    @staticmethod
+    def _remove_stale(path: str) -> None:
+        try:
+            mode = os.lstat(path).st_mode
+        except FileNotFoundError:
+            return
+        if not stat.S_ISSOCK(mode):
+            raise RuntimeError(f"{path} exists and is not a socket; not replacing it")
+        probe = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        try:
+            probe.connect(path)
+        except ConnectionRefusedError:
+            os.unlink(path)  # left behind by an earlier run
+            return
+        finally:
+            probe.close()
+        raise RuntimeError(f"another server is listening on {path}")
+
+    def start(self):
+        print(f"Server listening on {self.label}", flush=True)
+        threading.Thread(target=self.serve, daemon=True).start()
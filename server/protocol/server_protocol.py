@@ -1,15 +1,28 @@
 # protocol/server_protocol.py
+import base64
+import json
+import socket
 import struct
+import threading
+import time
 import uuid
 from dataclasses import dataclass
 from typing import Optional, Tuple
-from data.db import Database
+from data.db import Database, clients_version
+from stats import STATS
 
 # Constants
 CLIENT_HEADER_SIZE = 16 + 1 + 2 + 4  # id(16), ver(1), code(2 LE), size(4 LE)
 SERVER_VERSION = 2
 CLIENT_VERSION_SUPPORTED = 1
 
+# Multiplexed framing: a version 2 request header is followed by a request
+# id(4 LE); its reply has version 3 and the same id after the usual header.
+# Tagged requests may be answered in any order.
+CLIENT_VERSION_MUX = 2
+SERVER_VERSION_MUX = 3
+REQUEST_ID_SIZE = 4
+
 # Codes
 CODE_REGISTRATION_REQ = 600
 CODE_REGISTRATION_OK  = 2100
@@ -37,12 +50,55 @@ CODE_PUBLIC_KEY_REQ   = 602
 CODE_PUBLIC_KEY_OK    = 2102
 PUBKEY_RESP_KEY_LEN   = 400 #/ I couldn't handle 160
 
+# Typed identity keys (X25519): registration and public-key lookup
+CODE_REGISTRATION_V2_REQ = 605
+CODE_PUBLIC_KEY_V2_REQ   = 606
+CODE_PUBLIC_KEY_V2_OK    = 2106
+
+# Batched send: count(4 LE) + count x 603 payloads -> count(4 LE) + count x (dest(16) + msgId(4 LE))
+CODE_SEND_BATCH_REQ = 607
+CODE_SEND_BATCH_OK  = 2107
+
+# Username lookup: name(255) -> id(16) + keyType(1) + key (32 raw bytes for X25519, Base64 text for RSA)
+CODE_LOOKUP_USER_REQ = 608
+CODE_LOOKUP_USER_OK  = 2108
+
+# Bulk public keys: count(4 LE) + count x id(16) ->
+# count(4 LE) + count x (id(16) + keyType(1) + keyLen(2 LE) + key), in request
+# order; the key is encoded as in 2108, keyLen 0 = unknown client
+CODE_PUBLIC_KEYS_REQ = 611
+CODE_PUBLIC_KEYS_OK  = 2111
+PUBLIC_KEYS_MAX = 4096
+
+# Multiplexing handshake: highest request version offered(1) -> version accepted(1)
+CODE_HELLO_REQ = 609
+CODE_HELLO_OK  = 2109
+
+# Server statistics (stats.py): flags(1, optional; 1 = reset after reading) -> JSON text.
+# Nothing in a request proves who sent it, so only a connection on the Unix
+# listener (this host, socket mode 0660) may reset.
+CODE_SERVER_STATS_REQ = 610
+CODE_SERVER_STATS_OK  = 2110
+STATS_FLAG_RESET = 0x01
+
+# Message lifetime, by message type: rows nobody pulls in time are deleted
+# by the reaper (data/reaper.py). A key request is stale long before a text.
+MSG_TYPE_KEY_REQUEST = 1
+MESSAGE_TTL_DEFAULT = 30 * 24 * 3600
+MESSAGE_TTL_BY_TYPE = {MSG_TYPE_KEY_REQUEST: 7 * 24 * 3600}
+
+KEY_TYPE_RSA    = 0
+KEY_TYPE_X25519 = 1
+X25519_PUB_LEN  = 32
+REG_V2_PAYLOAD_LEN = REG_NAME_LEN + 1 + X25519_PUB_LEN  # 288
+
 @dataclass
 class ClientRequest:
     client_id: bytes  # 16 bytes
     version: int
     code: int
     payload: bytes
+    request_id: Optional[int] = None  # multiplexed requests only
 
 @dataclass
 class ServerResponse:
@@ -63,14 +119,51 @@ def read_exact(sock, n: int) -> bytes:
 def read_client_request(sock) -> ClientRequest:
     header = read_exact(sock, CLIENT_HEADER_SIZE)
     client_id, ver, code, size = struct.unpack("<16sBHI", header)
+    request_id = None
+    if ver == CLIENT_VERSION_MUX:
+        (request_id,) = struct.unpack("<I", read_exact(sock, REQUEST_ID_SIZE))
     payload = read_exact(sock, size) if size > 0 else b""
-    return ClientRequest(client_id=client_id, version=ver, code=code, payload=payload)
+    return ClientRequest(client_id=client_id, version=ver, code=code, payload=payload,
+                         request_id=request_id)
 
-def build_server_response(code: int, payload: bytes = b"") -> bytes:
-    header = struct.pack("<BHI", SERVER_VERSION, code, len(payload))
+def build_server_response(code: int, payload: bytes = b"", request_id: Optional[int] = None) -> bytes:
+    if request_id is not None:
+        header = struct.pack("<BHII", SERVER_VERSION_MUX, code, len(payload), request_id)
+    else:
+        header = struct.pack("<BHI", SERVER_VERSION, code, len(payload))
     return header + payload
 
-def handle_registration(db: Database, payload: bytes) -> ServerResponse:
+def handle_server_stats(payload: bytes, may_reset: bool = False) -> ServerResponse:
+    """610: everything stats.py recorded so far, as UTF-8 JSON.
+
+    A reset asked for without 'may_reset' is refused, snapshot and all.
+    """
+    if len(payload) > 1:
+        return ServerResponse(SERVER_VERSION, CODE_ERROR, b"")
+    if payload and payload[0] & STATS_FLAG_RESET and not may_reset:
+        return ServerResponse(SERVER_VERSION, CODE_ERROR, b"")
+    body = json.dumps(STATS.snapshot(), separators=(",", ":")).encode("utf-8")
+    if payload and payload[0] & STATS_FLAG_RESET:
+        STATS.reset()
+    return ServerResponse(SERVER_VERSION, CODE_SERVER_STATS_OK, body)
+
+def handle_hello(payload: bytes) -> ServerResponse:
+    """609: accepts multiplexed framing if the client offers it."""
+    if len(payload) != 1 or payload[0] < CLIENT_VERSION_MUX:
+        return ServerResponse(SERVER_VERSION, CODE_ERROR, b"")
+    return ServerResponse(SERVER_VERSION, CODE_HELLO_OK, bytes([CLIENT_VERSION_MUX]))
+
+NIL_UUID = b"\x00" * 16
+
+def handle_registration(db: Database, payload: bytes, requester_uuid: bytes = NIL_UUID) -> ServerResponse:
+    """Registers a new client.
+
+    A nil header UUID asks this server to assign one. A non-nil UUID is a
+    join: a client already registered on another node of a sharded
+    deployment registers here under the same UUID. The join is stored only
+    if the seed node holds the same UUID, name and key (SeedDirectory).
+    Joining again with the same name is a no-op, so clients may retry it.
+    """
     if len(payload) != REG_PAYLOAD_LEN:
         return ServerResponse(SERVER_VERSION, CODE_ERROR, b"")
 
@@ -80,40 +173,161 @@ def handle_registration(db: Database, payload: bytes) -> ServerResponse:
     # ASCII, trim trailing NULs/space
     username = name_raw.rstrip(b"\x00 ").decode("ascii", errors="ignore")
     public_key = pub_raw.rstrip(b"\x00 ").decode("ascii", errors="ignore")
+    return _register(db, username, public_key, KEY_TYPE_RSA, requester_uuid)
+
+def handle_registration_v2(db: Database, payload: bytes, requester_uuid: bytes = NIL_UUID) -> ServerResponse:
+    """Registers (or joins) a client with a typed raw public key.
+
+    Payload: name(255, NUL padded) + keyType(1) + publicKey(32). Only
+    X25519 is accepted; RSA clients keep using 600. Replies like 600.
+    """
+    if len(payload) != REG_V2_PAYLOAD_LEN:
+        return ServerResponse(SERVER_VERSION, CODE_ERROR, b"")
+    key_type = payload[REG_NAME_LEN]
+    if key_type != KEY_TYPE_X25519:
+        return ServerResponse(SERVER_VERSION, CODE_ERROR, b"")
+
+    username = payload[:REG_NAME_LEN].rstrip(b"\x00 ").decode("ascii", errors="ignore")
+    # stored as Base64 text so the publicKey column keeps one format
+    raw_key = payload[REG_NAME_LEN + 1:]
+    public_key = base64.b64encode(raw_key).decode("ascii")
+    return _register(db, username, public_key, key_type, requester_uuid)
+
+class SeedDirectory:
+    """Where a join is checked: the seed node, which saw every registration.
+
+    'address' is (host, port) from a "seed:" line in myport.info; None on
+    the seed itself (or a single node), which refuses every join of a
+    UUID it does not hold.
+    """
+    TIMEOUT = 5.0
+
+    def __init__(self):
+        self.address = None
+
+    def confirms(self, unique_id: bytes, username: str, public_key: str, key_type: int) -> bool:
+        """True if the seed holds exactly this UUID, name and key (608 lookup)."""
+        if self.address is None:
+            return False
+        key = _wire_key(public_key, key_type)
+        if key is None:
+            return False
+        name = username.encode("ascii", errors="ignore")[:REG_NAME_LEN]
+        payload = name.ljust(REG_NAME_LEN, b"\x00")
+        try:
+            with socket.create_connection(self.address, timeout=self.TIMEOUT) as s:
+                s.sendall(struct.pack("<16sBHI", NIL_UUID, CLIENT_VERSION_SUPPORTED,
+                                      CODE_LOOKUP_USER_REQ, len(payload)) + payload)
+                _ver, code, size = struct.unpack("<BHI", read_exact(s, 7))
+                reply = read_exact(s, size) if size > 0 else b""
+        except (OSError, ConnectionError) as e:
+            print(f"[warn] seed {self.address} unreachable, join refused: {e}")
+            return False
+        return code == CODE_LOOKUP_USER_OK and reply == unique_id + struct.pack("<B", key_type) + key
+
+SEED = SeedDirectory()
+
+def _register(db: Database, username: str, public_key: str, key_type: int,
+              requester_uuid: bytes) -> ServerResponse:
+    if requester_uuid != NIL_UUID:
+        existing = db.get_username_by_uuid(requester_uuid)
+        if existing == username:
+            return ServerResponse(SERVER_VERSION, CODE_REGISTRATION_OK, requester_uuid)
+        if existing is not None:
+            return ServerResponse(SERVER_VERSION, CODE_ERROR, b"")
+        # anyone may claim a UUID: only store it with the name and key the seed has
+        if not SEED.confirms(requester_uuid, username, public_key, key_type):
+            return ServerResponse(SERVER_VERSION, CODE_ERROR, b"")
 
     # Check username existence
     if db.username_exists(username):
         return ServerResponse(SERVER_VERSION, CODE_ERROR, b"")
 
-    # Create UUID and store
-    uid = uuid.uuid4().bytes  # 16 bytes
-    db.insert_client_with_uuid(username=username, public_key=public_key, unique_id_bytes=uid)
+    # Create UUID (unless joining with one) and store
+    uid = requester_uuid if requester_uuid != NIL_UUID else uuid.uuid4().bytes  # 16 bytes
+    db.insert_client_with_uuid(username=username, public_key=public_key, unique_id_bytes=uid,
+                               key_type=key_type)
 
     return ServerResponse(SERVER_VERSION, CODE_REGISTRATION_OK, uid)
 
+class ReplyCache:
+    """Replies built from the Clients table, kept serialized until it changes.
+
+    The directory is every 2101 entry in username order, built once; a
+    list request copies it around the requester's own entry. Public-key
+    replies (2102 / 2106) are kept per client once asked for. Everything
+    is dropped when data.db.clients_version() moves (a registration).
+    """
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.version = -1
+        self.directory = None  # bytes
+        self.entry_at = {}     # uniqueId -> offset of its entry in directory
+        self.keys = {}         # uniqueId -> 606 reply
+
+    def _check(self) -> int:
+        """Drops what is stale; caller holds the lock. Returns the version."""
+        version = clients_version()
+        if version != self.version:
+            self.version = version
+            self.directory = None
+            self.entry_at = {}
+            self.keys = {}
+        return version
+
+    def clients_list(self, db: Database, requester_uuid: bytes) -> bytes:
+        with self.lock:
+            self._check()
+            if self.directory is None:
+                self.directory, self.entry_at = _build_directory(db)
+            blob, at = self.directory, self.entry_at.get(requester_uuid)
+        if at is None:
+            return blob
+        return blob[:at] + blob[at + ENTRY_TOTAL:]
+
+    def public_key(self, db: Database, target_uid: bytes) -> ServerResponse:
+        with self.lock:
+            version = self._check()
+            resp = self.keys.get(target_uid)
+        if resp is not None:
+            return resp
+        resp = _public_key_response(db, target_uid)
+        if resp.code != CODE_ERROR:
+            with self.lock:
+                if self._check() == version:  # not built from a stale read
+                    self.keys[target_uid] = resp
+        return resp
+
+REPLY_CACHE = ReplyCache()
+
+def _build_directory(db: Database) -> tuple:
+    # repeating (16 bytes uuid + 255 bytes name (ASCII, NUL-terminated, padded))
+    parts = []
+    entry_at = {}
+    for uid_bytes, username in db.get_clients_excluding_uuid(NIL_UUID):  # every registered client
+        if uid_bytes is None or len(uid_bytes) != 16:
+            # skip malformed rows silently
+            continue
+        entry_at[uid_bytes] = len(parts) * ENTRY_TOTAL
+        name_bytes = username.encode("ascii", errors="ignore")
+        entry = bytearray(ENTRY_TOTAL)
+        entry[:ENTRY_UUID_LEN] = uid_bytes
+        n = min(len(name_bytes), ENTRY_NAME_LEN - 1)  # leave space for '\0'
+        entry[ENTRY_UUID_LEN:ENTRY_UUID_LEN + n] = name_bytes[:n]
+        parts.append(bytes(entry))
+    return b"".join(parts), entry_at
+
 def handle_clients_list(db: Database, requester_uuid: bytes) -> ServerResponse:
-    # Build payload: repeating (16 bytes uuid + 255 bytes name (ASCII, NUL-terminated, padded))
     try:
-        rows = db.get_clients_excluding_uuid(requester_uuid)
-        parts = []
-        for uid_bytes, username in rows:
-            if uid_bytes is None or len(uid_bytes) != 16:
-                # skip malformed rows silently
-                continue
-            # 16 bytes UUID
-            parts.append(uid_bytes)
-            # 255 bytes name (ASCII, NUL-terminated, padded)
-            name_bytes = username.encode("ascii", errors="ignore")
-            name_field = bytearray(ENTRY_NAME_LEN)
-            n = min(len(name_bytes), ENTRY_NAME_LEN - 1)  # leave space for '\0'
-            name_field[:n] = name_bytes[:n]
-            name_field[n] = 0
-            parts.append(bytes(name_field))
-        payload = b"".join(parts)
+        payload = REPLY_CACHE.clients_list(db, requester_uuid)
         return ServerResponse(SERVER_VERSION, CODE_CLIENTS_LIST_OK, payload)
     except Exception:
         return ServerResponse(SERVER_VERSION, CODE_ERROR, b"")
 
+def message_expiry(msg_type: int) -> int:
+    """Unix time after which an unpulled message of this type is dropped."""
+    return int(time.time()) + MESSAGE_TTL_BY_TYPE.get(msg_type, MESSAGE_TTL_DEFAULT)
+
 def handle_send_message(db: Database, requester_uuid: bytes, payload: bytes) -> ServerResponse:
     # Payload: destClientId(16) + msgType(1) + contentSize(4 LE) + content
     if len(payload) < 16 + 1 + 4:
@@ -130,11 +344,55 @@ def handle_send_message(db: Database, requester_uuid: bytes, payload: bytes) ->
     if to_rowid is None or from_rowid is None:
         return ServerResponse(SERVER_VERSION, CODE_ERROR, b"")
 
-    mid = db.save_message(to_rowid, from_rowid, int(msg_type), content)
+    mid = db.save_message(to_rowid, from_rowid, int(msg_type), content, message_expiry(msg_type))
     # Response payload: ClientID(16 dest) + MessageID(4 LE)
     resp = dest_uuid + struct.pack("<I", mid)
     return ServerResponse(SERVER_VERSION, CODE_SEND_MESSAGE_OK, resp)
 
+def handle_send_batch(db: Database, requester_uuid: bytes, payload: bytes) -> ServerResponse:
+    """Stores many messages from one frame and acks them all at once.
+
+    Items addressed to an unknown client get message ID 0; the others are
+    saved in a single transaction. A malformed frame is rejected whole.
+    """
+    if len(payload) < 4:
+        return ServerResponse(SERVER_VERSION, CODE_ERROR, b"")
+    count = struct.unpack_from("<I", payload, 0)[0]
+    pos = 4
+    items = []
+    for _ in range(count):
+        if len(payload) - pos < 16 + 1 + 4:
+            return ServerResponse(SERVER_VERSION, CODE_ERROR, b"")
+        dest_uuid = payload[pos:pos + 16]
+        msg_type = payload[pos + 16]
+        content_size = struct.unpack_from("<I", payload, pos + 17)[0]
+        pos += 21
+        if len(payload) - pos < content_size:
+            return ServerResponse(SERVER_VERSION, CODE_ERROR, b"")
+        items.append((dest_uuid, msg_type, payload[pos:pos + content_size]))
+        pos += content_size
+    if pos != len(payload):
+        return ServerResponse(SERVER_VERSION, CODE_ERROR, b"")
+
+    from_rowid = db.get_rowid_by_uuid(requester_uuid)
+    if from_rowid is None:
+        return ServerResponse(SERVER_VERSION, CODE_ERROR, b"")
+
+    rowids = {}
+    to_store = []
+    for dest_uuid, msg_type, content in items:
+        if dest_uuid not in rowids:
+            rowids[dest_uuid] = db.get_rowid_by_uuid(dest_uuid)
+        if rowids[dest_uuid] is not None:
+            to_store.append((rowids[dest_uuid], int(msg_type), content, message_expiry(msg_type)))
+    stored = iter(db.save_messages(from_rowid, to_store))
+
+    parts = [struct.pack("<I", count)]
+    for dest_uuid, _, _ in items:
+        mid = next(stored) if rowids[dest_uuid] is not None else 0
+        parts.append(dest_uuid + struct.pack("<I", mid))
+    return ServerResponse(SERVER_VERSION, CODE_SEND_BATCH_OK, b"".join(parts))
+
 def handle_pull_waiting(db: Database, requester_uuid: bytes) -> ServerResponse:
     to_rowid = db.get_rowid_by_uuid(requester_uuid)
     if to_rowid is None:
@@ -158,10 +416,80 @@ def handle_public_key_request(db: Database, payload: bytes) -> ServerResponse:
     # payload must be exactly 16 bytes: target client's unique ID
     if len(payload) != 16:
         return ServerResponse(SERVER_VERSION, CODE_ERROR, b"")
-    target_uid = payload
-    pk = db.get_public_key_by_uuid(target_uid)
-    if pk is None:
+    resp = REPLY_CACHE.public_key(db, payload)
+    # an X25519 key is useless to a client that only speaks RSA
+    if resp.code != CODE_PUBLIC_KEY_OK:
+        return ServerResponse(SERVER_VERSION, CODE_ERROR, b"")
+    return resp
+
+def handle_public_key_request_v2(db: Database, payload: bytes) -> ServerResponse:
+    """606: answers 2102 for an RSA client, 2106 (id + keyType + 32B key) for X25519."""
+    if len(payload) != 16:
         return ServerResponse(SERVER_VERSION, CODE_ERROR, b"")
+    return REPLY_CACHE.public_key(db, payload)
+
+def _public_key_response(db: Database, target_uid: bytes) -> ServerResponse:
+    row = db.get_public_key_and_type_by_uuid(target_uid)
+    if row is None:
+        return ServerResponse(SERVER_VERSION, CODE_ERROR, b"")
+    pk, key_type = row
+    if key_type == KEY_TYPE_RSA:
+        return _rsa_public_key_response(target_uid, pk)
+    try:
+        raw_key = base64.b64decode(pk, validate=True)
+    except ValueError:
+        return ServerResponse(SERVER_VERSION, CODE_ERROR, b"")
+    if len(raw_key) != X25519_PUB_LEN:
+        return ServerResponse(SERVER_VERSION, CODE_ERROR, b"")
+    resp_payload = target_uid + struct.pack("<B", key_type) + raw_key
+    return ServerResponse(SERVER_VERSION, CODE_PUBLIC_KEY_V2_OK, resp_payload)
+
+def handle_lookup_user(db: Database, payload: bytes) -> ServerResponse:
+    """608: id and public key of a user by name, without the full clients list."""
+    if len(payload) != REG_NAME_LEN:
+        return ServerResponse(SERVER_VERSION, CODE_ERROR, b"")
+    username = payload.rstrip(b"\x00 ").decode("ascii", errors="ignore")
+    row = db.get_client_by_username(username)
+    if row is None:
+        return ServerResponse(SERVER_VERSION, CODE_ERROR, b"")
+    target_uid, pk, key_type = row
+    key = _wire_key(pk, key_type)
+    if key is None:
+        return ServerResponse(SERVER_VERSION, CODE_ERROR, b"")
+    resp_payload = target_uid + struct.pack("<B", key_type) + key
+    return ServerResponse(SERVER_VERSION, CODE_LOOKUP_USER_OK, resp_payload)
+
+def handle_public_keys(db: Database, payload: bytes) -> ServerResponse:
+    """611: the public keys of many clients, from one query, in one reply."""
+    if len(payload) < 4:
+        return ServerResponse(SERVER_VERSION, CODE_ERROR, b"")
+    count = struct.unpack_from("<I", payload, 0)[0]
+    if count > PUBLIC_KEYS_MAX or len(payload) != 4 + 16 * count:
+        return ServerResponse(SERVER_VERSION, CODE_ERROR, b"")
+    uids = [payload[4 + 16 * i:20 + 16 * i] for i in range(count)]
+    keys = db.get_public_keys_by_uuids(uids)
+
+    parts = [struct.pack("<I", count)]
+    for uid in uids:
+        row = keys.get(uid)
+        key = _wire_key(*row) if row else None
+        if key is None:
+            parts.append(uid + struct.pack("<BH", 0, 0))
+        else:
+            parts.append(uid + struct.pack("<BH", row[1], len(key)) + key)
+    return ServerResponse(SERVER_VERSION, CODE_PUBLIC_KEYS_OK, b"".join(parts))
+
+def _wire_key(pk: str, key_type: int) -> Optional[bytes]:
+    """A stored key as 608/611 send it: Base64 DER text (RSA) or the 32 raw bytes."""
+    if key_type == KEY_TYPE_RSA:
+        return pk.encode("ascii", errors="ignore")
+    try:
+        key = base64.b64decode(pk, validate=True)
+    except ValueError:
+        return None
+    return key if len(key) == X25519_PUB_LEN else None
+
+def _rsa_public_key_response(target_uid: bytes, pk: str) -> ServerResponse:
     pk_bytes = pk.encode("ascii", errors="ignore")
     field = bytearray(PUBKEY_RESP_KEY_LEN)
     n = min(len(pk_bytes), PUBKEY_RESP_KEY_LEN)
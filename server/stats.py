@@ -0,0 +1,179 @@
+# stats.py
+"""Server instrumentation: per-opcode latency histograms (split by phase),
+byte and error counters, and time spent inside Database methods.
+
+Phases of one request:
+    db       inside Database methods called by the handler
+    handler  the rest of the handler (validation, payload assembly)
+    send     writing the reply frame
+    total    handler + send
+
+Requests held back by the rate limiter (network/rate_limit.py) add their
+wait to a "throttle" histogram of their opcode; refused ones are counted.
+
+Everything is kept in log-linear histograms like the client's (Stats.h):
+each power of two of nanoseconds is split into 8 linear sub-buckets.
+snapshot() returns it all as a dict; the 610 opcode sends it as JSON.
+"""
+from __future__ import annotations
+import functools
+import threading
+import time
+
+SUB_BITS = 3
+SUB_BUCKETS = 1 << SUB_BITS
+MAX_SHIFT = 40  # values above ~2^44 ns are clamped
+BUCKETS = SUB_BUCKETS * (MAX_SHIFT + 2)
+
+PHASES = ("db", "handler", "send", "total")
+
+class LatencyHistogram:
+    def __init__(self):
+        self.buckets = [0] * BUCKETS
+        self.count = 0
+        self.sum_ns = 0
+        self.max_ns = 0
+
+    @staticmethod
+    def bucket_of(ns: int) -> int:
+        if ns < SUB_BUCKETS:
+            return ns
+        shift = ns.bit_length() - 1 - SUB_BITS  # keep the top SUB_BITS+1 bits
+        if shift > MAX_SHIFT:
+            return BUCKETS - 1
+        return (shift + 1) * SUB_BUCKETS + ((ns >> shift) - SUB_BUCKETS)
+
+    @staticmethod
+    def bucket_upper_bound(idx: int) -> int:
+        if idx < SUB_BUCKETS:
+            return idx
+        shift = idx // SUB_BUCKETS - 1
+        return ((SUB_BUCKETS + idx % SUB_BUCKETS + 1) << shift) - 1
+
+    def record(self, ns: int) -> None:
+        self.buckets[self.bucket_of(ns)] += 1
+        self.count += 1
+        self.sum_ns += ns
+        if ns > self.max_ns:
+            self.max_ns = ns
+
+    def percentile(self, p: float) -> int:
+        if not self.count:
+            return 0
+        rank = max(1, int(self.count * p / 100.0 + 0.5))
+        seen = 0
+        for idx, n in enumerate(self.buckets):
+            seen += n
+            if seen >= rank:
+                return min(self.bucket_upper_bound(idx), self.max_ns)
+        return self.max_ns
+
+    def summary(self) -> dict:
+        us = lambda ns: round(ns / 1000.0, 1)
+        return {
+            "count": self.count,
+            "p50_us": us(self.percentile(50)),
+            "p90_us": us(self.percentile(90)),
+            "p99_us": us(self.percentile(99)),
+            "max_us": us(self.max_ns),
+            "mean_us": us(self.sum_ns / self.count) if self.count else 0.0,
+        }
+
+class PerCode:
+    def __init__(self):
+        self.phases = {p: LatencyHistogram() for p in PHASES}
+        self.bytes_in = 0
+        self.bytes_out = 0
+        self.errors = 0  # replies with CODE_ERROR
+        self.throttle = LatencyHistogram()  # waits of requests held back
+        self.rejected = 0                   # refused by the rate limiter
+
+class ServerStats:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.started = time.time()
+        self.codes = {}
+        self.db_methods = {}
+        self.local = threading.local()  # db time of the request on this thread
+
+    # ----- Database time -----
+    def db_call(self, name: str, ns: int) -> None:
+        self.local.db_ns = getattr(self.local, "db_ns", 0) + ns
+        with self.lock:
+            hist = self.db_methods.get(name)
+            if hist is None:
+                hist = self.db_methods[name] = LatencyHistogram()
+            hist.record(ns)
+
+    def take_db_ns(self) -> int:
+        """Database time of this thread since the last call."""
+        ns = getattr(self.local, "db_ns", 0)
+        self.local.db_ns = 0
+        return ns
+
+    # ----- Requests -----
+    def record_request(self, code: int, handler_ns: int, db_ns: int, send_ns: int,
+                       bytes_in: int, bytes_out: int, error: bool) -> None:
+        with self.lock:
+            pc = self.codes.get(code)
+            if pc is None:
+                pc = self.codes[code] = PerCode()
+            pc.phases["db"].record(db_ns)
+            pc.phases["handler"].record(max(0, handler_ns - db_ns))
+            pc.phases["send"].record(send_ns)
+            pc.phases["total"].record(handler_ns + send_ns)
+            pc.bytes_in += bytes_in
+            pc.bytes_out += bytes_out
+            pc.errors += 1 if error else 0
+
+    def record_throttle(self, code: int, wait_ns: int, rejected: bool) -> None:
+        with self.lock:
+            pc = self.codes.get(code)
+            if pc is None:
+                pc = self.codes[code] = PerCode()
+            if rejected:
+                pc.rejected += 1
+            else:
+                pc.throttle.record(wait_ns)
+
+    def snapshot(self) -> dict:
+        with self.lock:
+            return {
+                "uptime_s": round(time.time() - self.started, 1),
+                "opcodes": {
+                    str(code): {
+                        "bytes_in": pc.bytes_in,
+                        "bytes_out": pc.bytes_out,
+                        "errors": pc.errors,
+                        "rejected": pc.rejected,
+                        "throttle": pc.throttle.summary(),
+                        "phases": {p: h.summary() for p, h in pc.phases.items()},
+                    }
+                    for code, pc in sorted(self.codes.items())
+                },
+                "db": {name: h.summary() for name, h in sorted(self.db_methods.items())},
+            }
+
+    def reset(self) -> None:
+        with self.lock:
+            self.started = time.time()
+            self.codes.clear()
+            self.db_methods.clear()
+
+STATS = ServerStats()
+
+def timed_db_methods(cls):
+    """Class decorator: every public method's time goes to STATS.db_call."""
+    def wrap(name, fn):
+        @functools.wraps(fn)
+        def timed(*args, **kwargs):
+            t0 = time.perf_counter_ns()
+            try:
+                return fn(*args, **kwargs)
+            finally:
+                STATS.db_call(name, time.perf_counter_ns() - t0)
+        return timed
+    for name, fn in list(vars(cls).items()):
+        if callable(fn) and not name.startswith("_") and name not in ("connect", "close"):
+            setattr(cls, name, wrap(name, fn))
+    return cls